@@ -0,0 +1,83 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/*
+ * Benchmark of the split that an append of increasing keys takes at the rightmost leaf and non-leaves.
+ * An INTEGER index is filled one insertEntry at a time with even keys in increasing order, and in random
+ * order as a control that appends only now and then, with the left node of an append split keeping half,
+ * the default and all of a node. Each index reports its pages, its bytes per entry and its inserts per
+ * second, and then the pages it grows to when odd keys in random order land between the even ones.
+ */
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "btree.h"
+#include "bench_util.h"
+
+using namespace badgerdb;
+using namespace bench;
+
+const std::string relationName = "bench_append_rel";
+const int numKeys = 1000000;
+const int numBetween = 100000;
+const int bufferFrames = 1000;
+
+int main()
+{
+	const double fills[] = {0.5, DEFAULT_APPEND_FILL, 1.0};
+	// A relation of a single record, whose key comes before every inserted one.
+	createRelation(relationName, std::vector<int>(1, -1));
+	std::printf("%d inserts of even keys, then %d of odd keys between them, %d buffer frames\n",
+				numKeys, numBetween, bufferFrames);
+	std::printf("  order       fill   pages  bytes/entry  inserts/s  pages after odd keys\n");
+	for (int sequential = 1; sequential >= 0; sequential--)
+	{
+		const std::vector<int> keys = relationKeys(sequential ? ASCENDING : SHUFFLED, numKeys, 2);
+		for (int f = 0; f < 3; f++)
+		{
+			BufMgr bufMgr(bufferFrames);
+			std::string indexName;
+			RecordId rid;
+			rid.page_number = 1;
+			rid.slot_number = 1;
+			double seconds;
+			size_t count;
+			long bytes;
+			{
+				BTreeIndex index(relationName, indexName, &bufMgr, offsetof(Record, i), INTEGER);
+				index.setAppendFill(fills[f]);
+				Timer timer;
+				for (int i = 0; i < numKeys; i++)
+				{
+					index.insertEntry(&keys[i], rid);
+				}
+				seconds = timer.seconds();
+				const int low = 0, high = 2 * numKeys;
+				count = index.countRange(&low, GTE, &high, LT);
+			}
+			bytes = fileBytes(indexName);
+			{
+				BTreeIndex index(relationName, indexName, &bufMgr, offsetof(Record, i), INTEGER);
+				unsigned seed = 54321;
+				for (int i = 0; i < numBetween; i++)
+				{
+					seed = seed * 1103515245 + 12345;
+					const int key = 2 * (int)((seed >> 8) % numKeys) + 1;
+					index.insertEntry(&key, rid);
+				}
+			}
+			const long after = fileBytes(indexName);
+			std::printf("  %-10s  %4.2f  %6ld  %11.2f  %9.0f  %20ld%s\n", sequential ? "increasing" : "random",
+						fills[f], bytes / Page::SIZE, (double)bytes / numKeys, numKeys / seconds, after / Page::SIZE,
+						count == (size_t)numKeys ? "" : "  (entries missing)");
+			File::remove(indexName);
+		}
+	}
+	File::remove(relationName);
+	return 0;
+}
@@ -0,0 +1,178 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/*
+ * Relation set-up and timing shared by the benchmarks, which keep only their measurement loops.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "page.h"
+#include "file.h"
+#include "exceptions/file_not_found_exception.h"
+#include "exceptions/insufficient_space_exception.h"
+
+namespace bench {
+
+/**
+ * @brief Record of the benchmark relations, indexed on i, with d as a payload column.
+ */
+struct Record
+{
+  int i;
+  double d;
+  char s[64];
+};
+
+/**
+ * @brief Order of the keys of a benchmark relation in its file.
+ */
+enum KeyOrder
+{
+  ASCENDING,
+  SHUFFLED
+};
+
+/**
+ * Shuffle the keys with the benchmarks' linear congruential generator, advancing seed.
+ */
+inline void shuffleKeys(std::vector<int> &keys, unsigned &seed)
+{
+  for (int i = (int)keys.size() - 1; i > 0; i--)
+  {
+    seed = seed * 1103515245 + 12345;
+    std::swap(keys[i], keys[(seed >> 8) % (i + 1)]);
+  }
+}
+
+/**
+ * Keys 0, step, 2 * step, ... of n records, in the given order.
+ */
+inline std::vector<int> relationKeys(const KeyOrder order, const int n, const int step = 1)
+{
+  std::vector<int> keys(n);
+  for (int i = 0; i < n; i++)
+  {
+    keys[i] = i * step;
+  }
+  if (order == SHUFFLED)
+  {
+    unsigned seed = 12345;
+    shuffleKeys(keys, seed);
+  }
+  return keys;
+}
+
+/**
+ * Remove the file if it exists.
+ */
+inline void removeFile(const std::string &name)
+{
+  try
+  {
+    badgerdb::File::remove(name);
+  }
+  catch (const badgerdb::FileNotFoundException &e)
+  {
+  }
+}
+
+/**
+ * Create the relation afresh with a record for each key, in order, whose d is the key as well.
+ * No keys leave the file without pages.
+ */
+inline void createRelation(const std::string &name, const std::vector<int> &keys)
+{
+  removeFile(name);
+  badgerdb::PageFile file = badgerdb::PageFile::create(name);
+  if (keys.empty())
+  {
+    return;
+  }
+  Record record;
+  memset(&record, 0, sizeof(record));
+  badgerdb::PageId pageNo;
+  badgerdb::Page page = file.allocatePage(pageNo);
+  for (size_t i = 0; i < keys.size(); i++)
+  {
+    record.i = keys[i];
+    record.d = (double)keys[i];
+    std::string data(reinterpret_cast<char *>(&record), sizeof(record));
+    while (true)
+    {
+      try
+      {
+        page.insertRecord(data);
+        break;
+      }
+      catch (const badgerdb::InsufficientSpaceException &e)
+      {
+        file.writePage(pageNo, page);
+        page = file.allocatePage(pageNo);
+      }
+    }
+  }
+  file.writePage(pageNo, page);
+}
+
+/**
+ * Create the relation afresh with n records whose keys are 0 .. n - 1 in the given order.
+ */
+inline void createRelation(const std::string &name, const KeyOrder order, const int n)
+{
+  createRelation(name, relationKeys(order, n));
+}
+
+/**
+ * Bytes of the file, such as an index after it is closed.
+ */
+inline long fileBytes(const std::string &name)
+{
+  std::ifstream file(name.c_str(), std::ios::binary | std::ios::ate);
+  return (long)file.tellg();
+}
+
+/**
+ * @brief Wall-clock time since the timer was started.
+ */
+class Timer
+{
+ public:
+  Timer()
+    : start(std::chrono::steady_clock::now())
+  {
+  }
+
+  /**
+   * Start timing again from now.
+   */
+  void restart()
+  {
+    start = std::chrono::steady_clock::now();
+  }
+
+  double seconds() const
+  {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  double millis() const
+  {
+    return seconds() * 1000;
+  }
+
+ private:
+  std::chrono::steady_clock::time_point start;
+};
+
+}
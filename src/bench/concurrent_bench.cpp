@@ -0,0 +1,113 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/*
+ * Throughput benchmark for concurrent use of one index. Bulk loads an index on an INTEGER relation,
+ * then runs 1, 2, 4 and 8 threads that each mix insertEntry calls with short range scans, and
+ * reports the operations per second reached with each number of threads.
+ */
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include "btree.h"
+#include "bench_util.h"
+
+using namespace badgerdb;
+using namespace bench;
+
+const std::string relationName = "bench_rel";
+const int relationSize = 100000;
+const int opsPerRun = 200000;
+// One operation in scanEvery is a range scan, the others are inserts
+const int scanEvery = 4;
+const int scanWidth = 100;
+
+/**
+ * Runs opsPerRun operations split over the given number of threads and returns the operations per second.
+ */
+double run(const int numThreads)
+{
+	BufMgr bufMgr(1000);
+	// Set by the index to the name of the file it creates
+	std::string indexName;
+	double opsPerSecond;
+	{
+		// Leave room in the nodes so that the first inserts do not all split
+		BTreeIndex index(relationName, indexName, &bufMgr, offsetof(Record, i), INTEGER, true, 0.7);
+		std::atomic<long> scanned(0);
+		std::vector<std::thread> threads;
+		Timer timer;
+		for (int t = 0; t < numThreads; t++)
+		{
+			threads.push_back(std::thread([&index, &scanned, t, numThreads]() {
+				unsigned seed = 12345 + 7919 * t;
+				long found = 0;
+				for (int op = t; op < opsPerRun; op += numThreads)
+				{
+					seed = seed * 1103515245 + 12345;
+					const int key = (int)((seed >> 8) % (2 * relationSize));
+					if (op % scanEvery == 0)
+					{
+						const int high = key + scanWidth;
+						ScanCursor cursor = index.openScan(&key, GTE, &high, LT);
+						RecordId rids[scanWidth];
+						size_t got;
+						while ((got = cursor.scanNextBatch(rids, scanWidth)) > 0)
+						{
+							found += got;
+						}
+					}
+					else
+					{
+						// Odd keys fall between the relation's even ones
+						const int newKey = key | 1;
+						RecordId rid;
+						rid.page_number = newKey;
+						rid.slot_number = t;
+						index.insertEntry(&newKey, rid);
+					}
+				}
+				scanned += found;
+			}));
+		}
+		for (int t = 0; t < numThreads; t++)
+		{
+			threads[t].join();
+		}
+		opsPerSecond = opsPerRun / timer.seconds();
+		std::printf("  %d thread%s %10.0f ops/s  (%ld entries scanned)\n", numThreads, numThreads == 1 ? " " : "s",
+					opsPerSecond, (long)scanned);
+	}
+	File::remove(indexName);
+	return opsPerSecond;
+}
+
+int main()
+{
+	createRelation(relationName, relationKeys(ASCENDING, relationSize, 2));
+	std::printf("%d operations, one in %d a scan of %d keys, on an index of %d keys (%u hardware threads)\n",
+				opsPerRun, scanEvery, scanWidth, relationSize, std::thread::hardware_concurrency());
+	const int threadCounts[] = {1, 2, 4, 8};
+	double single = 0;
+	for (size_t i = 0; i < sizeof(threadCounts) / sizeof(threadCounts[0]); i++)
+	{
+		const double opsPerSecond = run(threadCounts[i]);
+		if (i == 0)
+		{
+			single = opsPerSecond;
+		}
+		else
+		{
+			std::printf("    speedup over 1 thread: %.2fx\n", opsPerSecond / single);
+		}
+	}
+	File::remove(relationName);
+	return 0;
+}
@@ -0,0 +1,126 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/*
+ * Benchmark of fetching the records of index range scans from the base relation. The relation holds
+ * its INTEGER keys in random order, so the records of a key range are spread over the whole file.
+ * Each range is fetched once with the per record id loop of intScan in main.cpp, which reads the heap
+ * page of every record id in key order, and once with BitmapHeapScan, which reads each page once in
+ * file order. Reports the time and the heap page reads of both, with a buffer pool much smaller than
+ * the relation.
+ */
+
+#include <cstdio>
+#include <string>
+#include "btree.h"
+#include "heapscan.h"
+#include "bench_util.h"
+#include "exceptions/end_of_file_exception.h"
+#include "exceptions/index_scan_completed_exception.h"
+
+using namespace badgerdb;
+using namespace bench;
+
+const std::string relationName = "bench_heap_rel";
+const int relationSize = 200000;
+const int bufferFrames = 100;
+// Fractions of the relation covered by the ranges, in per mille
+const int rangeWidths[] = {1, 10, 50, 200};
+const int rangesPerWidth = 5;
+
+/**
+ * Sum of the double field of the records in [low, high), fetched one record id at a time in key order.
+ */
+double perRidFetch(BTreeIndex &index, File *file, BufMgr &bufMgr, const int low, const int high)
+{
+	double sum = 0;
+	ScanCursor cursor = index.openScan(&low, GTE, &high, LT);
+	RecordId rid;
+	try
+	{
+		while (true)
+		{
+			cursor.scanNext(rid);
+			Page *page;
+			bufMgr.readPage(file, rid.page_number, page);
+			const Record record = *(reinterpret_cast<const Record *>(page->getRecord(rid).data()));
+			bufMgr.unPinPage(file, rid.page_number, false);
+			sum += record.d;
+		}
+	}
+	catch (const IndexScanCompletedException &e)
+	{
+	}
+	return sum;
+}
+
+/**
+ * Sum of the double field of the records in [low, high), fetched with a BitmapHeapScan.
+ */
+double bitmapFetch(BTreeIndex &index, File *file, BufMgr &bufMgr, const int low, const int high)
+{
+	double sum = 0;
+	ScanCursor cursor = index.openScan(&low, GTE, &high, LT);
+	BitmapHeapScan heapScan(file, &bufMgr, cursor);
+	RecordId rid;
+	try
+	{
+		while (true)
+		{
+			heapScan.scanNext(rid);
+			const std::string data = heapScan.getRecord();
+			sum += reinterpret_cast<const Record *>(data.data())->d;
+		}
+	}
+	catch (const EndOfFileException &e)
+	{
+	}
+	return sum;
+}
+
+int main()
+{
+	createRelation(relationName, SHUFFLED, relationSize);
+	BufMgr bufMgr(bufferFrames);
+	std::string indexName;
+	{
+		PageFile relation(relationName, false);
+		BTreeIndex index(relationName, indexName, &bufMgr, offsetof(Record, i), INTEGER);
+		std::printf("%d records in random key order, %d buffer frames, %d ranges per width\n",
+					relationSize, bufferFrames, rangesPerWidth);
+		std::printf("  width  per-rid ms  heap reads   bitmap ms  heap reads\n");
+		for (size_t w = 0; w < sizeof(rangeWidths) / sizeof(rangeWidths[0]); w++)
+		{
+			const int width = relationSize / 1000 * rangeWidths[w];
+			double times[2] = {0, 0};
+			int reads[2] = {0, 0};
+			double sums[2] = {0, 0};
+			for (int r = 0; r < rangesPerWidth; r++)
+			{
+				const int low = (int)((long)r * (relationSize - width) / rangesPerWidth);
+				for (int method = 0; method < 2; method++)
+				{
+					// Start from a pool holding only index pages, as left by the other method
+					bufMgr.flushFile(&relation);
+					bufMgr.clearBufStats();
+					Timer timer;
+					sums[method] += method == 0 ? perRidFetch(index, &relation, bufMgr, low, low + width)
+												: bitmapFetch(index, &relation, bufMgr, low, low + width);
+					times[method] += timer.millis();
+					reads[method] += bufMgr.getBufStats().diskreads;
+				}
+			}
+			std::printf("  %4.1f%%  %10.1f  %10d  %10.1f  %10d%s\n", rangeWidths[w] / 10.0,
+						times[0] / rangesPerWidth, reads[0] / rangesPerWidth,
+						times[1] / rangesPerWidth, reads[1] / rangesPerWidth,
+						sums[0] == sums[1] ? "" : "  (results differ)");
+		}
+	}
+	File::remove(indexName);
+	File::remove(relationName);
+	return 0;
+}
@@ -0,0 +1,92 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/*
+ * Benchmark of point lookups on an INTEGER index of three levels, with the hot-node cache holding the
+ * top levels and with it turned off. Loads the keys with insertBatch into an index over an empty
+ * relation, then looks up random keys on 1 and 4 threads, and reports the lookups per second and the
+ * buffer manager calls the cache saved per lookup.
+ */
+
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include "btree.h"
+#include "bench_util.h"
+
+using namespace badgerdb;
+using namespace bench;
+
+const std::string relationName = "bench_hot_rel";
+const int numKeys = 1000000;
+const int numLookups = 2000000;
+const int bufferFrames = 5000;
+
+/**
+ * Run numLookups lookups of random keys split over the given number of threads and print their rate.
+ */
+void run(BTreeIndex &index, const int levels, const int numThreads)
+{
+	index.setHotLevels(levels);
+	const std::uint64_t saved = index.getBufferCallsSaved();
+	std::vector<std::thread> threads;
+	Timer timer;
+	for (int t = 0; t < numThreads; t++)
+	{
+		threads.push_back(std::thread([&index, t, numThreads]() {
+			unsigned seed = 12345 + 7919 * t;
+			for (int n = t; n < numLookups; n += numThreads)
+			{
+				seed = seed * 1103515245 + 12345;
+				const int key = (int)((seed >> 8) % numKeys);
+				if (!index.contains(&key))
+				{
+					std::printf("  key %d missing\n", key);
+				}
+			}
+		}));
+	}
+	for (int t = 0; t < numThreads; t++)
+	{
+		threads[t].join();
+	}
+	std::printf("  %d level%s  %d thread%s %10.0f lookups/s  %5.2f buffer calls saved per lookup\n", levels,
+				levels == 1 ? " " : "s", numThreads, numThreads == 1 ? " " : "s",
+				numLookups / timer.seconds(),
+				(double)(index.getBufferCallsSaved() - saved) / numLookups);
+}
+
+int main()
+{
+	createRelation(relationName, std::vector<int>());
+	BufMgr bufMgr(bufferFrames);
+	std::string indexName;
+	{
+		BTreeIndex index(relationName, indexName, &bufMgr, offsetof(Record, i), INTEGER, false);
+		std::vector<RIDKeyPair<int> > pairs(numKeys);
+		for (int n = 0; n < numKeys; n++)
+		{
+			RecordId rid = RecordId();
+			rid.page_number = n / 100 + 1;
+			rid.slot_number = n % 100 + 1;
+			pairs[n].set(rid, (int)((long)n * 7919 % numKeys));
+		}
+		index.insertBatch(&pairs[0], pairs.size());
+
+		std::printf("%d lookups of random keys among %d, %d buffer frames\n", numLookups, numKeys, bufferFrames);
+		const int threadCounts[] = {1, 4};
+		for (int t = 0; t < 2; t++)
+		{
+			run(index, 0, threadCounts[t]);
+			run(index, DEFAULT_HOT_LEVELS, threadCounts[t]);
+		}
+	}
+	File::remove(indexName);
+	File::remove(relationName);
+	return 0;
+}
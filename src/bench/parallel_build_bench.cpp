@@ -0,0 +1,60 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/*
+ * Benchmark of bulk loading an INTEGER index over a relation of shuffled keys with its pages scanned
+ * on 1 to 8 threads. Each build reports its time, its speedup over the build on one thread, and
+ * whether it holds every key. The threads share the buffer manager, whose reads are serialized, so
+ * the extraction of pairs and the sorting of the runs are what run in parallel.
+ */
+
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include "btree.h"
+#include "bench_util.h"
+
+using namespace badgerdb;
+using namespace bench;
+
+const std::string relationName = "bench_build_rel";
+const int relationSize = 1000000;
+const int bufferFrames = 5000;
+
+int main()
+{
+	createRelation(relationName, SHUFFLED, relationSize);
+	std::printf("Bulk load of %d records, %d buffer frames, %u hardware threads\n", relationSize, bufferFrames,
+				std::thread::hardware_concurrency());
+	BufMgr bufMgr(bufferFrames);
+	double serial = 0;
+	const int threadCounts[] = {1, 2, 4, 8};
+	for (int t = 0; t < 4; t++)
+	{
+		std::string indexName;
+		BuildOptions options;
+		options.threads = threadCounts[t];
+		Timer timer;
+		{
+			BTreeIndex index(relationName, indexName, &bufMgr, offsetof(Record, i), INTEGER, true,
+							 DEFAULT_FILL_FACTOR, std::vector<PayloadColumn>(), options);
+			const double seconds = timer.seconds();
+			if (t == 0)
+			{
+				serial = seconds;
+			}
+			int low = 0, high = relationSize;
+			const int found = index.countRange(&low, GTE, &high, LT);
+			std::printf("  %d thread%s %8.3f s  %5.2fx  %s\n", threadCounts[t], threadCounts[t] == 1 ? " " : "s",
+						seconds, serial / seconds, found == relationSize ? "all keys found" : "KEYS MISSING");
+		}
+		File::remove(indexName);
+	}
+	File::remove(relationName);
+	return 0;
+}
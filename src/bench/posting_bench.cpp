@@ -0,0 +1,143 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/*
+ * Benchmark of the space and scan time of INTEGER indexes over keys with many duplicates, whose leaves
+ * store each key once for the posting list of its record ids. The relations hold distinct keys, 1000
+ * keys drawn uniformly, and 10000 keys with Zipf-like skew, where key k is drawn about 1/k as often.
+ * Each index is built by the bulk loader and by single inserts, and reports its pages, its bytes per
+ * entry, the leaves that entries each storing their key would take, and the time of full scans with
+ * scanNextBatch and scanNext.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "btree.h"
+#include "bench_util.h"
+#include "exceptions/index_scan_completed_exception.h"
+
+using namespace badgerdb;
+using namespace bench;
+
+const std::string relationName = "bench_posting_rel";
+const int relationSize = 200000;
+const int bufferFrames = 1000;
+const int scanRounds = 5;
+
+enum Distribution
+{
+	DISTINCT,
+	UNIFORM,
+	SKEWED
+};
+
+const char *const distributionNames[] = {"distinct", "1000 uniform", "10000 skewed"};
+
+int drawKey(const Distribution distribution, const int i, unsigned &seed)
+{
+	seed = seed * 1103515245 + 12345;
+	const double u = ((seed >> 8) & 0xffffff) / (double)0x1000000;
+	switch (distribution)
+	{
+	case DISTINCT:
+		return i;
+	case UNIFORM:
+		return (int)(u * 1000);
+	default:
+		// Log-uniform keys, so that key k turns up about 1/k as often
+		return (int)std::exp(u * std::log(10000.0));
+	}
+}
+
+void createRelation(const Distribution distribution)
+{
+	std::vector<int> keys(relationSize);
+	unsigned seed = 12345;
+	for (int i = 0; i < relationSize; i++)
+	{
+		keys[i] = drawKey(distribution, i, seed);
+	}
+	shuffleKeys(keys, seed);
+	bench::createRelation(relationName, keys);
+}
+
+/**
+ * Entries returned by a full scan of the index, in batches of batchSize, or one at a time if it is 0.
+ */
+size_t fullScan(BTreeIndex &index, const size_t batchSize)
+{
+	const int low = -1;
+	const int high = relationSize;
+	size_t count = 0;
+	ScanCursor cursor = index.openScan(&low, GT, &high, LT);
+	if (batchSize > 0)
+	{
+		std::vector<RecordId> rids(batchSize);
+		size_t got;
+		while ((got = cursor.scanNextBatch(&rids[0], batchSize)) > 0)
+		{
+			count += got;
+		}
+		return count;
+	}
+	RecordId rid;
+	try
+	{
+		while (true)
+		{
+			cursor.scanNext(rid);
+			count++;
+		}
+	}
+	catch (const IndexScanCompletedException &e)
+	{
+	}
+	return count;
+}
+
+int main()
+{
+	// Entries of a leaf whose entries each store their key, with nothing else but the header and siblings
+	const int unsharedLeaf = (Page::SIZE - sizeof(NodeHeader) - 2 * sizeof(PageId)) / (sizeof(int) + sizeof(RecordId));
+	std::printf("%d records, %d buffer frames, full scans averaged over %d rounds\n",
+				relationSize, bufferFrames, scanRounds);
+	std::printf("  keys          build   pages  bytes/entry  unshared leaves  batch ms  scanNext ms\n");
+	for (int d = DISTINCT; d <= SKEWED; d++)
+	{
+		createRelation((Distribution)d);
+		for (int bulkLoad = 1; bulkLoad >= 0; bulkLoad--)
+		{
+			BufMgr bufMgr(bufferFrames);
+			std::string indexName;
+			double times[2] = {0, 0};
+			size_t counts[2] = {0, 0};
+			{
+				BTreeIndex index(relationName, indexName, &bufMgr, offsetof(Record, i), INTEGER, bulkLoad != 0);
+				for (int round = 0; round < scanRounds; round++)
+				{
+					for (int method = 0; method < 2; method++)
+					{
+						Timer timer;
+						counts[method] = fullScan(index, method == 0 ? 1000 : 0);
+						times[method] += timer.millis();
+					}
+				}
+			}
+			const long bytes = fileBytes(indexName);
+			std::printf("  %-12s  %-6s  %5ld  %11.2f  %15d  %8.1f  %11.1f%s\n", distributionNames[d],
+						bulkLoad ? "bulk" : "insert", bytes / Page::SIZE, (double)bytes / relationSize,
+						(relationSize + unsharedLeaf - 1) / unsharedLeaf,
+						times[0] / scanRounds, times[1] / scanRounds,
+						counts[0] == (size_t)relationSize && counts[1] == (size_t)relationSize ? "" : "  (entries missing)");
+			File::remove(indexName);
+		}
+	}
+	File::remove(relationName);
+	return 0;
+}
@@ -0,0 +1,175 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/*
+ * Microbenchmark for the in-node search kernels. Searches full leaf and non-leaf key arrays,
+ * sized from INTARRAYLEAFSIZE and INTARRAYNONLEAFSIZE, with random probes and reports the
+ * average time per search for every kernel the CPU supports. Then searches full STRING non-leaf key
+ * arrays both by comparing whole keys and by their INTEGER prefixes with the kernel, as non-leaves do.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "btree.h"
+#include "search_kernel.h"
+#include "bench_util.h"
+
+using namespace badgerdb;
+using namespace bench;
+
+const int numProbes = 1 << 20;
+const int rounds = 5;
+
+// Keeps the compiler from dropping the searches
+volatile long sink;
+
+void benchNode(const char *nodeName, const int size)
+{
+	// A full node of distinct, sorted keys with gaps between them
+	std::vector<int> keys(size);
+	for (int i = 0; i < size; i++)
+	{
+		keys[i] = 2 * i;
+	}
+	std::vector<int> probes(numProbes);
+	for (int i = 0; i < numProbes; i++)
+	{
+		probes[i] = (int)(random() % (2 * size + 2)) - 1;
+	}
+
+	const SearchKernel &reference = getSearchKernel(SEARCH_BINARY);
+	const SearchKernelType types[] = {SEARCH_LINEAR, SEARCH_BINARY, SEARCH_SSE4, SEARCH_AVX2};
+	std::printf("%s (%d keys)\n", nodeName, size);
+	for (size_t t = 0; t < sizeof(types) / sizeof(types[0]); t++)
+	{
+		if (!searchKernelSupported(types[t]))
+		{
+			std::printf("  %-8s not supported by this CPU\n", getSearchKernel(types[t]).name);
+			continue;
+		}
+		const SearchKernel &kernel = getSearchKernel(types[t]);
+
+		// Every kernel has to agree with the reference before it is timed
+		for (int i = 0; i < numProbes; i += 97)
+		{
+			if (kernel.lowerBound(&keys[0], size, probes[i]) != reference.lowerBound(&keys[0], size, probes[i]) ||
+				kernel.upperBound(&keys[0], size, probes[i]) != reference.upperBound(&keys[0], size, probes[i]))
+			{
+				std::printf("  %-8s WRONG RESULT for key %d\n", kernel.name, probes[i]);
+				std::exit(1);
+			}
+		}
+
+		double best = 0;
+		for (int r = 0; r < rounds; r++)
+		{
+			long total = 0;
+			Timer timer;
+			for (int i = 0; i < numProbes; i++)
+			{
+				total += kernel.lowerBound(&keys[0], size, probes[i]);
+			}
+			const double ns = timer.seconds() * 1e9 / numProbes;
+			sink = total;
+			if (r == 0 || ns < best)
+			{
+				best = ns;
+			}
+		}
+		std::printf("  %-8s %8.1f ns/search%s\n", kernel.name, best,
+					&kernel == &getSearchKernel(SEARCH_AUTO) ? "  (auto)" : "");
+	}
+}
+
+/**
+ * Time the search of a full non-leaf of the given keys, which must be sorted, for probes, by whole keys
+ * and by prefixes.
+ */
+template <class T>
+void benchPrefixed(const char *nodeName, const std::vector<T> &keys, const std::vector<T> &probes)
+{
+	const int size = (int)keys.size();
+	const int offset = sharedPrefixOffset(&keys[0], size);
+	std::vector<int> prefixes(size);
+	for (int i = 0; i < size; i++)
+	{
+		prefixes[i] = KeyTraits<T>::prefix(keys[i], offset);
+	}
+	const SearchKernel &kernel = getSearchKernel(SEARCH_AUTO);
+	for (int i = 0; i < numProbes; i += 97)
+	{
+		if (sharedPrefixBound<KeyTraits<T> >(kernel, &prefixes[0], &keys[0], size, offset, probes[i], false) !=
+			keyLowerBound(kernel, &keys[0], size, probes[i]))
+		{
+			std::printf("  prefixes WRONG RESULT\n");
+			std::exit(1);
+		}
+	}
+	std::printf("%s (%d keys)\n", nodeName, size);
+	for (int method = 0; method < 2; method++)
+	{
+		double best = 0;
+		for (int r = 0; r < rounds; r++)
+		{
+			long total = 0;
+			Timer timer;
+			for (int i = 0; i < numProbes; i++)
+			{
+				total += method == 0 ? keyLowerBound(kernel, &keys[0], size, probes[i])
+									 : sharedPrefixBound<KeyTraits<T> >(kernel, &prefixes[0], &keys[0], size, offset, probes[i], false);
+			}
+			const double ns = timer.seconds() * 1e9 / numProbes;
+			sink = total;
+			if (r == 0 || ns < best)
+			{
+				best = ns;
+			}
+		}
+		std::printf("  %-8s %8.1f ns/search\n", method == 0 ? "keys" : "prefixes", best);
+	}
+}
+
+/**
+ * STRING key holding the text of value, padded as KeyTraits<StringKey>::get pads it.
+ */
+StringKey stringKey(const char *format, const unsigned value)
+{
+	char text[STRINGSIZE + 1] = {0};
+	std::snprintf(text, sizeof(text), format, value);
+	StringKey key;
+	memcpy(key.value, text, STRINGSIZE);
+	return key;
+}
+
+int main()
+{
+	benchNode("Leaf node", INTARRAYLEAFSIZE);
+	benchNode("Non-leaf node", INTARRAYNONLEAFSIZE);
+
+	// Strings that differ in their first bytes, and strings that share their first four
+	const char *formats[] = {"%08x", "key%07u"};
+	const char *names[] = {"STRING non-leaf node, distinct prefixes", "STRING non-leaf node, shared prefix"};
+	for (int f = 0; f < 2; f++)
+	{
+		std::vector<StringKey> strings(STRINGARRAYNONLEAFSIZE);
+		std::vector<StringKey> stringProbes(numProbes);
+		for (int i = 0; i < STRINGARRAYNONLEAFSIZE; i++)
+		{
+			strings[i] = stringKey(formats[f], f == 0 ? i * 2654435761u : i * 7);
+		}
+		std::sort(strings.begin(), strings.end());
+		for (int i = 0; i < numProbes; i++)
+		{
+			stringProbes[i] = stringKey(formats[f], f == 0 ? (unsigned)random() * 2654435761u : (unsigned)random() % (7 * STRINGARRAYNONLEAFSIZE));
+		}
+		benchPrefixed(names[f], strings, stringProbes);
+	}
+	return 0;
+}
@@ -0,0 +1,96 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/*
+ * Benchmark of random-key inserts into an INTEGER index while a snapshot scan of it is open, against the same
+ * inserts with no snapshot. Loads the index with insertBatch over an empty relation, inserts new keys in random
+ * order, and reports the inserts per second and the node copies kept for the snapshot, which then still returns
+ * exactly the entries the index had when it was opened.
+ */
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "btree.h"
+#include "bench_util.h"
+
+using namespace badgerdb;
+using namespace bench;
+
+const std::string relationName = "bench_snapshot_rel";
+const int numKeys = 1000000;
+const int numInserts = 500000;
+const int bufferFrames = 5000;
+
+/**
+ * Load numKeys keys, then insert numInserts more in random order, with a snapshot scan open over the loaded keys
+ * if snapshot is set, and print the insert rate.
+ */
+void run(const bool snapshot)
+{
+	BufMgr bufMgr(bufferFrames);
+	std::string indexName;
+	{
+		BTreeIndex index(relationName, indexName, &bufMgr, offsetof(Record, i), INTEGER, false);
+		std::vector<RIDKeyPair<int> > pairs(numKeys);
+		for (int n = 0; n < numKeys; n++)
+		{
+			RecordId rid = RecordId();
+			rid.page_number = n / 100 + 1;
+			rid.slot_number = n % 100 + 1;
+			// Even keys, so that the inserts go in between them
+			pairs[n].set(rid, 2 * n);
+		}
+		index.insertBatch(&pairs[0], pairs.size());
+
+		ScanOptions options;
+		options.snapshot = snapshot;
+		const int low = 0, high = 2 * numKeys;
+		ScanCursor cursor;
+		if (snapshot)
+		{
+			cursor = index.openScan(&low, GTE, &high, LT, options);
+		}
+		unsigned seed = 12345;
+		Timer timer;
+		for (int n = 0; n < numInserts; n++)
+		{
+			seed = seed * 1103515245 + 12345;
+			const int key = 2 * (int)((seed >> 8) % numKeys) + 1;
+			RecordId rid = RecordId();
+			rid.page_number = n / 100 + 1;
+			rid.slot_number = n % 100 + 1;
+			index.insertEntry(&key, rid);
+		}
+		const size_t copies = index.getSnapshotCopies();
+		size_t entries = 0;
+		if (snapshot)
+		{
+			std::vector<RecordId> batch(1000);
+			size_t got;
+			while ((got = cursor.scanNextBatch(&batch[0], batch.size())) > 0)
+			{
+				entries += got;
+			}
+			cursor.close();
+		}
+		std::printf("  %-12s %10.0f inserts/s  %7zu node copies  %s\n", snapshot ? "snapshot" : "no snapshot",
+					numInserts / timer.seconds(), copies,
+					!snapshot ? "" : entries == (size_t)numKeys ? "snapshot entries unchanged" : "SNAPSHOT ENTRIES CHANGED");
+	}
+	File::remove(indexName);
+}
+
+int main()
+{
+	createRelation(relationName, std::vector<int>());
+	std::printf("%d random-key inserts into an index of %d keys, %d buffer frames\n", numInserts, numKeys, bufferFrames);
+	run(false);
+	run(true);
+	File::remove(relationName);
+	return 0;
+}
@@ -0,0 +1,86 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/*
+ * Benchmark of point lookups on an INTEGER index too large for its non-leaf nodes to fit in the hot-node cache,
+ * with every node read through the buffer manager, with the hot-node cache holding the top levels and with the
+ * non-leaf nodes swizzled. Loads the keys with insertBatch into an index over an empty relation, then looks up
+ * random keys and reports the lookups per second and the buffer manager calls saved per lookup.
+ */
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "btree.h"
+#include "bench_util.h"
+
+using namespace badgerdb;
+using namespace bench;
+
+const std::string relationName = "bench_swizzle_rel";
+const int numKeys = 4000000;
+const int numLookups = 4000000;
+const int bufferFrames = 20000;
+
+/**
+ * Run numLookups lookups of random keys with the given hot levels and swizzled nodes and print their rate.
+ */
+void run(BTreeIndex &index, const char *mode, const int levels, const int maxSwizzled)
+{
+	index.setHotLevels(levels);
+	index.setSwizzling(maxSwizzled);
+	// Fill the cache or swizzle the nodes before timing
+	for (int key = 0; key < numKeys; key += 97)
+	{
+		index.contains(&key);
+	}
+	const std::uint64_t saved = index.getBufferCallsSaved();
+	unsigned seed = 12345;
+	Timer timer;
+	for (int n = 0; n < numLookups; n++)
+	{
+		seed = seed * 1103515245 + 12345;
+		const int key = (int)((seed >> 8) % numKeys);
+		if (!index.contains(&key))
+		{
+			std::printf("  key %d missing\n", key);
+		}
+	}
+	std::printf("  %-16s %10.0f lookups/s  %5.2f buffer calls saved per lookup\n", mode,
+				numLookups / timer.seconds(),
+				(double)(index.getBufferCallsSaved() - saved) / numLookups);
+}
+
+int main()
+{
+	createRelation(relationName, std::vector<int>());
+	BufMgr bufMgr(bufferFrames);
+	std::string indexName;
+	{
+		BTreeIndex index(relationName, indexName, &bufMgr, offsetof(Record, i), INTEGER, false);
+		std::vector<RIDKeyPair<int> > pairs(numKeys);
+		for (int n = 0; n < numKeys; n++)
+		{
+			RecordId rid = RecordId();
+			rid.page_number = n / 100 + 1;
+			rid.slot_number = n % 100 + 1;
+			pairs[n].set(rid, (int)((long)n * 7919 % numKeys));
+		}
+		index.insertBatch(&pairs[0], pairs.size());
+
+		std::printf("%d lookups of random keys among %d, %d buffer frames\n", numLookups, numKeys, bufferFrames);
+		for (int round = 0; round < 2; round++)
+		{
+			run(index, "buffer manager", 0, 0);
+			run(index, "hot-node cache", DEFAULT_HOT_LEVELS, 0);
+			run(index, "swizzled", 0, bufferFrames / 2);
+		}
+	}
+	File::remove(indexName);
+	File::remove(relationName);
+	return 0;
+}
@@ -0,0 +1,99 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/*
+ * Benchmark of random-key inserts into an INTEGER index that outgrows a 100-frame buffer pool, as the
+ * test driver's pool is. Inserts the same keys, in random order, into an index built over an empty
+ * relation, once with every entry going straight into the tree and then with write buffers of several
+ * sizes, and reports the inserts per second, the final flush included, and the disk writes of each. A mixed
+ * run then looks up a key inserted before after every insert, which the write buffer answers without a flush.
+ */
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "btree.h"
+#include "bench_util.h"
+
+using namespace badgerdb;
+using namespace bench;
+
+const std::string relationName = "bench_write_rel";
+const int numInserts = 1000000;
+const int bufferFrames = 100;
+
+/**
+ * Insert the keys with the given write buffer capacity, looking up an earlier key after each if mixed is set,
+ * print the inserts per second and return them.
+ */
+double run(const std::vector<int> &keys, const size_t capacity, const bool mixed)
+{
+	BufMgr bufMgr(bufferFrames);
+	std::string indexName;
+	double insertsPerSecond;
+	long entries = 0;
+	int missed = 0;
+	{
+		BTreeIndex index(relationName, indexName, &bufMgr, offsetof(Record, i), INTEGER, false);
+		index.setWriteBuffer(capacity);
+		unsigned seed = 54321;
+		Timer timer;
+		for (int n = 0; n < numInserts; n++)
+		{
+			RecordId rid;
+			rid.page_number = n / 100 + 1;
+			rid.slot_number = n % 100 + 1;
+			index.insertEntry(&keys[n], rid);
+			if (mixed)
+			{
+				seed = seed * 1103515245 + 12345;
+				if (!index.contains(&keys[(seed >> 8) % (n + 1)]))
+				{
+					missed++;
+				}
+			}
+		}
+		index.flushWriteBuffer();
+		insertsPerSecond = numInserts / timer.seconds();
+		const int low = 0, high = numInserts;
+		entries = (long)index.countRange(&low, GTE, &high, LT);
+	}
+	std::printf("  %-10zu %12.0f inserts/s  %9d disk writes%s%s\n", capacity, insertsPerSecond,
+				bufMgr.getBufStats().diskwrites, entries == numInserts ? "" : "  (entries missing)",
+				missed == 0 ? "" : "  (lookups missed)");
+	File::remove(indexName);
+	return insertsPerSecond;
+}
+
+int main()
+{
+	createRelation(relationName, std::vector<int>());
+	const std::vector<int> keys = relationKeys(SHUFFLED, numInserts);
+
+	const size_t capacities[] = {0, 10000, 100000, 1000000};
+	for (int mixed = 0; mixed < 2; mixed++)
+	{
+		std::printf("%d random-key inserts%s, %d buffer frames\n", numInserts,
+					mixed ? " each followed by a lookup" : "", bufferFrames);
+		std::printf("  buffered   throughput\n");
+		double unbuffered = 0;
+		for (size_t i = 0; i < sizeof(capacities) / sizeof(capacities[0]); i++)
+		{
+			const double insertsPerSecond = run(keys, capacities[i], mixed != 0);
+			if (i == 0)
+			{
+				unbuffered = insertsPerSecond;
+			}
+			else
+			{
+				std::printf("    speedup over unbuffered: %.1fx\n", insertsPerSecond / unbuffered);
+			}
+		}
+	}
+	File::remove(relationName);
+	return 0;
+}
@@ -6,7 +6,9 @@
  */
 
 #include "btree.h"
+#include "search_kernel.h"
 #include "filescan.h"
+#include "external_sort.h"
 #include "exceptions/bad_index_info_exception.h"
 #include "exceptions/bad_opcodes_exception.h"
 #include "exceptions/bad_scanrange_exception.h"
@@ -15,13 +17,420 @@
 #include "exceptions/index_scan_completed_exception.h"
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/end_of_file_exception.h"
-#include "math.h"
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <thread>
+#include <utility>
 
 //#define DEBUG
 
 namespace badgerdb
 {
 
+	/**
+	 * Reason given when insertBatch is called with pairs of another key type than the index.
+	 */
+	static const std::string batchTypeMismatch = "insertBatch pairs do not have the key type of the index";
+
+	/**
+	 * Reason given when an entry of a covering index is inserted without the record its payload comes from.
+	 */
+	static const std::string payloadMissing = "covering index entries need the record for their payload";
+
+	/**
+	 * Reason given when the write buffer is turned on for a covering index.
+	 */
+	static const std::string payloadNotBuffered = "the write buffer does not hold the payloads of a covering index";
+
+	/**
+	 * Reason given when the payload columns of a new index do not fit with each entry.
+	 */
+	static const std::string payloadTooLarge = "payload columns exceed MAX_PAYLOAD_COLUMNS or MAX_PAYLOAD_SIZE";
+
+	/**
+	 * Reason given when the key columns of a new COMPOSITE index are none or do not fit in a key.
+	 */
+	static const std::string keyColumnsTooLarge = "key columns are none or exceed MAX_KEY_COLUMNS or COMPOSITESIZE";
+
+	/**
+	 * Reason given when a composite key is made for an index that does not have the columns it is made of.
+	 */
+	static const std::string keyColumnsMismatch = "composite key values do not match the key columns of the index";
+
+	/**
+	 * Bytes a key column of the given type takes in a composite key, more than COMPOSITESIZE if it cannot be one.
+	 */
+	static int keyColumnSize(const Datatype type)
+	{
+		switch (type)
+		{
+		case INTEGER:
+			return sizeof(int);
+		case DOUBLE:
+			return sizeof(double);
+		case STRING:
+			return STRINGSIZE;
+		default:
+			return COMPOSITESIZE + 1;
+		}
+	}
+
+	/**
+	 * Write the key column value of the given type to out, most significant byte first, so that encoded values
+	 * compare with memcmp as the values do. Return the bytes written.
+	 */
+	static int encodeKeyColumn(const Datatype type, const void *value, unsigned char *out)
+	{
+		std::uint64_t bits;
+		int size = keyColumnSize(type);
+		if (type == STRING)
+		{
+			const size_t length = strnlen((const char *)value, STRINGSIZE);
+			memcpy(out, value, length);
+			memset(out + length, 0, STRINGSIZE - length);
+			return size;
+		}
+		if (type == INTEGER)
+		{
+			// Flipping the sign bit orders negative values before positive ones
+			std::uint32_t v;
+			memcpy(&v, value, sizeof(v));
+			bits = v ^ 0x80000000u;
+		}
+		else
+		{
+			bits = KeyTraits<double>::ordered(KeyTraits<double>::get(value));
+		}
+		for (int i = size - 1; i >= 0; i--)
+		{
+			out[i] = (unsigned char)bits;
+			bits >>= 8;
+		}
+		return size;
+	}
+
+	/**
+	 * Number of keys in a node, from its header. Capped at capacity, as a reader that does not latch
+	 * the node can find it half written.
+	 */
+	template <class Node>
+	static inline int keyCount(const Node *node, const int capacity)
+	{
+		return std::min((int)node->header.keyCount, capacity);
+	}
+
+	/**
+	 * Number of leaf entries below a non-leaf, from the entry counts of its children.
+	 */
+	template <class T>
+	static inline std::uint32_t subtreeCount(const NonLeafNode<T> *node)
+	{
+		std::uint32_t count = 0;
+		const int n = keyCount(node, NodeSize<T>::NONLEAF);
+		for (int i = 0; i <= n; i++)
+		{
+			count += node->countArray[i];
+		}
+		return count;
+	}
+
+	/**
+	 * Set up the header of a new, empty leaf.
+	 */
+	template <class T>
+	static inline void initLeaf(LeafNode<T> *leaf)
+	{
+		leaf->header.keyCount = 0;
+		leaf->header.level = 0;
+		leaf->header.type = LEAF_NODE;
+		leaf->postingCount = 0;
+	}
+
+	/**
+	 * Number of posting lists in a leaf, capped at capacity like keyCount.
+	 */
+	template <class T>
+	static inline int postingCount(const LeafNode<T> *leaf, const int capacity)
+	{
+		return std::min((int)leaf->postingCount, capacity);
+	}
+
+	/**
+	 * Keys of the count posting lists of a leaf, which end at the end of the page.
+	 */
+	template <class T>
+	static inline T *postingKeys(LeafNode<T> *leaf, const int count)
+	{
+		return (T *)(leaf->data + NodeSize<T>::LEAF_SPACE) - count;
+	}
+
+	/**
+	 * One past the last entry of each of the count posting lists of a leaf, right before their keys.
+	 */
+	template <class T>
+	static inline std::uint16_t *postingEnds(LeafNode<T> *leaf, const int count)
+	{
+		return (std::uint16_t *)postingKeys(leaf, count) - count;
+	}
+
+	/**
+	 * Insert posting list g of a leaf, with the given key and end, moving the lists before it towards the front
+	 * of the page. There must be room for it between them and the entries.
+	 */
+	template <class T>
+	static void insertPosting(LeafNode<T> *leaf, const int g, const T &key, const int end)
+	{
+		const int count = leaf->postingCount;
+		T *keys = postingKeys(leaf, count);
+		std::uint16_t *ends = postingEnds(leaf, count);
+		T *newKeys = keys - 1;
+		std::uint16_t *newEnds = (std::uint16_t *)newKeys - (count + 1);
+		// Everything moves towards the front, so front to back. Keys from g on stay where they are.
+		memmove(newEnds, ends, g * sizeof(std::uint16_t));
+		memmove(newEnds + g + 1, ends + g, (count - g) * sizeof(std::uint16_t));
+		memmove(newKeys, keys, g * sizeof(T));
+		newEnds[g] = end;
+		newKeys[g] = key;
+		leaf->postingCount = count + 1;
+	}
+
+	/**
+	 * Remove posting list g of a leaf, moving the lists before it towards the back of the page.
+	 */
+	template <class T>
+	static void removePosting(LeafNode<T> *leaf, const int g)
+	{
+		const int count = leaf->postingCount;
+		T *keys = postingKeys(leaf, count);
+		std::uint16_t *ends = postingEnds(leaf, count);
+		T *newKeys = keys + 1;
+		std::uint16_t *newEnds = (std::uint16_t *)newKeys - (count - 1);
+		// Everything moves towards the back, so back to front. Keys after g stay where they are.
+		memmove(newKeys, keys, g * sizeof(T));
+		memmove(newEnds + g, ends + g + 1, (count - g - 1) * sizeof(std::uint16_t));
+		memmove(newEnds, ends, g * sizeof(std::uint16_t));
+		leaf->postingCount = count - 1;
+	}
+
+	/**
+	 * Set up the header of a new non-leaf holding count keys, level levels above the leaves.
+	 */
+	template <class T>
+	static inline void initNonLeaf(NonLeafNode<T> *node, const int level, const int count)
+	{
+		node->header.keyCount = count;
+		node->header.level = level;
+		node->header.type = NON_LEAF_NODE;
+		node->prefixOffset = 0;
+	}
+
+	// -----------------------------------------------------------------------------
+	// Key type dispatch
+	// -----------------------------------------------------------------------------
+
+	/**
+	 * Order of record ids, for searching the record ids a cursor has returned.
+	 */
+	static bool ridLess(const RecordId &a, const RecordId &b)
+	{
+		return a.page_number != b.page_number ? a.page_number < b.page_number : a.slot_number < b.slot_number;
+	}
+
+	/**
+	 * Merge m sorted pairs into n sorted leaf entries and write the n + m entries to outKeys and outRids, which
+	 * may be keys and rids themselves if they have room. Pairs go after entries with the same key, as leafInsert puts them.
+	 */
+	template <class T>
+	static inline void mergeLeafEntries(const T *keys, const RecordId *rids, const int n, const RIDKeyPair<T> *pairs, const int m,
+										T *outKeys, RecordId *outRids)
+	{
+		// From the back, so that merging in place overwrites only entries already moved
+		int i = n - 1;
+		for (int j = m - 1, k = n + m - 1; j >= 0; k--)
+		{
+			if (i >= 0 && pairs[j].key < keys[i])
+			{
+				outKeys[k] = keys[i];
+				outRids[k] = rids[i];
+				i--;
+			}
+			else
+			{
+				outKeys[k] = pairs[j].key;
+				outRids[k] = pairs[j].rid;
+				j--;
+			}
+		}
+		if (outKeys != keys)
+		{
+			memcpy(outKeys, keys, (i + 1) * sizeof(T));
+			memcpy(outRids, rids, (i + 1) * sizeof(RecordId));
+		}
+	}
+
+	/**
+	 * Key prefixes of the non-leaves of an index over keys T, which are only kept if KeyTraits<T>::PREFIXED.
+	 * Otherwise the keys themselves are searched.
+	 */
+	template <class T, bool PREFIXED = KeyTraits<T>::PREFIXED>
+	struct SeparatorPrefixes
+	{
+		static void update(NonLeafNode<T> *, const int, const int)
+		{
+		}
+
+		static int bound(const SearchKernel &kernel, const NonLeafNode<T> *node, const int n, const T &key,
+						 const bool upper)
+		{
+			return upper ? keyUpperBound(kernel, node->keyArray, n, key) : keyLowerBound(kernel, node->keyArray, n, key);
+		}
+	};
+
+	template <class T>
+	struct SeparatorPrefixes<T, true>
+	{
+		static void update(NonLeafNode<T> *node, int from, int to)
+		{
+			const int n = keyCount(node, NodeSize<T>::NONLEAF);
+			const int offset = sharedPrefixOffset(node->keyArray, n);
+			if (offset != node->prefixOffset)
+			{
+				node->prefixOffset = offset;
+				from = 0;
+				to = n;
+			}
+			for (int i = from; i < std::min(to, n); i++)
+			{
+				node->prefixArray[i] = KeyTraits<T>::prefix(node->keyArray[i], offset);
+			}
+		}
+
+		static int bound(const SearchKernel &kernel, const NonLeafNode<T> *node, const int n, const T &key,
+						 const bool upper)
+		{
+			// Clamped, as optimistic readers may see a node being changed
+			const int offset = std::min(std::max(node->prefixOffset, 0), maxPrefixOffset<T>());
+			return sharedPrefixBound<KeyTraits<T> >(kernel, node->prefixArray, node->keyArray, n, offset, key, upper);
+		}
+	};
+
+	/**
+	 * Recompute the key prefixes of a non-leaf from key index from on, after its keys changed there.
+	 */
+	template <class T>
+	static inline void setPrefixes(NonLeafNode<T> *node, const int from)
+	{
+		SeparatorPrefixes<T>::update(node, from, NodeSize<T>::NONLEAF);
+	}
+
+	/**
+	 * Recompute the prefix of key index of a non-leaf, after the key changed.
+	 */
+	template <class T>
+	static inline void setPrefix(NonLeafNode<T> *node, const int index)
+	{
+		SeparatorPrefixes<T>::update(node, index, index + 1);
+	}
+
+	/**
+	 * Index of the first of the n keys of a non-leaf that is >= key, or > key if upper. Keys that have prefixes are
+	 * searched by their prefixes with the search kernel, see prefixBound.
+	 */
+	template <class T>
+	static inline int separatorBound(const SearchKernel &kernel, const NonLeafNode<T> *node, const int n, const T &key,
+									 const bool upper)
+	{
+		return SeparatorPrefixes<T>::bound(kernel, node, n, key, upper);
+	}
+
+	/**
+	 * Remove key index of a non-leaf along with the child to its right.
+	 */
+	template <class T>
+	static inline void removeSeparator(NonLeafNode<T> *node, const int index)
+	{
+		const int n = keyCount(node, NodeSize<T>::NONLEAF);
+		memmove(&node->keyArray[index], &node->keyArray[index + 1], (n - index - 1) * sizeof(T));
+		memmove(&node->pageNoArray[index + 1], &node->pageNoArray[index + 2], (n - index - 1) * sizeof(PageId));
+		memmove(&node->countArray[index + 1], &node->countArray[index + 2], (n - index - 1) * sizeof(std::uint32_t));
+		node->header.keyCount = n - 1;
+		setPrefixes(node, index);
+	}
+
+	template <>
+	int &ScanCursor::lowVal<int>() { return lowValInt; }
+	template <>
+	int &ScanCursor::highVal<int>() { return highValInt; }
+	template <>
+	double &ScanCursor::lowVal<double>() { return lowValDouble; }
+	template <>
+	double &ScanCursor::highVal<double>() { return highValDouble; }
+	template <>
+	StringKey &ScanCursor::lowVal<StringKey>() { return lowValString; }
+	template <>
+	StringKey &ScanCursor::highVal<StringKey>() { return highValString; }
+	template <>
+	int &ScanCursor::lastVal<int>() { return lastValInt; }
+	template <>
+	double &ScanCursor::lastVal<double>() { return lastValDouble; }
+	template <>
+	StringKey &ScanCursor::lastVal<StringKey>() { return lastValString; }
+	template <>
+	CompositeKey &ScanCursor::lowVal<CompositeKey>() { return lowValComposite; }
+	template <>
+	CompositeKey &ScanCursor::highVal<CompositeKey>() { return highValComposite; }
+	template <>
+	CompositeKey &ScanCursor::lastVal<CompositeKey>() { return lastValComposite; }
+
+	template <>
+	BufferedInserts<int> &BTreeIndex::buffered<int>() { return bufferedInt; }
+	template <>
+	BufferedInserts<double> &BTreeIndex::buffered<double>() { return bufferedDouble; }
+	template <>
+	BufferedInserts<StringKey> &BTreeIndex::buffered<StringKey>() { return bufferedString; }
+	template <>
+	BufferedInserts<CompositeKey> &BTreeIndex::buffered<CompositeKey>() { return bufferedComposite; }
+
+	template <class T>
+	T BTreeIndex::recordKey(const char *record) const
+	{
+		return KeyTraits<T>::get(record + attrByteOffset);
+	}
+
+	template <>
+	CompositeKey BTreeIndex::recordKey<CompositeKey>(const char *record) const
+	{
+		CompositeKey key;
+		memset(key.value, 0, COMPOSITESIZE);
+		int size = 0;
+		for (size_t i = 0; i < keyColumns.size(); i++)
+		{
+			size += encodeKeyColumn(keyColumns[i].type, record + keyColumns[i].offset, key.value + size);
+		}
+		return key;
+	}
+
+	template <class T>
+	void BTreeIndex::bindKeyType()
+	{
+		// A leaf holds the most entries when they share one posting list, and the most lists when each holds one entry
+		entrySize = sizeof(RecordId) + payloadSize;
+		leafOccupancy = (NodeSize<T>::LEAF_SPACE - NodeSize<T>::POSTING) / entrySize;
+		postingOccupancy = NodeSize<T>::LEAF_SPACE / (NodeSize<T>::POSTING + entrySize);
+		nodeOccupancy = NodeSize<T>::NONLEAF;
+		insertFn = &BTreeIndex::insertEntryTyped<T>;
+		deleteFn = &BTreeIndex::deleteEntryTyped<T>;
+		lookupFn = &BTreeIndex::lookupTyped<T>;
+		countBelowFn = &BTreeIndex::countBelowTyped<T>;
+		countRangeFn = &BTreeIndex::countRangeTyped<T>;
+		selectFn = &BTreeIndex::selectTyped<T>;
+		openScanFn = &BTreeIndex::openScanTyped<T>;
+		scanNextFn = &BTreeIndex::scanNextTyped<T>;
+		scanNextBatchFn = &BTreeIndex::scanNextBatchTyped<T>;
+		flushFn = &BTreeIndex::flushWriteBufferTyped<T>;
+	}
+
 	// -----------------------------------------------------------------------------
 	// BTreeIndex::BTreeIndex -- Constructor
 	// -----------------------------------------------------------------------------
@@ -30,28 +439,111 @@ namespace badgerdb
 						   std::string &outIndexName,
 						   BufMgr *bufMgrIn,
 						   const int attrByteOffset,
-						   const Datatype attrType)
+						   const Datatype attrType,
+						   const bool bulkLoadMode,
+						   const double fillFactor,
+						   const std::vector<PayloadColumn> &payloadColumns,
+						   const BuildOptions &buildOptions)
 	{
 		// Creating index name
-		std::cout << "Entered constructor\n";
 		std::ostringstream indexString;
 		indexString << relationName << '.' << attrByteOffset;
 		outIndexName = indexString.str();
+		attributeType = attrType;
+		this->attrByteOffset = attrByteOffset;
+		openIndex(relationName, outIndexName, bufMgrIn, bulkLoadMode, fillFactor, payloadColumns, buildOptions);
+	}
+
+	BTreeIndex::BTreeIndex(const std::string &relationName,
+						   std::string &outIndexName,
+						   BufMgr *bufMgrIn,
+						   const std::vector<KeyColumn> &keyColumns,
+						   const bool bulkLoadMode,
+						   const double fillFactor,
+						   const std::vector<PayloadColumn> &payloadColumns,
+						   const BuildOptions &buildOptions)
+	{
+		// Creating index name from the offsets of all the key columns
+		std::ostringstream indexString;
+		indexString << relationName;
+		int keySize = 0;
+		for (size_t i = 0; i < keyColumns.size(); i++)
+		{
+			indexString << '.' << keyColumns[i].offset;
+			keySize += keyColumnSize(keyColumns[i].type);
+		}
+		outIndexName = indexString.str();
+		if (keyColumns.empty() || keyColumns.size() > (size_t)MAX_KEY_COLUMNS || keySize > COMPOSITESIZE)
+		{
+			throw BadIndexInfoException(keyColumnsTooLarge);
+		}
+		attributeType = COMPOSITE;
+		attrByteOffset = keyColumns[0].offset;
+		this->keyColumns = keyColumns;
+		openIndex(relationName, outIndexName, bufMgrIn, bulkLoadMode, fillFactor, payloadColumns, buildOptions);
+	}
+
+	void BTreeIndex::openIndex(const std::string &relationName, const std::string &indexName, BufMgr *bufMgrIn,
+							   const bool bulkLoadMode, const double fillFactor, const std::vector<PayloadColumn> &payloadColumns,
+							   const BuildOptions &buildOptions)
+	{
 		// Initializing buffMgr
 		bufMgr = bufMgrIn;
-		// leafOccupancy = INTARRAYLEAFSIZE;
-		// nodeOccupancy = INTARRAYNONLEAFSIZE;
-		scanExecuting = false;
+		this->payloadColumns = payloadColumns;
+		payloadSize = 0;
+		for (size_t i = 0; i < payloadColumns.size(); i++)
+		{
+			payloadSize += payloadColumns[i].length;
+		}
+		if (payloadColumns.size() > (size_t)MAX_PAYLOAD_COLUMNS || payloadSize > MAX_PAYLOAD_SIZE)
+		{
+			throw BadIndexInfoException(payloadTooLarge);
+		}
+		switch (attributeType)
+		{
+		case INTEGER:
+			bindKeyType<int>();
+			break;
+		case DOUBLE:
+			bindKeyType<double>();
+			break;
+		case STRING:
+			bindKeyType<StringKey>();
+			break;
+		case COMPOSITE:
+			bindKeyType<CompositeKey>();
+			break;
+		}
+		openCursors = 0;
+		writeBufferCapacity = 0;
+		bufferedInserts = 0;
+		writeBufferFlushes = 0;
+		appendFill = DEFAULT_APPEND_FILL;
+		// The cache fills once the index is built, so that building it leaves no page pinned
+		hotLevels = 0;
+		hotCount = 0;
+		hotHits = 0;
+		swizzleLimit = 0;
+		swizzledCount = 0;
+		nodeCopyCount = 0;
+		snapshotClock = 0;
+		newestSnapshot = 0;
+		activeWriters = 0;
+		takingSnapshot = false;
+		for (int i = 0; i < MAX_HOT_NODES; i++)
+		{
+			hotNodes[i].pageNo = (PageId)-1;
+			hotNodes[i].page = NULL;
+		}
 		// Try block to see if file exists
 		try
 		{
-			std::cout << "Entered try block\n";
 			// Throws FileNotFoundException if file doesn't exist
-			file = new BlobFile(outIndexName, false);
+			file = new BlobFile(indexName, false);
 			// Read metadata
 			headerPageNum = file->getFirstPageNo();
 			Page *header;
-			bufMgr->readPage(file, 1, header);
+			bufMgr->readPage(file, headerPageNum, header);
 			IndexMetaInfo *metadata = (IndexMetaInfo *)header;
 			// Checking index metadata
 			bool flag = false;
@@ -59,7 +551,7 @@ namespace badgerdb
 			{
 				flag = true;
 			}
-			else if (attrType != metadata->attrType)
+			else if (attributeType != metadata->attrType)
 			{
 				flag = true;
 			}
@@ -67,90 +559,77 @@ namespace badgerdb
 			{
 				flag = true;
 			}
-			if (flag)
+			else if ((int)payloadColumns.size() != metadata->payloadColumnCount)
+			{
+				flag = true;
+			}
+			else if ((int)keyColumns.size() != metadata->keyColumnCount)
+			{
+				flag = true;
+			}
+			for (size_t i = 0; !flag && i < payloadColumns.size(); i++)
+			{
+				flag = payloadColumns[i].offset != metadata->payloadColumns[i].offset ||
+					   payloadColumns[i].length != metadata->payloadColumns[i].length;
+			}
+			for (size_t i = 0; !flag && i < keyColumns.size(); i++)
 			{
-				throw BadIndexInfoException(outIndexName);
+				flag = keyColumns[i].offset != metadata->keyColumns[i].offset ||
+					   keyColumns[i].type != metadata->keyColumns[i].type;
 			}
 			// Assign rootPageNo
 			rootPageNum = metadata->rootPageNo;
+			freePageNum = metadata->freePageNo;
 			// Unpin page from bufMgr
-			std::cout << "unpin 1\n";
-			bufMgr->unPinPage(file, 1, false);
+			bufMgr->unPinPage(file, headerPageNum, false);
+			if (flag)
+			{
+				// The destructor does not run, so close the file here
+				bufMgr->flushFile(file);
+				delete file;
+				throw BadIndexInfoException(indexName);
+			}
 		}
 		// Catch block if file doesn't exist
-		catch (FileNotFoundException e)
+		catch (const FileNotFoundException &e)
 		{
 			// This time, we call BlobFile with true as argument
-			std::cout << "Entered catch\n";
-			file = new BlobFile(outIndexName, true);
-			// Allocate header and root pages
-			Page *header, *root;
+			file = new BlobFile(indexName, true);
+			// Allocate header page
+			Page *header;
 			bufMgr->allocPage(file, headerPageNum, header);
-			bufMgr->allocPage(file, rootPageNum, root);
 			// Copy metadata
 			IndexMetaInfo *metadata = (IndexMetaInfo *)header;
 			metadata->attrByteOffset = attrByteOffset;
-			metadata->attrType = attrType;
-			metadata->rootPageNo = rootPageNum;
+			metadata->attrType = attributeType;
 			strncpy((char *)(&(metadata->relationName)), relationName.c_str(), 20);
 			metadata->relationName[19] = 0;
-			// TODO: Fix this part
-			// Root node initialized with both leaf and non-leaf nodes
-			// NonLeafNodeInt *rootNonLeaf = (NonLeafNodeInt *)root;
-			// rootNonLeaf->level = 1;
-			// LeafNodeInt *rootLeaf = new LeafNodeInt();
-			PageId new_pid;
-			Page *new_page;
-			bufMgr->allocPage(file, new_pid, new_page);
-			rootPageNum = new_pid;
-			NonLeafNodeInt *rootNonLeaf = (NonLeafNodeInt *)new_page;
-			rootNonLeaf->level = 1;
-			for (int i = 0; i < INTARRAYNONLEAFSIZE; i++)
-			{
-				rootNonLeaf->keyArray[i] = -1;
-				rootNonLeaf->pageNoArray[i] = (PageId)-1;
-			}
-
-			PageId new_leaf_pid;
-			Page *new_leaf_page;
-			bufMgr->allocPage(file, new_leaf_pid, new_leaf_page);
-			LeafNodeInt *rootLeafNode = (LeafNodeInt *)new_leaf_page;
-			rootLeafNode->rightSibPageNo = -1;
-			for (int i = 0; i < INTARRAYLEAFSIZE; i++)
-			{
-				rootLeafNode->keyArray[i] = -1;
-				rootLeafNode->ridArray[i].page_number = (PageId)-1;
-				rootLeafNode->ridArray[i].slot_number = (PageId)-1;
-			}
-
-			// bufMgr->unPinPage(file, *rootLeaf, true);
-			rootNonLeaf->pageNoArray[0] = new_leaf_pid;
-			bufMgr->unPinPage(file, new_leaf_pid, true);
-			bufMgr->unPinPage(file, new_pid, true);
-			// Unpin header and root pages
+			metadata->freePageNo = freePageNum = -1;
+			metadata->payloadColumnCount = (int)payloadColumns.size();
+			std::copy(payloadColumns.begin(), payloadColumns.end(), metadata->payloadColumns);
+			metadata->keyColumnCount = (int)keyColumns.size();
+			std::copy(keyColumns.begin(), keyColumns.end(), metadata->keyColumns);
 			bufMgr->unPinPage(file, headerPageNum, true);
-			// bufMgr->unPinPage(file, rootPageNum, true);
-			// Using FileScan to fill the new file
-			FileScan fScan(relationName, bufMgr);
-			RecordId recID;
-			std::cout << "Reached internal try\n";
-			try
-			{
-				while (true)
-				{
-					fScan.scanNext(recID); // Throws EndOfFileException
-					std::string record = fScan.getRecord();
-					insertEntry(record.c_str() + attrByteOffset, recID);
-				}
-			}
-			catch (EndOfFileException e)
+
+			switch (attributeType)
 			{
-				// Save file from B+ Tree to disk
-				bufMgr->flushFile(file);
+			case INTEGER:
+				buildIndex<int>(relationName, bulkLoadMode, fillFactor, buildOptions);
+				break;
+			case DOUBLE:
+				buildIndex<double>(relationName, bulkLoadMode, fillFactor, buildOptions);
+				break;
+			case STRING:
+				buildIndex<StringKey>(relationName, bulkLoadMode, fillFactor, buildOptions);
+				break;
+			case COMPOSITE:
+				buildIndex<CompositeKey>(relationName, bulkLoadMode, fillFactor, buildOptions);
+				break;
 			}
-			delete &fScan;
-			std::cout << "Finished constructor";
+			// Save file from B+ Tree to disk
+			bufMgr->flushFile(file);
 		}
+		hotLevels = DEFAULT_HOT_LEVELS;
 	}
 
 	// BTreeIndex::BTreeIndex(const std::string &relationName,
@@ -285,569 +764,3667 @@ namespace badgerdb
 	// }
 
 	// -----------------------------------------------------------------------------
-	// BTreeIndex::~BTreeIndex -- destructor
-	// -----------------------------------------------------------------------------
-
-	BTreeIndex::~BTreeIndex()
-	{
-		scanExecuting = false;
-		bufMgr->flushFile(file);
-		delete file;
-	}
-
-	// -----------------------------------------------------------------------------
-	// BTreeIndex::insertEntry
+	// BTreeIndex::buildIndex
 	// -----------------------------------------------------------------------------
 
-	void BTreeIndex::insertEntry(const void *key, const RecordId rid)
+	template <class T>
+	void BTreeIndex::buildIndex(const std::string &relationName, const bool bulkLoadMode, const double fillFactor,
+								const BuildOptions &buildOptions)
 	{
-		std::cout << "Begun insert\n";
-		PageKeyPair<int> root_changes;
-		root_changes.set(-1, -1);
-		// This method inserts a new entry into the index using the pair <key, rid>.
-		root_changes = navigate(rootPageNum, key, rid);
-		std::cout << "Returned to insertEntry\n";
-		if (root_changes.key == -1 && root_changes.pageNo == -1)
+		// insertEntry needs an existing root, so start from an empty tree
+		std::vector<RIDKeyPair<T> > pairs;
+		std::vector<char> payloads;
+		if (!bulkLoadMode)
 		{
-			return;
+			bulkLoad(pairs, payloads, fillFactor);
 		}
-		else
+		else if (buildOptions.sortMemory > 0)
 		{
-			root_updation(root_changes);
+			bulkLoadExternal<T>(relationName, fillFactor, buildOptions.sortMemory);
+			return;
 		}
-	}
-
-	void BTreeIndex::root_updation(PageKeyPair<int> root_changes)
-	{
-		std::cout << "Entered root_update";
-		// Allocate a new page for the new node
-		PageId new_pid;
-		Page *new_page;
-		bufMgr->allocPage(file, new_pid, new_page);
-
-		// Make a new leaf node for the page and initialising leaf variables
-		NonLeafNodeInt *new_non_leaf = (NonLeafNodeInt *)new_page; // TODO:check
-		new_non_leaf->level = 0;
-
-		for (int i = 0; i < INTARRAYNONLEAFSIZE; i++)
+		else if (buildOptions.threads > 1)
 		{
-			new_non_leaf->keyArray[i] = -1;
-			new_non_leaf->pageNoArray[i] = -1;
+			scanRelationParallel(relationName, std::min(buildOptions.threads, MAX_BUILD_THREADS), pairs, payloads);
+			bulkLoad(pairs, payloads, fillFactor);
+			return;
 		}
-
-		NonLeafNodeInt *newRoot = (NonLeafNodeInt *)(new_pid);
-		newRoot->level = 0;
-		newRoot->keyArray[0] = root_changes.key;
-		newRoot->pageNoArray[0] = rootPageNum;
-		newRoot->pageNoArray[1] = root_changes.pageNo;
-		bufMgr->unPinPage(file, new_pid, true);
-
-		rootPageNum = new_pid;
-
-		IndexMetaInfo *meta;
-		bufMgr->readPage(file, 1, (Page *&)meta);
-		meta->rootPageNo = rootPageNum;
-		bufMgr->unPinPage(file, 1, true);
-	}
-
-	PageKeyPair<int> BTreeIndex::navigate(const PageId pageNo, const void *key, const RecordId rid)
-	{
-		std::cout << "Entered navigate\n";
-		// Make a new temporary node
-		NonLeafNodeInt *this_node; // TODO: CHECK
-		// Holder for changes recieved from leaf node
-		PageKeyPair<int> changes;
-		changes.set(-1, -1);
-
-		bool dirty = false; // TODO: check
-
-		// Read page into node
-		bufMgr->readPage(file, pageNo, (Page *&)this_node);
-		// Check if reached leaf
-		if (this_node->level == 1)
-			// Get next node PageNo and go to leaf level
-			changes = go_to_leaf(get_next_node(this_node, key), key, rid);
-		else
-			// Get next node PageNo and recurse
-			changes = navigate(get_next_node(this_node, key), key, rid);
-		std::cout << "Returned to navigate\n";
-		if (changes.key == -1 && changes.pageNo == -1)
+		char payload[MAX_PAYLOAD_SIZE];
+		// Using FileScan to fill the new file
+		FileScan fScan(relationName, bufMgr);
+		RecordId recID;
+		try
 		{
-			bufMgr->unPinPage(file, pageNo, dirty);
-			return changes;
+			while (true)
+			{
+				fScan.scanNext(recID); // Throws EndOfFileException
+				std::string record = fScan.getRecord();
+				extractPayload(record.c_str(), payload);
+				if (bulkLoadMode)
+				{
+					RIDKeyPair<T> pair;
+					pair.set(recID, recordKey<T>(record.c_str()));
+					pairs.push_back(pair);
+					payloads.insert(payloads.end(), payload, payload + payloadSize);
+				}
+				else
+				{
+					const T key = recordKey<T>(record.c_str());
+					insertEntryTyped<T>(&key, recID, payload);
+				}
+			}
 		}
-		if (this_node->keyArray[INTARRAYNONLEAFSIZE - 1] == -1)
+		catch (const EndOfFileException &e)
 		{
-			// Insert changes returned to this level
-			insert_in_non_leaf(this_node, changes);
-			changes.set(-1, -1);
 		}
-		else
+		if (bulkLoadMode)
 		{
-			// Split this node and Insert changes returned to this level
-			changes = split_non_leaf(this_node, changes);
+			bulkLoad(pairs, payloads, fillFactor);
 		}
-		bufMgr->unPinPage(file, pageNo, dirty);
-		std::cout << "before navigate returns\n";
-		return changes;
 	}
 
-	PageId BTreeIndex::get_next_node(NonLeafNodeInt *this_node, const void *key)
+	template <class T>
+	void BTreeIndex::scanRelationParallel(const std::string &relationName, const int numThreads,
+										  std::vector<RIDKeyPair<T> > &pairs, std::vector<char> &payloads)
 	{
-		std::cout << "Entered get_next_node\n";
-		for (int i = 0; i < INTARRAYNONLEAFSIZE; i++)
+		PageFile relation(relationName, false);
+		std::vector<PageId> pageNos;
+		for (FileIterator it = relation.begin(); it != relation.end(); ++it)
 		{
-			if (this_node->keyArray[i] >= *(int *)key)
-				return this_node->pageNoArray[i];
-			if (this_node->keyArray[i] == -1)
-				return this_node->pageNoArray[i];
+			pageNos.push_back(it.getCurrentPageNumber());
 		}
-	}
-
-	PageKeyPair<int> BTreeIndex::go_to_leaf(const PageId pageNo, const void *key, const RecordId rid)
-	{
-		std::cout << "Entered go_to_leaf\n";
-		LeafNodeInt *this_node; // TODO: CHECK
-		// Holder for changes to send to Non leaf node
-		PageKeyPair<int> copy_changes;
-		copy_changes.set(-1, -1);
-
-		bufMgr->readPage(file, pageNo, (Page *&)this_node);
-		// If leaf is not full insert entry else split
-		if (this_node->keyArray[INTARRAYLEAFSIZE - 1] == -1)
-			insert_in_leaf(this_node, key, rid);
-		else
-			copy_changes = split_leaf(this_node, key, rid); // changes returned after split
-		bool dirty = false;
-		bufMgr->unPinPage(file, pageNo, dirty);
-
-		// Sending changes up to the non leaf node
-		std::cout << "copy_changes.key: " << copy_changes.key << std::endl;
-		return copy_changes;
-	}
 
-	// TODO: complete
-	void BTreeIndex::insert_in_non_leaf(NonLeafNodeInt *node, const PageKeyPair<int> changes)
-	{
-		std::cout << "Entered insert_in_non_leaf\n";
-		std::cout << changes.key << std::endl;
-		int index;
-		for (int i = 0; i < INTARRAYLEAFSIZE; i++)
+		// Each thread collects and sorts the pairs of one range of pages into its own run
+		const int numRuns = std::max(1, std::min(numThreads, (int)pageNos.size()));
+		std::vector<std::vector<RIDKeyPair<T> > > runPairs(numRuns);
+		std::vector<std::vector<char> > runPayloads(numRuns);
+		std::vector<std::exception_ptr> errors(numRuns);
+		std::vector<std::thread> threads;
+		for (int r = 0; r < numRuns; r++)
 		{
-			std::cout << "non_leaf for loop " << i << std::endl;
-			if (node->keyArray[i] == -1)
-			{
-				std::cout << "Inside sus if statement\n";
-				// node->keyArray[i] = *((int *)changes.key);
-				std::cout << "if not sus\n";
-				index = i;
-				break;
-			}
+			const size_t begin = pageNos.size() * r / numRuns;
+			const size_t end = pageNos.size() * (r + 1) / numRuns;
+			threads.push_back(std::thread([this, &relation, &pageNos, &runPairs, &runPayloads, &errors, r, begin, end]() {
+				try
+				{
+					char payload[MAX_PAYLOAD_SIZE];
+					for (size_t i = begin; i < end; i++)
+					{
+						Page *page;
+						bufMgr->readPage(&relation, pageNos[i], page);
+						for (PageIterator it = page->begin(); it != page->end(); ++it)
+						{
+							const std::string record = *it;
+							RIDKeyPair<T> pair;
+							pair.set(it.getCurrentRecord(), recordKey<T>(record.c_str()));
+							runPairs[r].push_back(pair);
+							extractPayload(record.c_str(), payload);
+							runPayloads[r].insert(runPayloads[r].end(), payload, payload + payloadSize);
+						}
+						bufMgr->unPinPage(&relation, pageNos[i], false);
+					}
+					sortPairs(runPairs[r], runPayloads[r]);
+				}
+				catch (...)
+				{
+					errors[r] = std::current_exception();
+				}
+			}));
 		}
-		// Base case
-		if (index == 0)
+		for (int r = 0; r < numRuns; r++)
 		{
-			std::cout << "Base case b4\n";
-			node->keyArray[0] = changes.key;
-			node->pageNoArray[0] = changes.pageNo;
-			std::cout << "Base case after\n";
+			threads[r].join();
 		}
-		else
+		// The relation's frames must go before its file does, even when a thread failed
+		bufMgr->flushFile(&relation);
+		for (int r = 0; r < numRuns; r++)
 		{
-			// Find index
-			std::cout << "Before weird index\n";
-			for (index; index >= 0; index--)
+			if (errors[r])
 			{
-				if (node->keyArray[index - 1] > changes.key)
-				{
-					node->keyArray[index] = node->keyArray[index - 1];
-					node->pageNoArray[index] = node->pageNoArray[index - 1];
-				}
-				else
-					break;
+				std::rethrow_exception(errors[r]);
 			}
-			std::cout << "after weird index\n";
-
-			// Set value
-			node->keyArray[index] = changes.key;
-			node->pageNoArray[index] = changes.pageNo;
 		}
-		std::cout << "insert_in_non_leaf over\n";
-	}
 
-	// TODO: complete
-	void BTreeIndex::insert_in_leaf(LeafNodeInt *node, const void *key, const RecordId rid)
-	{
-		std::cout << "Entered insert_in_leaf\n";
-		int index;
-		for (int i = 0; i < INTARRAYLEAFSIZE; i++)
+		// Merge the runs with a heap of the runs ordered by their next pair, equal pairs taken from the earlier run
+		size_t total = 0;
+		for (int r = 0; r < numRuns; r++)
 		{
-			if (node->keyArray[i] == -1)
-			{
-				node->keyArray[i] = *((int *)key);
-				index = i;
-				break;
-			}
+			total += runPairs[r].size();
 		}
-		// Base case
-		if (index == 0)
+		pairs.clear();
+		pairs.reserve(total);
+		payloads.clear();
+		payloads.resize(total * payloadSize);
+		std::vector<size_t> next(numRuns, 0);
+		const auto later = [&runPairs, &next](int a, int b) {
+			const RIDKeyPair<T> &pa = runPairs[a][next[a]];
+			const RIDKeyPair<T> &pb = runPairs[b][next[b]];
+			return pb < pa || (!(pa < pb) && b < a);
+		};
+		std::vector<int> heap;
+		for (int r = 0; r < numRuns; r++)
 		{
-			node->keyArray[0] = *((int *)key);
-			node->ridArray[0] = rid;
+			if (!runPairs[r].empty())
+			{
+				heap.push_back(r);
+			}
 		}
-		else
+		std::make_heap(heap.begin(), heap.end(), later);
+		while (!heap.empty())
 		{
-			// Find index
-			for (index; index >= 0; index--)
+			std::pop_heap(heap.begin(), heap.end(), later);
+			const int r = heap.back();
+			if (payloadSize > 0)
 			{
-				if (node->keyArray[index - 1] > *((int *)key))
-				{
-					node->keyArray[index] = node->keyArray[index - 1];
-					node->ridArray[index] = node->ridArray[index - 1];
-				}
-				else
-					break;
+				memcpy(&payloads[pairs.size() * payloadSize], &runPayloads[r][next[r] * payloadSize], payloadSize);
+			}
+			pairs.push_back(runPairs[r][next[r]]);
+			if (++next[r] < runPairs[r].size())
+			{
+				std::push_heap(heap.begin(), heap.end(), later);
+			}
+			else
+			{
+				heap.pop_back();
+				std::vector<RIDKeyPair<T> >().swap(runPairs[r]);
+				std::vector<char>().swap(runPayloads[r]);
 			}
-
-			// Set value
-			node->keyArray[index] = *((int *)key);
-			node->ridArray[index] = rid;
 		}
 	}
 
-	PageKeyPair<int> BTreeIndex::split_leaf(LeafNodeInt *node, const void *key, const RecordId rid)
+	template <class T>
+	void BTreeIndex::sortPairs(std::vector<RIDKeyPair<T> > &pairs, std::vector<char> &payloads) const
 	{
-		std::cout << "Entered split_leaf\n";
-		// Get half size
-		int half = ceil(INTARRAYLEAFSIZE / 2);
-		// Allocate a new page for the new node
-
-		PageId new_pid;
-		Page *new_page;
-		std::cout << "Before allocPage\n";
-		bufMgr->allocPage(file, new_pid, new_page);
-		std::cout << "After allocPage\n";
-		// Make a new leaf node for the page and initialising leaf variables
-		LeafNodeInt *new_leaf = (LeafNodeInt *)new_page; // TODO:check
-		new_leaf->rightSibPageNo = -1;
-
-		for (int i = 0; i < INTARRAYLEAFSIZE; i++)
+		if (payloadSize == 0)
+		{
+			std::sort(pairs.begin(), pairs.end());
+			return;
+		}
+		// Sort the positions of the pairs, so that each payload can be moved along with its pair
+		std::vector<size_t> order(pairs.size());
+		for (size_t i = 0; i < order.size(); i++)
 		{
-			new_leaf->keyArray[i] = -1;
-			new_leaf->ridArray[i].page_number = -1;
-			new_leaf->ridArray[i].slot_number = -1;
+			order[i] = i;
 		}
-
-		// Check if key goes to old leaf or new leaf
-		bool key_to_left = false;
-		if (*((int *)key) < node->keyArray[half])
+		std::sort(order.begin(), order.end(), [&pairs](size_t a, size_t b) { return pairs[a] < pairs[b]; });
+		std::vector<RIDKeyPair<T> > sortedPairs(pairs.size());
+		std::vector<char> sortedPayloads(payloads.size());
+		for (size_t i = 0; i < order.size(); i++)
 		{
-			key_to_left = true;
-			half--;
+			sortedPairs[i] = pairs[order[i]];
+			memcpy(&sortedPayloads[i * payloadSize], &payloads[order[i] * payloadSize], payloadSize);
 		}
+		pairs.swap(sortedPairs);
+		payloads.swap(sortedPayloads);
+	}
 
-		// Copying values into new leaf and replacing them in existing leaf
-		for (int i = half; i < INTARRAYLEAFSIZE; i++)
+	void BTreeIndex::extractPayload(const char *record, char *payload) const
+	{
+		for (size_t i = 0; i < payloadColumns.size(); i++)
 		{
-			new_leaf->keyArray[i - half] = node->keyArray[i];
-			new_leaf->ridArray[i - half] = node->ridArray[i];
-			node->keyArray[i] = -1;
-			node->ridArray[i].page_number = -1;
-			node->ridArray[i].slot_number = -1;
+			memcpy(payload, record + payloadColumns[i].offset, payloadColumns[i].length);
+			payload += payloadColumns[i].length;
 		}
+	}
 
-		// Insert new record
-		if (key_to_left)
-			insert_in_leaf(node, key, rid);
-		else
-			insert_in_leaf(new_leaf, key, rid);
+	// -----------------------------------------------------------------------------
+	// Leaf layout
+	// -----------------------------------------------------------------------------
 
-		// Modifying sibling values
-		new_leaf->rightSibPageNo = node->rightSibPageNo;
-		node->rightSibPageNo = new_pid;
+	template <class T>
+	bool BTreeIndex::leafPosting(LeafNode<T> *leaf, const int i, T &key, int &start, int &end, int *group) const
+	{
+		const int n = keyCount(leaf, leafOccupancy);
+		const int count = postingCount(leaf, postingOccupancy);
+		if (count == 0)
+		{
+			return false;
+		}
+		const std::uint16_t *ends = postingEnds(leaf, count);
+		int g = group != NULL ? *group : -1;
+		if (g < 0 || g >= count || i >= ends[g] || (g > 0 && i < ends[g - 1]))
+		{
+			// The first list that ends after entry i
+			g = std::min((int)(std::upper_bound(ends, ends + count, i) - ends), count - 1);
+		}
+		if (group != NULL)
+		{
+			*group = g;
+		}
+		key = postingKeys(leaf, count)[g];
+		start = g == 0 ? 0 : std::min((int)ends[g - 1], n);
+		end = std::max(start, std::min((int)ends[g], n));
+		return true;
+	}
 
-		// Unpin this page from buffer
-		bufMgr->unPinPage(file, new_pid, new_page);
+	template <class T>
+	T BTreeIndex::leafKey(LeafNode<T> *leaf, const int i) const
+	{
+		T key = T();
+		int start, end;
+		leafPosting(leaf, i, key, start, end);
+		return key;
+	}
 
-		// Send back the changes to the upper level node
-		PageKeyPair<int> newPair;
-		newPair.set(new_pid, new_leaf->keyArray[0]);
-		return newPair;
+	template <class T>
+	int BTreeIndex::leafBound(LeafNode<T> *leaf, const T &key, const bool upper) const
+	{
+		const int n = keyCount(leaf, leafOccupancy);
+		const int count = postingCount(leaf, postingOccupancy);
+		const T *keys = postingKeys(leaf, count);
+		const int g = upper ? keyUpperBound(searchKernel(), keys, count, key) : keyLowerBound(searchKernel(), keys, count, key);
+		return g == 0 ? 0 : std::min((int)postingEnds(leaf, count)[g - 1], n);
 	}
 
-	PageKeyPair<int> BTreeIndex::split_non_leaf(NonLeafNodeInt *node, const PageKeyPair<int> changes)
+	template <class T>
+	void BTreeIndex::leafRange(LeafNode<T> *leaf, const T &key, int &first, int &end) const
 	{
-		std::cout << "Entered split_non_leaf";
-		PageKeyPair<int> push_up_changes;
-		// Get half size
-		int half = ceil(INTARRAYLEAFSIZE / 2);
-		// Allocate a new page for the new node
-		PageId new_pid;
-		Page *new_page;
-		bufMgr->allocPage(file, new_pid, new_page);
+		const int n = keyCount(leaf, leafOccupancy);
+		const int count = postingCount(leaf, postingOccupancy);
+		const T *keys = postingKeys(leaf, count);
+		const std::uint16_t *ends = postingEnds(leaf, count);
+		const int g = keyLowerBound(searchKernel(), keys, count, key);
+		first = g == 0 ? 0 : std::min((int)ends[g - 1], n);
+		end = g < count && keys[g] == key ? std::max(first, std::min((int)ends[g], n)) : first;
+	}
 
-		// Make a new leaf node for the page and initialising leaf variables
-		NonLeafNodeInt *new_non_leaf = (NonLeafNodeInt *)new_page; // TODO:check
-		new_non_leaf->level = 0;
+	template <class T>
+	int BTreeIndex::leafBytes(LeafNode<T> *leaf) const
+	{
+		return postingCount(leaf, postingOccupancy) * NodeSize<T>::POSTING + keyCount(leaf, leafOccupancy) * entrySize;
+	}
 
-		for (int i = 0; i < INTARRAYNONLEAFSIZE; i++)
+	template <class T>
+	int BTreeIndex::packedBytes(const T *keys, const int n) const
+	{
+		int bytes = n * entrySize;
+		for (int i = 0; i < n; i++)
 		{
-			new_non_leaf->keyArray[i] = -1;
-			new_non_leaf->pageNoArray[i] = -1;
+			if (i == 0 || keys[i] != keys[i - 1])
+			{
+				bytes += NodeSize<T>::POSTING;
+			}
 		}
+		return bytes;
+	}
 
-		// Start changes TODO: complete
-		int index = 0;
-		for (; index < INTARRAYNONLEAFSIZE && node->keyArray[index] < changes.key; index++)
-			;
+	template <class T>
+	int BTreeIndex::splitPoint(const T *keys, const int n) const
+	{
+		// Stop once the left leaf has half the bytes. A key split between the leaves has a list in each.
+		const int total = packedBytes(keys, n);
+		int bytes = 0;
+		int m = 0;
+		while (m < n - 1 && 2 * bytes < total)
+		{
+			bytes += entrySize + (m == 0 || keys[m] != keys[m - 1] ? NodeSize<T>::POSTING : 0);
+			m++;
+		}
+		return std::max(m, 1);
+	}
 
-		if (index < half)
+	template <class T>
+	int BTreeIndex::appendSplitPoint(const T *keys, const int n) const
+	{
+		const int most = (int)(NodeSize<T>::LEAF_SPACE * appendFill);
+		int bytes = 0;
+		int m = 0;
+		while (m < n - 1)
 		{
-			for (int i = 0; i < half - 1; i++)
+			const int entryBytes = entrySize + (m == 0 || keys[m] != keys[m - 1] ? NodeSize<T>::POSTING : 0);
+			if (bytes + entryBytes > most)
 			{
-				new_non_leaf->keyArray[i] = node->keyArray[i + half];
-				new_non_leaf->pageNoArray[i] = node->pageNoArray[i + half];
-				node->keyArray[i + half] = -1;
-				node->pageNoArray[i + half] = -1;
+				break;
 			}
-			new_non_leaf->pageNoArray[half - 1] = node->pageNoArray[INTARRAYNONLEAFSIZE];
-			node->pageNoArray[INTARRAYNONLEAFSIZE] = -1;
+			bytes += entryBytes;
+			m++;
+		}
+		return std::max(m, splitPoint(keys, n));
+	}
 
-			push_up_changes.set(new_pid, node->keyArray[half - 1]);
+	template <class T>
+	void BTreeIndex::leafInsert(LeafNode<T> *leaf, const T &key, const RecordId rid, const char *payload)
+	{
+		const int n = keyCount(leaf, leafOccupancy);
+		int count = leaf->postingCount;
+		const int g = keyLowerBound(searchKernel(), postingKeys(leaf, count), count, key);
+		const bool found = g < count && postingKeys(leaf, count)[g] == key;
+		// After the entries with the same key, or where they would be
+		const int pos = found ? postingEnds(leaf, count)[g] : (g == 0 ? 0 : postingEnds(leaf, count)[g - 1]);
+		if (!found)
+		{
+			insertPosting(leaf, g, key, pos);
+			count++;
+		}
+		memmove(leaf->data + (pos + 1) * entrySize, leaf->data + pos * entrySize, (n - pos) * entrySize);
+		memcpy(leaf->data + pos * entrySize, &rid, sizeof(RecordId));
+		memcpy(leafPayload(leaf, pos), payload, payloadSize);
+		std::uint16_t *ends = postingEnds(leaf, count);
+		for (int h = g; h < count; h++)
+		{
+			ends[h]++;
+		}
+		leaf->header.keyCount = n + 1;
+	}
 
-			node->keyArray[half - 1] = -1;
-			insert_in_non_leaf(node, changes);
+	template <class T>
+	void BTreeIndex::leafRemove(LeafNode<T> *leaf, const int pos)
+	{
+		const int n = keyCount(leaf, leafOccupancy);
+		const int count = leaf->postingCount;
+		std::uint16_t *ends = postingEnds(leaf, count);
+		const int g = std::upper_bound(ends, ends + count, pos) - ends;
+		memmove(leaf->data + pos * entrySize, leaf->data + (pos + 1) * entrySize, (n - pos - 1) * entrySize);
+		for (int h = g; h < count; h++)
+		{
+			ends[h]--;
+		}
+		if (ends[g] == (g == 0 ? 0 : ends[g - 1]))
+		{
+			removePosting(leaf, g);
 		}
-		else if (index == half)
+		leaf->header.keyCount = n - 1;
+	}
+
+	template <class T>
+	int BTreeIndex::unpackLeaf(LeafNode<T> *leaf, T *keys, RecordId *rids, char *payloads) const
+	{
+		const int n = keyCount(leaf, leafOccupancy);
+		const int count = postingCount(leaf, postingOccupancy);
+		const T *postingKey = postingKeys(leaf, count);
+		const std::uint16_t *ends = postingEnds(leaf, count);
+		for (int g = 0, i = 0; g < count; g++)
 		{
-			for (int i = 0; i < half - 1; i++)
+			for (; i < ends[g]; i++)
 			{
-				new_non_leaf->keyArray[i] = node->keyArray[i + half];
-				new_non_leaf->pageNoArray[i + 1] = node->pageNoArray[i + half + 1];
-				node->keyArray[i + half] = -1;
-				node->pageNoArray[i + half + 1] = -1;
+				keys[i] = postingKey[g];
 			}
-			new_non_leaf->pageNoArray[0] = new_pid;
+		}
+		if (payloadSize == 0)
+		{
+			// The entries are an array of record ids
+			memcpy(rids, leaf->data, n * sizeof(RecordId));
+			return n;
+		}
+		for (int i = 0; i < n; i++)
+		{
+			rids[i] = leafRid(leaf, i);
+			memcpy(payloads + i * payloadSize, leafPayload(leaf, i), payloadSize);
+		}
+		return n;
+	}
 
-			push_up_changes.set(new_pid, changes.key);
+	template <class T>
+	void BTreeIndex::packLeaf(LeafNode<T> *leaf, const T *keys, const RecordId *rids, const char *payloads, const int n)
+	{
+		if (payloadSize == 0)
+		{
+			memcpy(leaf->data, rids, n * sizeof(RecordId));
 		}
-		else
+		for (int i = 0; payloadSize > 0 && i < n; i++)
+		{
+			memcpy(leaf->data + i * entrySize, &rids[i], sizeof(RecordId));
+			memcpy(leafPayload(leaf, i), payloads + i * payloadSize, payloadSize);
+		}
+		// A posting list per run of equal keys, placed once their number is known
+		int count = 0;
+		for (int i = 0; i < n; i++)
+		{
+			count += i == 0 || keys[i] != keys[i - 1];
+		}
+		T *postingKey = postingKeys(leaf, count);
+		std::uint16_t *ends = postingEnds(leaf, count);
+		for (int i = 0, g = -1; i < n; i++)
 		{
-			for (int i = 0; i < half - 2; i++)
+			if (i == 0 || keys[i] != keys[i - 1])
 			{
-				new_non_leaf->keyArray[i] = node->keyArray[i + half + 1];
-				new_non_leaf->pageNoArray[i] = node->pageNoArray[i + half + 1];
-				node->keyArray[i + half + 1] = -1;
-				node->pageNoArray[i + half + 1] = -1;
+				postingKey[++g] = keys[i];
 			}
-			new_non_leaf->pageNoArray[half - 2] = node->pageNoArray[INTARRAYNONLEAFSIZE];
-			node->pageNoArray[INTARRAYNONLEAFSIZE] = -1;
-
-			new_non_leaf->level = node->level;
-
-			// TODO: above stuff optimize
+			ends[g] = i + 1;
 		}
-		// end
-		bool dirty = false;
-		bufMgr->unPinPage(file, new_pid, dirty);
-		return push_up_changes;
+		leaf->postingCount = count;
+		leaf->header.keyCount = n;
 	}
 
 	// -----------------------------------------------------------------------------
-	// BTreeIndex::startScan
+	// BTreeIndex::bulkLoad
 	// -----------------------------------------------------------------------------
-	/**
-	 * Begin a filtered scan of the index.  For instance, if the method is called
-	 * using ("a",GT,"d",LTE) then we should seek all entries with a value
-	 * greater than "a" and less than or equal to "d".
-	 * If another scan is already executing, that needs to be ended here.
-	 * Set up all the variables for scan. Start from root to find out the leaf page that contains the first RecordID
-	 * that satisfies the scan parameters. Keep that page pinned in the buffer pool.
-	 * @param lowValParm	Low value of range, pointer to integer / double / char string
-	 * @param lowOpParm		Low operator (GT/GTE)
-	 * @param highValParm	High value of range, pointer to integer / double / char string
-	 * @param highOpParm	High operator (LT/LTE)
-	 * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
-	 * @throws  BadScanrangeException If lowVal > highval
-	 * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that satisfies the scan criteria.
-	 **/
-	void BTreeIndex::startScan(const void *lowValParm,
-							   const Operator lowOpParm,
-							   const void *highValParm,
-							   const Operator highOpParm)
+
+	template <class T>
+	void BTreeIndex::bulkLoad(std::vector<RIDKeyPair<T> > &pairs, std::vector<char> &payloads, const double fillFactor)
 	{
-		lowValInt = *((int *)lowValParm);
-		lowOp = lowOpParm;
-		highValInt = *((int *)highValParm);
-		highOp = highOpParm;
-		if (lowOp != GT && lowOp != GTE)
-		{
-			throw BadOpcodesException();
-		}
-		if (highOp != LT && highOp != LTE)
+		// A parallel build hands over pairs already merged in order
+		if (!std::is_sorted(pairs.begin(), pairs.end()))
 		{
-			throw BadOpcodesException();
+			sortPairs(pairs, payloads);
 		}
-		if (lowValInt > highValInt)
+
+		// Leaves are filled by bytes, as an entry with the same key as the one before it takes less room than one without
+		long totalBytes = 0;
+		for (size_t i = 0; i < pairs.size(); i++)
 		{
-			throw BadScanrangeException();
+			totalBytes += entrySize + (i == 0 || pairs[i].key != pairs[i - 1].key ? NodeSize<T>::POSTING : 0);
 		}
-		PageId pageNo = rootPageNum;
-		NonLeafNodeInt *node;
-		LeafNodeInt *leaf;
+		int leafFill, nodeFill;
+		bulkLoadFill<T>(fillFactor, leafFill, nodeFill);
 
-		bufMgr->readPage(file, pageNo, (Page *&)node);
-		while (node->level == 0)
+		// Pack leaves left to right. Bytes are spread evenly over the leaves so the last leaf is not left nearly
+		// empty, allowing for a posting list of a key that goes on from one leaf into the next in every leaf.
+		std::vector<PageKeyPair<T> > level;
+		const long numLeaves = std::max(1L, (totalBytes + leafFill - 1) / leafFill);
+		const long share = std::min((long)leafFill, (totalBytes + (numLeaves - 1) * NodeSize<T>::POSTING + numLeaves - 1) / numLeaves);
+		T keys[NodeSize<T>::LEAF_ENTRIES];
+		RecordId rids[NodeSize<T>::LEAF_ENTRIES];
+		PageId prevPageNo = Page::INVALID_NUMBER;
+		LeafNode<T> *prevLeaf = NULL;
+		size_t next = 0;
+		do
 		{
-			int i;
-			for (i = 0; i < INTARRAYNONLEAFSIZE; i++)
+			int count = 0;
+			long bytes = 0;
+			while (next + count < pairs.size())
 			{
-				if (node->keyArray[i] >= lowValInt)
-				{
-					break;
-				}
-				if (node->keyArray[i] == -1)
+				const bool newKey = count == 0 || pairs[next + count].key != pairs[next + count - 1].key;
+				const int entryBytes = entrySize + (newKey ? NodeSize<T>::POSTING : 0);
+				if (count > 0 && bytes + entryBytes > share)
 				{
 					break;
 				}
+				bytes += entryBytes;
+				keys[count] = pairs[next + count].key;
+				rids[count] = pairs[next + count].rid;
+				count++;
 			}
-			PageId oldPageNo = pageNo;
-			pageNo = node->pageNoArray[i];
-			bufMgr->unPinPage(file, oldPageNo, false);
-			bufMgr->readPage(file, pageNo, (Page *&)node);
-		}
+			appendLeaf(keys, rids, payloadSize > 0 && count > 0 ? &payloads[next * payloadSize] : NULL, count,
+					   prevPageNo, prevLeaf, level);
+			next += count;
+		} while (next < pairs.size());
+		bufMgr->unPinPage(file, prevPageNo, true);
+		buildNonLeafLevels(level, nodeFill);
+	}
+
+	template <class T>
+	void BTreeIndex::bulkLoadExternal(const std::string &relationName, const double fillFactor, const size_t sortMemory)
+	{
+		// Each record of the sort is a pair followed by its payload, padded so that every pair stays aligned
+		const int align = (int)alignof(RIDKeyPair<T>);
+		const int recordSize = ((int)sizeof(RIDKeyPair<T>) + payloadSize + align - 1) / align * align;
+		// While the merged pairs are packed, the last leaf and the one appended after it are pinned
+		const int packerPins = 2;
+		ExternalSort sorter(
+			bufMgr, recordSize, sortMemory,
+			[](const char *a, const char *b) { return *(const RIDKeyPair<T> *)a < *(const RIDKeyPair<T> *)b; },
+			packerPins);
+		std::vector<char> record(recordSize);
+		RIDKeyPair<T> *pair = (RIDKeyPair<T> *)&record[0];
+		char *payload = &record[sizeof(RIDKeyPair<T>)];
 		{
-			int i;
-			for (i = 0; i < INTARRAYNONLEAFSIZE; i++)
+			FileScan fScan(relationName, bufMgr);
+			RecordId recID;
+			try
 			{
-				if (node->keyArray[i] >= lowValInt)
-				{
-					break;
-				}
-				if (node->keyArray[i] == -1)
+				while (true)
 				{
-					break;
+					fScan.scanNext(recID); // Throws EndOfFileException
+					std::string tuple = fScan.getRecord();
+					pair->set(recID, recordKey<T>(tuple.c_str()));
+					extractPayload(tuple.c_str(), payload);
+					sorter.add(&record[0]);
 				}
 			}
-			PageId oldPageNo = pageNo;
-			pageNo = node->pageNoArray[i];
-			bufMgr->unPinPage(file, oldPageNo, false);
-			bufMgr->readPage(file, pageNo, (Page *&)leaf);
+			catch (const EndOfFileException &e)
+			{
+			}
 		}
 
-		bool ans = false;
-		for (int i = 0; i < INTARRAYLEAFSIZE && leaf->keyArray[i] != -1; i++)
+		// Pack leaves full as the merged pairs come. The last full leaf is held back until the one after it
+		// fills, so that at the end the final two leaves can share their entries and neither is left nearly empty.
+		int leafFill, nodeFill;
+		bulkLoadFill<T>(fillFactor, leafFill, nodeFill);
+		const int POSTING = NodeSize<T>::POSTING;
+		std::vector<T> keys(2 * NodeSize<T>::LEAF_ENTRIES);
+		std::vector<RecordId> rids(2 * NodeSize<T>::LEAF_ENTRIES);
+		std::vector<char> payloads(2 * NodeSize<T>::LEAF_ENTRIES * payloadSize + 1);
+		std::vector<PageKeyPair<T> > level;
+		PageId prevPageNo = Page::INVALID_NUMBER;
+		LeafNode<T> *prevLeaf = NULL;
+		// Entries [0, held) are the held leaf and [held, n) the one being filled, taking bytes
+		int held = 0;
+		int n = 0;
+		long bytes = 0;
+		try
 		{
-			int key = leaf->keyArray[i];
-			bool conditions = false;
-			if (lowOp == GTE && highOp == LTE)
-			{
-				conditions = key >= lowValInt && key <= highValInt;
-			}
-			else if (lowOp == GT && highOp == LTE)
+			while (true)
 			{
-				conditions = key > lowValInt && key <= highValInt;
+				sorter.scanNext(&record[0]); // Throws EndOfFileException
+				bool newKey = n == held || pair->key != keys[n - 1];
+				if (n > held && bytes + entrySize + (newKey ? POSTING : 0) > leafFill)
+				{
+					if (held > 0)
+					{
+						appendLeaf(&keys[0], &rids[0], &payloads[0], held, prevPageNo, prevLeaf, level);
+						std::copy(keys.begin() + held, keys.begin() + n, keys.begin());
+						std::copy(rids.begin() + held, rids.begin() + n, rids.begin());
+						std::copy(payloads.begin() + held * payloadSize, payloads.begin() + n * payloadSize, payloads.begin());
+						n -= held;
+					}
+					held = n;
+					bytes = 0;
+					newKey = true;
+				}
+				bytes += entrySize + (newKey ? POSTING : 0);
+				keys[n] = pair->key;
+				rids[n] = pair->rid;
+				memcpy(&payloads[n * payloadSize], payload, payloadSize);
+				n++;
 			}
-			else if (lowOp == GTE && highOp == LT)
+		}
+		catch (const EndOfFileException &e)
+		{
+		}
+		const auto leafBytes = [&keys, POSTING, this](const int from, const int to) {
+			long total = 0;
+			for (int i = from; i < to; i++)
 			{
-				conditions = key >= lowValInt && key < highValInt;
+				total += entrySize + (i == from || keys[i] != keys[i - 1] ? POSTING : 0);
 			}
-			else
+			return total;
+		};
+		// Move entries from the end of the held leaf to the last one while the last stays the smaller
+		int cut = held;
+		while (cut > 1 && leafBytes(cut - 1, n) <= leafBytes(0, cut - 1))
+		{
+			cut--;
+		}
+		if (held > 0)
+		{
+			appendLeaf(&keys[0], &rids[0], &payloads[0], cut, prevPageNo, prevLeaf, level);
+		}
+		appendLeaf(&keys[cut], &rids[cut], &payloads[cut * payloadSize], n - cut, prevPageNo, prevLeaf, level);
+		bufMgr->unPinPage(file, prevPageNo, true);
+		buildNonLeafLevels(level, nodeFill);
+	}
+
+	template <class T>
+	void BTreeIndex::bulkLoadFill(const double fillFactor, int &leafFill, int &nodeFill) const
+	{
+		const int SPACE = NodeSize<T>::LEAF_SPACE;
+		leafFill = (int)(SPACE * fillFactor);
+		leafFill = std::max(NodeSize<T>::POSTING + entrySize, std::min(leafFill, SPACE));
+		nodeFill = (int)((NodeSize<T>::NONLEAF + 1) * fillFactor);
+		nodeFill = std::max(2, std::min(nodeFill, NodeSize<T>::NONLEAF + 1));
+	}
+
+	template <class T>
+	void BTreeIndex::appendLeaf(const T *keys, const RecordId *rids, const char *payloads, const int count,
+								PageId &prevPageNo, LeafNode<T> *&prevLeaf, std::vector<PageKeyPair<T> > &level)
+	{
+		PageId pageNo;
+		Page *page;
+		bufMgr->allocPage(file, pageNo, page);
+		LeafNode<T> *leaf = (LeafNode<T> *)page;
+		initLeaf(leaf);
+		leaf->rightSibPageNo = -1;
+		leaf->leftSibPageNo = prevLeaf != NULL ? prevPageNo : (PageId)-1;
+		packLeaf(leaf, keys, rids, payloadSize > 0 && count > 0 ? payloads : NULL, count);
+
+		PageKeyPair<T> entry;
+		entry.set(pageNo, count > 0 ? keys[0] : T(), (std::uint32_t)count);
+		level.push_back(entry);
+
+		if (prevLeaf != NULL)
+		{
+			prevLeaf->rightSibPageNo = pageNo;
+			bufMgr->unPinPage(file, prevPageNo, true);
+		}
+		prevLeaf = leaf;
+		prevPageNo = pageNo;
+	}
+
+	template <class T>
+	void BTreeIndex::buildNonLeafLevels(std::vector<PageKeyPair<T> > &level, const int nodeFill)
+	{
+		// Build the non-leaf levels one at a time until a single root is left. The
+		// root is always a non-leaf node, even when there is only one leaf.
+		int nodeLevel = 1;
+		do
+		{
+			std::vector<PageKeyPair<T> > upper;
+			const size_t numNodes = (level.size() + nodeFill - 1) / nodeFill;
+			size_t child = 0;
+			for (size_t n = 0; n < numNodes; n++)
 			{
-				conditions = key > lowValInt && key < highValInt;
+				const size_t count = level.size() / numNodes + (n < level.size() % numNodes ? 1 : 0);
+				PageId pageNo;
+				Page *page;
+				bufMgr->allocPage(file, pageNo, page);
+				NonLeafNode<T> *node = (NonLeafNode<T> *)page;
+				initNonLeaf(node, nodeLevel, (int)count - 1);
+				node->pageNoArray[0] = level[child].pageNo;
+				node->countArray[0] = level[child].count;
+				for (size_t i = 1; i < count; i++)
+				{
+					node->keyArray[i - 1] = level[child + i].key;
+					node->pageNoArray[i] = level[child + i].pageNo;
+					node->countArray[i] = level[child + i].count;
+				}
+				setPrefixes(node, 0);
+
+				PageKeyPair<T> entry;
+				entry.set(pageNo, level[child].key, subtreeCount(node));
+				upper.push_back(entry);
+				child += count;
+				bufMgr->unPinPage(file, pageNo, true);
 			}
-			if (conditions)
+			level.swap(upper);
+			nodeLevel++;
+		} while (level.size() > 1);
+
+		rootPageNum = level[0].pageNo;
+		Page *metaPage;
+		bufMgr->readPage(file, headerPageNum, metaPage);
+		IndexMetaInfo *meta = (IndexMetaInfo *)metaPage;
+		meta->rootPageNo = rootPageNum;
+		bufMgr->unPinPage(file, headerPageNum, true);
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::~BTreeIndex -- destructor
+	// -----------------------------------------------------------------------------
+
+	BTreeIndex::~BTreeIndex()
+	{
+		try
+		{
+			if (scan.isOpen())
 			{
-				ans = true;
-				scanExecuting = true;
-				currentPageNum = pageNo;
-				currentPageData = (Page *)leaf;
-				nextEntry = i;
-				break;
+				endScan();
 			}
+			flushWriteBuffer();
+			dropHotNodes(true);
+			unswizzleNodes(true);
+			bufMgr->flushFile(file);
 		}
-
-		if (!ans)
+		catch (...)
 		{
-			scanExecuting = false;
-			bufMgr->unPinPage(file, pageNo, false);
-			throw NoSuchKeyFoundException();
 		}
+		delete file;
 	}
 
 	// -----------------------------------------------------------------------------
-	// BTreeIndex::scanNext
+	// BTreeIndex::insertEntry
 	// -----------------------------------------------------------------------------
 
-	void BTreeIndex::scanNext(RecordId &outRid)
+	void BTreeIndex::insertEntry(const void *key, const RecordId rid)
 	{
-		if (!scanExecuting)
+		if (payloadSize > 0)
 		{
-			throw ScanNotInitializedException();
+			throw BadIndexInfoException(payloadMissing);
 		}
+		(this->*insertFn)(key, rid, NULL);
+	}
 
-		LeafNodeInt *node = (LeafNodeInt *)currentPageData;
+	void BTreeIndex::insertEntry(const void *key, const RecordId rid, const char *record)
+	{
+		char payload[MAX_PAYLOAD_SIZE];
+		extractPayload(record, payload);
+		(this->*insertFn)(key, rid, payload);
+	}
 
-		if (nextEntry == INTARRAYLEAFSIZE || node->keyArray[nextEntry] == -1)
+	template <class T>
+	void BTreeIndex::insertEntryTyped(const void *key, const RecordId rid, const char *payload)
+	{
+		// This method inserts a new entry into the index using the pair <key, rid>.
+		const T value = KeyTraits<T>::get(key);
+		if (writeBufferCapacity > 0)
 		{
-			if (node->rightSibPageNo == (PageId)-1)
+			std::lock_guard<std::mutex> guard(writeBufferMutex);
+			std::vector<RIDKeyPair<T> > &pairs = buffered<T>().pending;
+			pairs.resize(pairs.size() + 1);
+			pairs.back().set(rid, value);
+			bufferedInserts++;
+			if (bufferedInserts >= writeBufferCapacity)
 			{
-				throw IndexScanCompletedException();
+				flushWriteBufferTyped<T>();
 			}
-			const PageId oldPageNum = currentPageNum;
-			currentPageNum = node->rightSibPageNo;
-			nextEntry = 0;
-			bufMgr->unPinPage(file, oldPageNum, false);
-			bufMgr->readPage(file, currentPageNum, (Page *&)currentPageData);
-			node = (LeafNodeInt *)currentPageData;
+			return;
 		}
+		WriteScope scope(*this);
+		while (!tryInsert(value, rid, payload))
+		{
+		}
+	}
+
+	// -----------------------------------------------------------------------------
+	// Hot-node cache
+	// -----------------------------------------------------------------------------
 
-		const int key = node->keyArray[nextEntry];
+	bool BTreeIndex::pinNode(const PageId pageNo, Page *&page, std::uint64_t &version)
+	{
+		if (swizzledCount > 0)
+		{
+			std::atomic<Page *> &frame = latches.frame(pageNo);
+			Page *swizzled = frame.load(std::memory_order_acquire);
+			if (swizzled != NULL)
+			{
+				version = latches.get(pageNo).readLock();
+				// As for a slot of the cache, a node is unswizzled only while it is latched
+				if (frame.load(std::memory_order_acquire) == swizzled)
+				{
+					page = swizzled;
+					hotHits.fetch_add(1, std::memory_order_relaxed);
+					return true;
+				}
+			}
+		}
+		for (int i = 0; hotCount > 0 && i < MAX_HOT_NODES; i++)
+		{
+			if (hotNodes[i].pageNo.load(std::memory_order_acquire) != pageNo)
+			{
+				continue;
+			}
+			Page *hotPage = hotNodes[i].page.load(std::memory_order_relaxed);
+			version = latches.get(pageNo).readLock();
+			// Still in its slot once the version is read, so the frame holds the node until the version changes
+			if (hotNodes[i].pageNo.load(std::memory_order_acquire) == pageNo &&
+				hotNodes[i].page.load(std::memory_order_relaxed) == hotPage)
+			{
+				page = hotPage;
+				hotHits.fetch_add(1, std::memory_order_relaxed);
+				return true;
+			}
+			break;
+		}
+		bufMgr->readPage(file, pageNo, page);
+		version = latches.get(pageNo).readLock();
+		return false;
+	}
 
-		bool check = false;
-		if (lowOp == GTE && highOp == LTE)
+	bool BTreeIndex::keepHot(const PageId pageNo, Page *page, const int depth)
+	{
+		if (swizzledCount >= swizzleLimit && (depth >= hotLevels || hotCount >= MAX_HOT_NODES))
 		{
-			check = key >= lowValInt && key <= highValInt;
+			return false;
 		}
-		else if (lowOp == GT && highOp == LTE)
+		std::lock_guard<std::mutex> guard(hotMutex);
+		std::atomic<Page *> &frame = latches.frame(pageNo);
+		if (frame.load(std::memory_order_relaxed) != NULL)
 		{
-			check = key > lowValInt && key <= highValInt;
+			// Another descent got there first
+			return false;
 		}
-		else if (lowOp == GTE && highOp == LT)
+		if (swizzledCount < swizzleLimit)
 		{
-			check = key >= lowValInt && key < highValInt;
+			for (int i = 0; i < MAX_HOT_NODES; i++)
+			{
+				if (hotNodes[i].pageNo.load(std::memory_order_relaxed) == pageNo)
+				{
+					return false;
+				}
+			}
+			frame.store(page, std::memory_order_release);
+			swizzledPages.push_back(pageNo);
+			swizzledCount++;
+			return true;
 		}
-		else
+		if (depth >= hotLevels)
 		{
-			check = key > lowValInt && key < highValInt;
+			return false;
 		}
-
-		if (check)
+		int free = -1;
+		for (int i = 0; i < MAX_HOT_NODES; i++)
 		{
-			outRid = node->ridArray[nextEntry];
-			nextEntry++;
+			const PageId slotPageNo = hotNodes[i].pageNo.load(std::memory_order_relaxed);
+			if (slotPageNo == pageNo)
+			{
+				// Another descent got there first
+				return false;
+			}
+			if (slotPageNo == (PageId)-1 && free < 0)
+			{
+				free = i;
+			}
 		}
-		else
+		if (free < 0)
 		{
-			throw IndexScanCompletedException();
+			return false;
 		}
+		hotNodes[free].page.store(page, std::memory_order_relaxed);
+		hotNodes[free].pageNo.store(pageNo, std::memory_order_release);
+		hotCount++;
+		return true;
 	}
 
-	// -----------------------------------------------------------------------------
-	// BTreeIndex::endScan
-	// -----------------------------------------------------------------------------
-	//
-	void BTreeIndex::endScan()
+	void BTreeIndex::dropHotNode(const PageId pageNo)
 	{
-		if (!scanExecuting)
+		if (hotCount == 0 && swizzledCount == 0)
 		{
-			throw ScanNotInitializedException();
+			return;
 		}
-		bufMgr->unPinPage(file, currentPageNum, false);
-
-		scanExecuting = false;
-		currentPageData = nullptr;
-		currentPageNum = -1;
-		nextEntry = -1;
-	}
+		std::lock_guard<std::mutex> guard(hotMutex);
+		std::atomic<Page *> &frame = latches.frame(pageNo);
+		if (frame.load(std::memory_order_relaxed) != NULL)
+		{
+			frame.store(NULL, std::memory_order_release);
+			swizzledPages.erase(std::find(swizzledPages.begin(), swizzledPages.end(), pageNo));
+			swizzledCount--;
+			bufMgr->unPinPage(file, pageNo, false);
+			return;
+		}
+		for (int i = 0; i < MAX_HOT_NODES; i++)
+		{
+			if (hotNodes[i].pageNo.load(std::memory_order_relaxed) == pageNo)
+			{
+				hotNodes[i].pageNo.store((PageId)-1, std::memory_order_release);
+				hotCount--;
+				bufMgr->unPinPage(file, pageNo, false);
+				return;
+			}
+		}
+	}
+
+	void BTreeIndex::dropHotNodes(const bool all)
+	{
+		std::lock_guard<std::mutex> guard(hotMutex);
+		for (int i = 0; i < MAX_HOT_NODES; i++)
+		{
+			const PageId pageNo = hotNodes[i].pageNo.load(std::memory_order_relaxed);
+			if (pageNo == (PageId)-1)
+			{
+				continue;
+			}
+			// The new version sends readers that took the node from its slot back to the root
+			VersionLatch &latch = latches.get(pageNo);
+			if (!all && !latch.tryLock())
+			{
+				continue;
+			}
+			hotNodes[i].pageNo.store((PageId)-1, std::memory_order_release);
+			hotCount--;
+			bufMgr->unPinPage(file, pageNo, false);
+			if (!all)
+			{
+				latch.unlock();
+			}
+		}
+	}
+
+	void BTreeIndex::unswizzleNodes(const bool all)
+	{
+		std::lock_guard<std::mutex> guard(hotMutex);
+		for (size_t i = 0; i < swizzledPages.size();)
+		{
+			const PageId pageNo = swizzledPages[i];
+			VersionLatch &latch = latches.get(pageNo);
+			if (!all && !latch.tryLock())
+			{
+				i++;
+				continue;
+			}
+			latches.frame(pageNo).store(NULL, std::memory_order_release);
+			swizzledPages[i] = swizzledPages.back();
+			swizzledPages.pop_back();
+			swizzledCount--;
+			bufMgr->unPinPage(file, pageNo, false);
+			if (!all)
+			{
+				latch.unlock();
+			}
+		}
+	}
+
+	void BTreeIndex::setHotLevels(const int levels)
+	{
+		hotLevels = std::max(levels, 0);
+		dropHotNodes(false);
+	}
+
+	void BTreeIndex::setAppendFill(const double fill)
+	{
+		appendFill = std::max(0.5, std::min(fill, 1.0));
+	}
+
+	void BTreeIndex::setSwizzling(const int maxNodes)
+	{
+		swizzleLimit = std::max(maxNodes, 0);
+		if (swizzleLimit == 0)
+		{
+			unswizzleNodes(false);
+		}
+	}
+
+	template <class T>
+	bool BTreeIndex::descend(const T &key, DescentPath &path, PageId &leafPageNo, Page *&leaf, std::uint64_t &leafVersion,
+							 const bool rightmost)
+	{
+		path.depth = 0;
+		path.rootVersion = rootLatch.readLock();
+		PageId pageNo = rootPageNum;
+		NonLeafNode<T> *node;
+		std::uint64_t version;
+		Page *nodePage;
+		bool hot = pinNode(pageNo, nodePage, version);
+		node = (NonLeafNode<T> *)nodePage;
+		if (!rootLatch.validate(path.rootVersion))
+		{
+			unpinNode(pageNo, hot);
+			return false;
+		}
+		hot = hot || keepHot(pageNo, (Page *)node, 0);
+		while (true)
+		{
+			const int n = keyCount(node, NodeSize<T>::NONLEAF);
+			const int index = separatorBound(searchKernel(), node, n, key, rightmost);
+			const PageId child = node->pageNoArray[index];
+			const bool aboveLeaves = node->header.level == 1;
+			// Nothing read from the node can be trusted, not even the child, until this holds
+			if (!latches.get(pageNo).validate(version))
+			{
+				unpinNode(pageNo, hot);
+				return false;
+			}
+			path.pageNo[path.depth] = pageNo;
+			path.version[path.depth] = version;
+			path.index[path.depth] = index;
+			path.depth++;
+
+			Page *childPage;
+			std::uint64_t childVersion;
+			const bool childHot = pinNode(child, childPage, childVersion);
+			// The child is still the right one if the parent has not changed meanwhile
+			const bool valid = latches.get(pageNo).validate(version);
+			unpinNode(pageNo, hot);
+			if (!valid)
+			{
+				unpinNode(child, childHot);
+				return false;
+			}
+			pageNo = child;
+			version = childVersion;
+			if (aboveLeaves)
+			{
+				leafPageNo = child;
+				leaf = childPage;
+				leafVersion = childVersion;
+				return true;
+			}
+			hot = childHot || keepHot(child, childPage, path.depth);
+			node = (NonLeafNode<T> *)childPage;
+		}
+	}
+
+	template <class T>
+	bool BTreeIndex::tryInsert(const T &key, const RecordId rid, const char *payload)
+	{
+		DescentPath path;
+		PageId leafPageNo;
+		Page *page;
+		std::uint64_t leafVersion;
+		if (!descend(key, path, leafPageNo, page, leafVersion))
+		{
+			return false;
+		}
+		LeafNode<T> *leaf = (LeafNode<T> *)page;
+		VersionLatch &leafLatch = latches.get(leafPageNo);
+		if (!leafLatch.upgrade(leafVersion))
+		{
+			bufMgr->unPinPage(file, leafPageNo, false);
+			return false;
+		}
+		// A leaf without room for the entry, and a posting list if its key has none, splits, and the new leaf
+		// becomes the left sibling of the one on its right
+		int first, end;
+		leafRange(leaf, key, first, end);
+		const bool split = leafBytes(leaf) + entrySize + (first == end ? NodeSize<T>::POSTING : 0) > NodeSize<T>::LEAF_SPACE;
+		const PageId sibPageNo = split ? leaf->rightSibPageNo : (PageId)-1;
+		// An entry that goes after every entry of the rightmost leaf is taken for an append of increasing keys
+		const bool append = split && leaf->rightSibPageNo == (PageId)-1 && end == keyCount(leaf, leafOccupancy);
+		if (!latchRightSibling(sibPageNo))
+		{
+			leafLatch.unlockUnchanged();
+			bufMgr->unPinPage(file, leafPageNo, false);
+			return false;
+		}
+		int top;
+		bool rootLocked;
+		if (!latchInsertPath<T>(path, split, top, rootLocked))
+		{
+			if (sibPageNo != (PageId)-1)
+			{
+				latches.get(sibPageNo).unlockUnchanged();
+			}
+			leafLatch.unlockUnchanged();
+			bufMgr->unPinPage(file, leafPageNo, false);
+			return false;
+		}
+		// Open snapshots keep the nodes as they are before anything changes
+		preserveNode(leafPageNo);
+		if (sibPageNo != (PageId)-1)
+		{
+			preserveNode(sibPageNo);
+		}
+		preservePath(path, top);
+		PageKeyPair<T> changes;
+		changes.set(-1, key);
+		if (split)
+		{
+			changes = split_leaf(leafPageNo, leaf, key, rid, payload, append);
+		}
+		else
+		{
+			leafInsert(leaf, key, rid, payload);
+		}
+		bufMgr->unPinPage(file, leafPageNo, true);
+		propagateInsert(path, top, rootLocked, changes, 1, append);
+		if (sibPageNo != (PageId)-1)
+		{
+			latches.get(sibPageNo).unlock();
+		}
+		leafLatch.unlock();
+		return true;
+	}
+
+	bool BTreeIndex::latchRightSibling(const PageId sibPageNo)
+	{
+		return sibPageNo == (PageId)-1 || latches.get(sibPageNo).tryLock();
+	}
+
+	template <class T>
+	void BTreeIndex::setLeftSibling(const PageId pageNo, const PageId leftPageNo)
+	{
+		if (pageNo == (PageId)-1)
+		{
+			return;
+		}
+		Page *leafPage;
+		bufMgr->readPage(file, pageNo, leafPage);
+		LeafNode<T> *leaf = (LeafNode<T> *)leafPage;
+		leaf->leftSibPageNo = leftPageNo;
+		bufMgr->unPinPage(file, pageNo, true);
+	}
+
+	template <class T>
+	bool BTreeIndex::latchInsertPath(const DescentPath &path, const bool split, int &top, bool &rootLocked)
+	{
+		// Bottom-up. A split reaches every full ancestor up to the first that is not full.
+		top = path.depth;
+		rootLocked = false;
+		bool splitting = split;
+		int d = path.depth;
+		for (; d > 0 && splitting; d--)
+		{
+			if (!latches.get(path.pageNo[d - 1]).upgrade(path.version[d - 1]))
+			{
+				break;
+			}
+			top = d - 1;
+			Page *nodePage;
+			bufMgr->readPage(file, path.pageNo[d - 1], nodePage);
+			NonLeafNode<T> *node = (NonLeafNode<T> *)nodePage;
+			splitting = keyCount(node, NodeSize<T>::NONLEAF) == NodeSize<T>::NONLEAF;
+			bufMgr->unPinPage(file, path.pageNo[d - 1], false);
+		}
+		// The root pointer changes if the root splits too. Above top, only the entry counts change.
+		const bool latched = !splitting ? joinAncestorCounters(path, top) : d == 0 && (rootLocked = rootLatch.upgrade(path.rootVersion));
+		if (!latched)
+		{
+			for (int i = d; i < path.depth; i++)
+			{
+				latches.get(path.pageNo[i]).unlockUnchanged();
+			}
+		}
+		return latched;
+	}
+
+	template <class T>
+	void BTreeIndex::propagateInsert(const DescentPath &path, const int top, const bool rootLocked, PageKeyPair<T> changes,
+									 const std::uint32_t delta, const bool append)
+	{
+		// Bottom-up. Up to top, each node takes the new node of its child's split, and splits itself if full.
+		// Above it, only the count of the child on the path grows.
+		for (int d = path.depth - 1; d >= 0; d--)
+		{
+			Page *nodePage;
+			bufMgr->readPage(file, path.pageNo[d], nodePage);
+			NonLeafNode<T> *node = (NonLeafNode<T> *)nodePage;
+			const int index = path.index[d];
+			if (changes.pageNo == (PageId)-1)
+			{
+				__atomic_fetch_add(&node->countArray[index], delta, __ATOMIC_RELAXED);
+			}
+			else
+			{
+				// The child that split keeps the entries that did not go to the new node
+				node->countArray[index] += delta - changes.count;
+				if (keyCount(node, NodeSize<T>::NONLEAF) < NodeSize<T>::NONLEAF)
+				{
+					// Insert changes returned to this level
+					insert_in_non_leaf(node, index, changes);
+					changes.pageNo = (PageId)-1;
+				}
+				else
+				{
+					// Split this node and Insert changes returned to this level. Above the rightmost leaf, the new
+					// node goes after the last child of each node on the path.
+					changes = split_non_leaf(node, index, changes, append);
+				}
+			}
+			bufMgr->unPinPage(file, path.pageNo[d], true);
+		}
+		if (changes.pageNo != (PageId)-1)
+		{
+			root_updation(changes);
+		}
+
+		// A change of entry counts alone leaves the tree as descents see it, so those nodes keep their version
+		leaveAncestorCounters(path, top);
+		for (int d = top; d < path.depth; d++)
+		{
+			latches.get(path.pageNo[d]).unlock();
+		}
+		if (rootLocked)
+		{
+			rootLatch.unlock();
+		}
+	}
+
+	template <class T>
+	void BTreeIndex::root_updation(const PageKeyPair<T> &root_changes)
+	{
+		// Allocate a new page for the new root
+		PageId new_pid;
+		Page *new_page;
+		allocNode<T>(new_pid, new_page);
+
+		// The old root is always a non-leaf node, so the new root is one level above it
+		Page *oldRootPage;
+		bufMgr->readPage(file, rootPageNum, oldRootPage);
+		NonLeafNode<T> *oldRoot = (NonLeafNode<T> *)oldRootPage;
+		const int level = oldRoot->header.level + 1;
+		const std::uint32_t oldRootCount = subtreeCount(oldRoot);
+		bufMgr->unPinPage(file, rootPageNum, false);
+		NonLeafNode<T> *newRoot = (NonLeafNode<T> *)new_page;
+		initNonLeaf(newRoot, level, 1);
+		newRoot->keyArray[0] = root_changes.key;
+		newRoot->pageNoArray[0] = rootPageNum;
+		newRoot->pageNoArray[1] = root_changes.pageNo;
+		newRoot->countArray[0] = oldRootCount;
+		newRoot->countArray[1] = root_changes.count;
+		setPrefixes(newRoot, 0);
+		bufMgr->unPinPage(file, new_pid, true);
+
+		rootPageNum = new_pid;
+
+		Page *metaPage;
+		bufMgr->readPage(file, headerPageNum, metaPage);
+		IndexMetaInfo *meta = (IndexMetaInfo *)metaPage;
+		meta->rootPageNo = rootPageNum;
+		bufMgr->unPinPage(file, headerPageNum, true);
+		dropHotNodes(false);
+	}
+
+	template <class T>
+	void BTreeIndex::insert_in_non_leaf(NonLeafNode<T> *node, const int index, const PageKeyPair<T> &changes)
+	{
+		const int n = keyCount(node, NodeSize<T>::NONLEAF);
+		// Shift larger keys right. The new page goes to the right of its key.
+		memmove(&node->keyArray[index + 1], &node->keyArray[index], (n - index) * sizeof(T));
+		memmove(&node->pageNoArray[index + 2], &node->pageNoArray[index + 1], (n - index) * sizeof(PageId));
+		memmove(&node->countArray[index + 2], &node->countArray[index + 1], (n - index) * sizeof(std::uint32_t));
+		node->keyArray[index] = changes.key;
+		node->pageNoArray[index + 1] = changes.pageNo;
+		node->countArray[index + 1] = changes.count;
+		node->header.keyCount = n + 1;
+		setPrefixes(node, index);
+	}
+
+	template <class T>
+	PageKeyPair<T> BTreeIndex::split_leaf(const PageId pageNo, LeafNode<T> *node, const T &key, const RecordId rid, const char *payload,
+										  const bool append)
+	{
+		// Lay out all entries, including the new one after those with its key, in order
+		T keys[NodeSize<T>::LEAF_ENTRIES + 1];
+		RecordId rids[NodeSize<T>::LEAF_ENTRIES + 1];
+		char payloads[NodeSize<T>::LEAF_SPACE + MAX_PAYLOAD_SIZE];
+		const int n = unpackLeaf(node, keys, rids, payloads);
+		const int index = keyUpperBound(searchKernel(), keys, n, key);
+		memmove(keys + index + 1, keys + index, (n - index) * sizeof(T));
+		memmove(rids + index + 1, rids + index, (n - index) * sizeof(RecordId));
+		memmove(payloads + (index + 1) * payloadSize, payloads + index * payloadSize, (n - index) * payloadSize);
+		keys[index] = key;
+		rids[index] = rid;
+		memcpy(payloads + index * payloadSize, payload, payloadSize);
+		const int total = n + 1;
+
+		// Allocate a new page for the new node
+		PageId new_pid;
+		Page *new_page;
+		allocNode<T>(new_pid, new_page);
+		// Make a new leaf node for the page and initialising leaf variables
+		LeafNode<T> *new_leaf = (LeafNode<T> *)new_page;
+		initLeaf(new_leaf);
+
+		// The old leaf keeps the first half of the bytes, or most of its space on an append, and the new one takes the rest
+		const int half = append ? appendSplitPoint(keys, total) : splitPoint(keys, total);
+		packLeaf(node, keys, rids, payloads, half);
+		packLeaf(new_leaf, keys + half, rids + half, payloads + half * payloadSize, total - half);
+
+		// Modifying sibling values
+		new_leaf->rightSibPageNo = node->rightSibPageNo;
+		new_leaf->leftSibPageNo = pageNo;
+		setLeftSibling<T>(node->rightSibPageNo, new_pid);
+		node->rightSibPageNo = new_pid;
+
+		// Send back the changes to the upper level node
+		PageKeyPair<T> newPair;
+		newPair.set(new_pid, keys[half], total - half);
+
+		// Unpin this page from buffer
+		bufMgr->unPinPage(file, new_pid, true);
+		return newPair;
+	}
+
+	template <class T>
+	PageKeyPair<T> BTreeIndex::split_non_leaf(NonLeafNode<T> *node, const int index, const PageKeyPair<T> &changes,
+											  const bool append)
+	{
+		const int NONLEAF = NodeSize<T>::NONLEAF;
+		// Lay out all keys and children, including the new ones, in order
+		T keys[NONLEAF + 1];
+		PageId pages[NONLEAF + 2];
+		std::uint32_t counts[NONLEAF + 2];
+		pages[0] = node->pageNoArray[0];
+		counts[0] = node->countArray[0];
+		for (int i = 0, j = 0; i < NONLEAF + 1; i++)
+		{
+			if (i == index)
+			{
+				keys[i] = changes.key;
+				pages[i + 1] = changes.pageNo;
+				counts[i + 1] = changes.count;
+			}
+			else
+			{
+				keys[i] = node->keyArray[j];
+				pages[i + 1] = node->pageNoArray[j + 1];
+				counts[i + 1] = node->countArray[j + 1];
+				j++;
+			}
+		}
+
+		// Allocate a new page for the new node
+		PageId new_pid;
+		Page *new_page;
+		allocNode<T>(new_pid, new_page);
+		NonLeafNode<T> *new_non_leaf = (NonLeafNode<T> *)new_page;
+
+		// The middle key moves up, keys left of it stay and keys right of it move to the new node. An append
+		// moves up a key further right, down to the new child when the node keeps all of its keys.
+		int half = (NONLEAF + 1) / 2;
+		if (append && index == NONLEAF)
+		{
+			half = std::max(half, std::min((int)(NONLEAF * appendFill), NONLEAF));
+		}
+		initNonLeaf(new_non_leaf, node->header.level, NONLEAF - half);
+		node->header.keyCount = half;
+		for (int i = 0; i < half; i++)
+		{
+			node->keyArray[i] = keys[i];
+			node->pageNoArray[i + 1] = pages[i + 1];
+			node->countArray[i + 1] = counts[i + 1];
+		}
+		new_non_leaf->pageNoArray[0] = pages[half + 1];
+		new_non_leaf->countArray[0] = counts[half + 1];
+		for (int from = half + 1; from < NONLEAF + 1; from++)
+		{
+			new_non_leaf->keyArray[from - half - 1] = keys[from];
+			new_non_leaf->pageNoArray[from - half] = pages[from + 1];
+			new_non_leaf->countArray[from - half] = counts[from + 1];
+		}
+
+		setPrefixes(node, 0);
+		setPrefixes(new_non_leaf, 0);
+
+		PageKeyPair<T> push_up_changes;
+		push_up_changes.set(new_pid, keys[half], subtreeCount(new_non_leaf));
+		bufMgr->unPinPage(file, new_pid, true);
+		return push_up_changes;
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::insertBatch
+	// -----------------------------------------------------------------------------
+
+	template <class T>
+	void BTreeIndex::insertBatch(const RIDKeyPair<T> *pairs, size_t n)
+	{
+		if (KeyTraits<T>::type != attributeType)
+		{
+			throw BadIndexInfoException(batchTypeMismatch);
+		}
+		if (payloadSize > 0)
+		{
+			throw BadIndexInfoException(payloadMissing);
+		}
+		applyWriteBuffer();
+		std::vector<RIDKeyPair<T> > sorted(pairs, pairs + n);
+		std::sort(sorted.begin(), sorted.end());
+		insertSorted(sorted.data(), n);
+	}
+
+	template <class T>
+	void BTreeIndex::insertSorted(const RIDKeyPair<T> *pairs, const size_t n)
+	{
+		WriteScope scope(*this);
+		size_t done = 0;
+		while (done < n)
+		{
+			done += tryInsertRun(&pairs[done], n - done);
+		}
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::setWriteBuffer
+	// -----------------------------------------------------------------------------
+
+	void BTreeIndex::setWriteBuffer(const size_t capacity)
+	{
+		if (capacity > 0 && payloadSize > 0)
+		{
+			throw BadIndexInfoException(payloadNotBuffered);
+		}
+		std::lock_guard<std::mutex> guard(writeBufferMutex);
+		(this->*flushFn)();
+		writeBufferCapacity = capacity;
+	}
+
+	void BTreeIndex::flushWriteBuffer()
+	{
+		std::lock_guard<std::mutex> guard(writeBufferMutex);
+		(this->*flushFn)();
+	}
+
+	template <class T>
+	void BTreeIndex::flushWriteBufferTyped()
+	{
+		if (bufferedInserts == 0)
+		{
+			return;
+		}
+		// Before any entry reaches the tree, so that point reads that searched the buffer read it again
+		writeBufferFlushes++;
+		BufferedInserts<T> &held = buffered<T>();
+		std::vector<RIDKeyPair<T> > &pairs = held.pending;
+		for (size_t i = 0; i < held.runs.size(); i++)
+		{
+			pairs.insert(pairs.end(), held.runs[i].begin(), held.runs[i].end());
+		}
+		held.runs.clear();
+		// Sorted, the entries going into one leaf are inserted together, so each leaf is read and written once
+		std::sort(pairs.begin(), pairs.end());
+		insertSorted(pairs.data(), pairs.size());
+		pairs.clear();
+		bufferedInserts = 0;
+	}
+
+	template <class T>
+	size_t BTreeIndex::readWriteBuffer(const T &low, const bool lowInclusive, const T &high, const bool highInclusive,
+									   std::vector<RecordId> *out, std::uint64_t &flushes)
+	{
+		std::lock_guard<std::mutex> guard(writeBufferMutex);
+		flushes = writeBufferFlushes;
+		BufferedInserts<T> &held = buffered<T>();
+		// What came since the last read becomes a run, and runs merge while the last is at least half the one before
+		if (!held.pending.empty())
+		{
+			std::sort(held.pending.begin(), held.pending.end());
+			held.runs.push_back(std::vector<RIDKeyPair<T> >());
+			held.runs.back().swap(held.pending);
+			while (held.runs.size() > 1 && held.runs[held.runs.size() - 2].size() <= 2 * held.runs.back().size())
+			{
+				std::vector<RIDKeyPair<T> > &left = held.runs[held.runs.size() - 2];
+				const std::vector<RIDKeyPair<T> > &right = held.runs.back();
+				const size_t middle = left.size();
+				left.insert(left.end(), right.begin(), right.end());
+				std::inplace_merge(left.begin(), left.begin() + middle, left.end());
+				held.runs.pop_back();
+			}
+		}
+		// Page 0 sorts before every record id with the same key
+		RIDKeyPair<T> first;
+		first.set(RecordId(), low);
+		size_t count = 0;
+		for (size_t r = 0; r < held.runs.size(); r++)
+		{
+			const std::vector<RIDKeyPair<T> > &run = held.runs[r];
+			for (typename std::vector<RIDKeyPair<T> >::const_iterator it = std::lower_bound(run.begin(), run.end(), first);
+				 it != run.end() && (highInclusive ? it->key <= high : it->key < high); ++it)
+			{
+				if (!lowInclusive && it->key == low)
+				{
+					continue;
+				}
+				if (out != NULL)
+				{
+					out->push_back(it->rid);
+				}
+				count++;
+			}
+		}
+		return count;
+	}
+
+	template <class T>
+	size_t BTreeIndex::tryInsertRun(const RIDKeyPair<T> *pairs, const size_t n)
+	{
+		DescentPath path;
+		PageId leafPageNo;
+		Page *page;
+		std::uint64_t leafVersion;
+		if (!descend(pairs[0].key, path, leafPageNo, page, leafVersion))
+		{
+			return 0;
+		}
+		LeafNode<T> *leaf = (LeafNode<T> *)page;
+		VersionLatch &leafLatch = latches.get(leafPageNo);
+		if (!leafLatch.upgrade(leafVersion))
+		{
+			bufMgr->unPinPage(file, leafPageNo, false);
+			return 0;
+		}
+
+		// Keys up to the separator right of the leaf belong in it. That is the key right of the path
+		// in the lowest node on it where the path does not take the last child; the rightmost leaf has none.
+		T fence;
+		bool fenced = false;
+		for (int d = path.depth - 1; d >= 0 && !fenced; d--)
+		{
+			Page *nodePage;
+			bufMgr->readPage(file, path.pageNo[d], nodePage);
+			NonLeafNode<T> *node = (NonLeafNode<T> *)nodePage;
+			if (path.index[d] < keyCount(node, NodeSize<T>::NONLEAF))
+			{
+				fence = node->keyArray[path.index[d]];
+				fenced = true;
+			}
+			const bool valid = latches.get(path.pageNo[d]).validate(path.version[d]);
+			bufMgr->unPinPage(file, path.pageNo[d], false);
+			if (!valid)
+			{
+				leafLatch.unlockUnchanged();
+				bufMgr->unPinPage(file, leafPageNo, false);
+				return 0;
+			}
+		}
+
+		// The leaf splits at most once per descent, so it takes no more pairs than two leaves can share evenly
+		const int count = keyCount(leaf, leafOccupancy);
+		const int most = 2 * (NodeSize<T>::LEAF_SPACE - entrySize - NodeSize<T>::POSTING);
+		int bytes = leafBytes(leaf);
+		int take = 0;
+		while ((size_t)take < n && (!fenced || pairs[take].key <= fence))
+		{
+			// A pair needs a posting list if it is the first with its key and the leaf has none for it
+			int first = 0, end = 1;
+			if (take == 0 || pairs[take].key != pairs[take - 1].key)
+			{
+				leafRange(leaf, pairs[take].key, first, end);
+			}
+			const int pairBytes = entrySize + (first == end ? NodeSize<T>::POSTING : 0);
+			if (bytes + pairBytes > most)
+			{
+				break;
+			}
+			bytes += pairBytes;
+			take++;
+		}
+		const bool split = bytes > NodeSize<T>::LEAF_SPACE;
+		const PageId sibPageNo = split ? leaf->rightSibPageNo : (PageId)-1;
+		const bool append = split && !fenced && leaf->rightSibPageNo == (PageId)-1 && leafBound(leaf, pairs[0].key, true) == count;
+		if (!latchRightSibling(sibPageNo))
+		{
+			leafLatch.unlockUnchanged();
+			bufMgr->unPinPage(file, leafPageNo, false);
+			return 0;
+		}
+		int top;
+		bool rootLocked;
+		if (!latchInsertPath<T>(path, split, top, rootLocked))
+		{
+			if (sibPageNo != (PageId)-1)
+			{
+				latches.get(sibPageNo).unlockUnchanged();
+			}
+			leafLatch.unlockUnchanged();
+			bufMgr->unPinPage(file, leafPageNo, false);
+			return 0;
+		}
+		preserveNode(leafPageNo);
+		if (sibPageNo != (PageId)-1)
+		{
+			preserveNode(sibPageNo);
+		}
+		preservePath(path, top);
+		PageKeyPair<T> changes;
+		changes.set(-1, pairs[0].key);
+		if (split)
+		{
+			changes = splitLeafRun(leafPageNo, leaf, count, pairs, take, append);
+		}
+		else
+		{
+			T keys[NodeSize<T>::LEAF_ENTRIES];
+			RecordId rids[NodeSize<T>::LEAF_ENTRIES];
+			unpackLeaf(leaf, keys, rids, NULL);
+			mergeLeafEntries(keys, rids, count, pairs, take, keys, rids);
+			packLeaf(leaf, keys, rids, NULL, count + take);
+		}
+		bufMgr->unPinPage(file, leafPageNo, true);
+		propagateInsert(path, top, rootLocked, changes, (std::uint32_t)take, append);
+		if (sibPageNo != (PageId)-1)
+		{
+			latches.get(sibPageNo).unlock();
+		}
+		leafLatch.unlock();
+		return take;
+	}
+
+	template <class T>
+	PageKeyPair<T> BTreeIndex::splitLeafRun(const PageId pageNo, LeafNode<T> *node, const int count, const RIDKeyPair<T> *pairs, const int m,
+											const bool append)
+	{
+		T keys[2 * NodeSize<T>::LEAF_ENTRIES];
+		RecordId rids[2 * NodeSize<T>::LEAF_ENTRIES];
+		unpackLeaf(node, keys, rids, NULL);
+		mergeLeafEntries(keys, rids, count, pairs, m, keys, rids);
+		const int total = count + m;
+		const int half = append ? appendSplitPoint(keys, total) : splitPoint(keys, total);
+
+		PageId new_pid;
+		Page *new_page;
+		allocNode<T>(new_pid, new_page);
+		LeafNode<T> *new_leaf = (LeafNode<T> *)new_page;
+		initLeaf(new_leaf);
+		packLeaf(node, keys, rids, NULL, half);
+		packLeaf(new_leaf, keys + half, rids + half, NULL, total - half);
+		new_leaf->rightSibPageNo = node->rightSibPageNo;
+		new_leaf->leftSibPageNo = pageNo;
+		setLeftSibling<T>(node->rightSibPageNo, new_pid);
+		node->rightSibPageNo = new_pid;
+
+		PageKeyPair<T> newPair;
+		newPair.set(new_pid, keys[half], total - half);
+		bufMgr->unPinPage(file, new_pid, true);
+		return newPair;
+	}
+	// -----------------------------------------------------------------------------
+	// Page allocation
+	// -----------------------------------------------------------------------------
+
+	template <class T>
+	void BTreeIndex::allocNode(PageId &pageNo, Page *&page)
+	{
+		std::lock_guard<std::mutex> guard(freeListMutex);
+		if (freePageNum == (PageId)-1 || openCursors > 0)
+		{
+			bufMgr->allocPage(file, pageNo, page);
+			return;
+		}
+		pageNo = freePageNum;
+		bufMgr->readPage(file, pageNo, page);
+		freePageNum = ((LeafNode<T> *)page)->rightSibPageNo;
+
+		Page *metaPage;
+		bufMgr->readPage(file, headerPageNum, metaPage);
+		IndexMetaInfo *meta = (IndexMetaInfo *)metaPage;
+		meta->freePageNo = freePageNum;
+		bufMgr->unPinPage(file, headerPageNum, true);
+	}
+
+	template <class T>
+	void BTreeIndex::freeNode(const PageId pageNo, Page *page)
+	{
+		dropHotNode(pageNo);
+		std::lock_guard<std::mutex> guard(freeListMutex);
+		// An empty leaf, so that a cursor still on the page finds nothing in it
+		LeafNode<T> *leaf = (LeafNode<T> *)page;
+		initLeaf(leaf);
+		leaf->rightSibPageNo = freePageNum;
+		bufMgr->unPinPage(file, pageNo, true);
+		freePageNum = pageNo;
+
+		Page *metaPage;
+		bufMgr->readPage(file, headerPageNum, metaPage);
+		IndexMetaInfo *meta = (IndexMetaInfo *)metaPage;
+		meta->freePageNo = freePageNum;
+		bufMgr->unPinPage(file, headerPageNum, true);
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::deleteEntry
+	// -----------------------------------------------------------------------------
+
+	bool BTreeIndex::deleteEntry(const void *key, const RecordId rid)
+	{
+		applyWriteBuffer();
+		return (this->*deleteFn)(key, rid);
+	}
+
+	template <class T>
+	bool BTreeIndex::deleteEntryTyped(const void *key, const RecordId rid)
+	{
+		const T value = KeyTraits<T>::get(key);
+		bool found;
+		WriteScope scope(*this);
+		while (!tryDelete(value, rid, found))
+		{
+		}
+		return found;
+	}
+
+	template <class T>
+	bool BTreeIndex::tryDelete(const T &key, const RecordId rid, bool &found)
+	{
+		const int SPACE = NodeSize<T>::LEAF_SPACE;
+		const int NONLEAF = NodeSize<T>::NONLEAF;
+		DescentPath path;
+		PageId pageNo;
+		Page *page;
+		std::uint64_t version;
+		if (!descend(key, path, pageNo, page, version))
+		{
+			return false;
+		}
+
+		// Find the entry. Duplicates of key can go on into leaves to the right, and the path follows them there.
+		LeafNode<T> *leaf;
+		int n;
+		int pos;
+		// Bytes the leaf is left with once the entry is removed
+		int remaining = 0;
+		while (true)
+		{
+			leaf = (LeafNode<T> *)page;
+			n = keyCount(leaf, leafOccupancy);
+			pos = -1;
+			int first, end;
+			leafRange(leaf, key, first, end);
+			for (int i = first; i < end; i++)
+			{
+				if (leafRid(leaf, i) == rid)
+				{
+					pos = i;
+					break;
+				}
+			}
+			if (pos >= 0)
+			{
+				// The posting list goes with its last entry
+				remaining = leafBytes(leaf) - entrySize - (end - first == 1 ? NodeSize<T>::POSTING : 0);
+				break;
+			}
+			const bool more = n == 0 || !(key < leafKey(leaf, n - 1));
+			const PageId sibPageNo = leaf->rightSibPageNo;
+			if (!more || sibPageNo == (PageId)-1)
+			{
+				const bool valid = latches.get(pageNo).validate(version);
+				bufMgr->unPinPage(file, pageNo, false);
+				found = false;
+				return valid;
+			}
+			Page *sibPage;
+			bufMgr->readPage(file, sibPageNo, sibPage);
+			const std::uint64_t sibVersion = latches.get(sibPageNo).readLock();
+			const bool valid = latches.get(pageNo).validate(version);
+			bufMgr->unPinPage(file, pageNo, false);
+			if (!valid || !advancePath<T>(path, sibPageNo))
+			{
+				bufMgr->unPinPage(file, sibPageNo, false);
+				return false;
+			}
+			pageNo = sibPageNo;
+			page = sibPage;
+			version = sibVersion;
+		}
+
+		VersionLatch &leafLatch = latches.get(pageNo);
+		if (!leafLatch.upgrade(version))
+		{
+			bufMgr->unPinPage(file, pageNo, false);
+			return false;
+		}
+		if (remaining >= SPACE / 2)
+		{
+			// Only the entry counts of the ancestors change
+			if (!joinAncestorCounters(path, path.depth))
+			{
+				leafLatch.unlockUnchanged();
+				bufMgr->unPinPage(file, pageNo, false);
+				return false;
+			}
+			found = true;
+			preserveNode(pageNo);
+			leafRemove(leaf, pos);
+			addToCounts<T>(path, -1);
+			leaveAncestorCounters(path, path.depth);
+			leafLatch.unlock();
+			bufMgr->unPinPage(file, pageNo, true);
+			return true;
+		}
+
+		// The leaf underflows. Latch, bottom-up, the parent of each node that may underflow and the sibling it
+		// rebalances with, up to the first parent that cannot underflow, and the root pointer if the root may go.
+		// Siblings are off the path, so they are latched at whatever version they are at, and only read once latched.
+		PageId sibling[MAX_HEIGHT + 1];
+		for (int d = 0; d <= path.depth; d++)
+		{
+			sibling[d] = -1;
+		}
+		// Leaf after the two leaves if they merge, whose left sibling changes
+		PageId farPageNo = -1;
+		int top = path.depth;
+		bool rootLocked = false;
+		bool latched = true;
+		for (int d = path.depth; d > 0; d--)
+		{
+			// The node at depth d may underflow; its parent is at depth d - 1
+			if (!latches.get(path.pageNo[d - 1]).upgrade(path.version[d - 1]))
+			{
+				latched = false;
+				break;
+			}
+			top = d - 1;
+			Page *parentPage;
+			bufMgr->readPage(file, path.pageNo[d - 1], parentPage);
+			NonLeafNode<T> *parent = (NonLeafNode<T> *)parentPage;
+			const int np = keyCount(parent, NONLEAF);
+			const int index = path.index[d - 1];
+			const PageId sibPageNo = np == 0 ? (PageId)-1 : parent->pageNoArray[index < np ? index + 1 : index - 1];
+			// The root only goes when it loses its last key and its child is not a leaf
+			const bool parentMayUnderflow = d == 1 ? np == 1 && parent->header.level != 1 : np - 1 < NONLEAF / 2;
+			bufMgr->unPinPage(file, path.pageNo[d - 1], false);
+			if (sibPageNo == (PageId)-1)
+			{
+				// A root above a single leaf, which has nothing to rebalance with
+				break;
+			}
+			if (!latches.get(sibPageNo).tryLock())
+			{
+				latched = false;
+				break;
+			}
+			sibling[d] = sibPageNo;
+			if (d == path.depth)
+			{
+				Page *sibPage;
+				bufMgr->readPage(file, sibPageNo, sibPage);
+				LeafNode<T> *sib = (LeafNode<T> *)sibPage;
+				const bool merge = remaining + leafBytes(sib) <= SPACE;
+				const PageId far = index < np ? sib->rightSibPageNo : leaf->rightSibPageNo;
+				bufMgr->unPinPage(file, sibPageNo, false);
+				if (merge)
+				{
+					if (!latchRightSibling(far))
+					{
+						latched = false;
+						break;
+					}
+					farPageNo = far;
+				}
+			}
+			if (!parentMayUnderflow)
+			{
+				break;
+			}
+			if (d == 1)
+			{
+				latched = rootLocked = rootLatch.upgrade(path.rootVersion);
+			}
+		}
+		// The ancestors above those the rebalancing reaches only have their entry counts change
+		if (latched && !joinAncestorCounters(path, top))
+		{
+			latched = false;
+		}
+		if (!latched)
+		{
+			for (int d = top; d < path.depth; d++)
+			{
+				latches.get(path.pageNo[d]).unlockUnchanged();
+			}
+			for (int d = 0; d <= path.depth; d++)
+			{
+				if (sibling[d] != (PageId)-1)
+				{
+					latches.get(sibling[d]).unlockUnchanged();
+				}
+			}
+			if (farPageNo != (PageId)-1)
+			{
+				latches.get(farPageNo).unlockUnchanged();
+			}
+			leafLatch.unlockUnchanged();
+			bufMgr->unPinPage(file, pageNo, false);
+			return false;
+		}
+
+		// Delete and rebalance bottom-up, as far as nodes underflow. Rebalancing works out the entry counts of
+		// the nodes it changes from those of their children, so those are brought up to date first.
+		found = true;
+		preserveNode(pageNo);
+		for (int d = 0; d <= path.depth; d++)
+		{
+			if (sibling[d] != (PageId)-1)
+			{
+				preserveNode(sibling[d]);
+			}
+		}
+		if (farPageNo != (PageId)-1)
+		{
+			preserveNode(farPageNo);
+		}
+		preservePath(path, top);
+		leafRemove(leaf, pos);
+		addToCounts<T>(path, -1);
+		Page *nodePage = page;
+		PageId nodePageNo = pageNo;
+		for (int d = path.depth; d > 0 && sibling[d] != (PageId)-1; d--)
+		{
+			const PageId parentPageNo = path.pageNo[d - 1];
+			Page *parentPage;
+			bufMgr->readPage(file, parentPageNo, parentPage);
+			NonLeafNode<T> *parent = (NonLeafNode<T> *)parentPage;
+			const int np = keyCount(parent, NONLEAF);
+			const int index = path.index[d - 1];
+			Page *sibPage;
+			bufMgr->readPage(file, sibling[d], sibPage);
+			// Pair the node with its right sibling, or with its left one if it is the last child
+			const bool nodeIsLeft = index < np;
+			Page *leftPage = nodeIsLeft ? nodePage : sibPage;
+			Page *rightPage = nodeIsLeft ? sibPage : nodePage;
+			const PageId leftPageNo = nodeIsLeft ? nodePageNo : sibling[d];
+			const PageId rightPageNo = nodeIsLeft ? sibling[d] : nodePageNo;
+			const int sepIndex = nodeIsLeft ? index : index - 1;
+			const bool merged = d == path.depth
+									? rebalanceLeaves(parent, sepIndex, (LeafNode<T> *)leftPage, rightPage)
+									: rebalanceNonLeaves(parent, sepIndex, (NonLeafNode<T> *)leftPage, rightPage);
+			// A merge frees the right node
+			bufMgr->unPinPage(file, leftPageNo, true);
+			if (!merged)
+			{
+				bufMgr->unPinPage(file, rightPageNo, true);
+			}
+			nodePage = (Page *)parent;
+			nodePageNo = parentPageNo;
+			if (!merged)
+			{
+				break;
+			}
+			if (d == 1)
+			{
+				if (np == 1 && parent->header.level != 1)
+				{
+					// The root lost its last key, so its one child becomes the root
+					rootPageNum = parent->pageNoArray[0];
+					Page *metaPage;
+					bufMgr->readPage(file, headerPageNum, metaPage);
+					IndexMetaInfo *meta = (IndexMetaInfo *)metaPage;
+					meta->rootPageNo = rootPageNum;
+					bufMgr->unPinPage(file, headerPageNum, true);
+					freeNode<T>(parentPageNo, nodePage);
+					nodePage = NULL;
+					dropHotNodes(false);
+				}
+				break;
+			}
+			if (np - 1 >= NONLEAF / 2)
+			{
+				break;
+			}
+		}
+		if (nodePage != NULL)
+		{
+			bufMgr->unPinPage(file, nodePageNo, true);
+		}
+
+		leafLatch.unlock();
+		for (int d = 0; d <= path.depth; d++)
+		{
+			if (sibling[d] != (PageId)-1)
+			{
+				latches.get(sibling[d]).unlock();
+			}
+		}
+		if (farPageNo != (PageId)-1)
+		{
+			latches.get(farPageNo).unlock();
+		}
+		leaveAncestorCounters(path, top);
+		for (int d = top; d < path.depth; d++)
+		{
+			latches.get(path.pageNo[d]).unlock();
+		}
+		if (rootLocked)
+		{
+			rootLatch.unlock();
+		}
+		return true;
+	}
+
+	template <class T>
+	bool BTreeIndex::advancePath(DescentPath &path, const PageId leafPageNo)
+	{
+		// Up to the lowest node where the path does not take the last child, and one child right there
+		int d = path.depth - 1;
+		for (; d >= 0; d--)
+		{
+			Page *nodePage;
+			bufMgr->readPage(file, path.pageNo[d], nodePage);
+			NonLeafNode<T> *node = (NonLeafNode<T> *)nodePage;
+			const bool last = path.index[d] >= keyCount(node, NodeSize<T>::NONLEAF);
+			const bool valid = latches.get(path.pageNo[d]).validate(path.version[d]);
+			bufMgr->unPinPage(file, path.pageNo[d], false);
+			if (!valid)
+			{
+				return false;
+			}
+			if (!last)
+			{
+				break;
+			}
+		}
+		if (d < 0)
+		{
+			return false;
+		}
+		path.index[d]++;
+		// Then down the first children
+		for (; d < path.depth; d++)
+		{
+			Page *nodePage;
+			bufMgr->readPage(file, path.pageNo[d], nodePage);
+			NonLeafNode<T> *node = (NonLeafNode<T> *)nodePage;
+			const PageId child = node->pageNoArray[path.index[d]];
+			const bool leaf = d + 1 == path.depth;
+			const std::uint64_t childVersion = leaf ? 0 : latches.get(child).readLock();
+			const bool valid = latches.get(path.pageNo[d]).validate(path.version[d]);
+			bufMgr->unPinPage(file, path.pageNo[d], false);
+			if (!valid)
+			{
+				return false;
+			}
+			if (leaf)
+			{
+				return child == leafPageNo;
+			}
+			path.pageNo[d + 1] = child;
+			path.version[d + 1] = childVersion;
+			path.index[d + 1] = 0;
+		}
+		return false;
+	}
+
+	bool BTreeIndex::joinAncestorCounters(const DescentPath &path, const int below)
+	{
+		for (int d = below - 1; d >= 0; d--)
+		{
+			if (!latches.get(path.pageNo[d]).joinCounters(path.version[d]))
+			{
+				for (int i = d + 1; i < below; i++)
+				{
+					latches.get(path.pageNo[i]).leaveCounters();
+				}
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void BTreeIndex::leaveAncestorCounters(const DescentPath &path, const int below)
+	{
+		for (int d = 0; d < below; d++)
+		{
+			latches.get(path.pageNo[d]).leaveCounters();
+		}
+	}
+
+	template <class T>
+	void BTreeIndex::addToCounts(const DescentPath &path, const int delta)
+	{
+		for (int d = 0; d < path.depth; d++)
+		{
+			Page *nodePage;
+			bufMgr->readPage(file, path.pageNo[d], nodePage);
+			NonLeafNode<T> *node = (NonLeafNode<T> *)nodePage;
+			__atomic_fetch_add(&node->countArray[path.index[d]], delta, __ATOMIC_RELAXED);
+			bufMgr->unPinPage(file, path.pageNo[d], true);
+		}
+	}
+
+	template <class T>
+	bool BTreeIndex::rebalanceLeaves(NonLeafNode<T> *parent, const int sepIndex, LeafNode<T> *left, Page *rightPage)
+	{
+		LeafNode<T> *right = (LeafNode<T> *)rightPage;
+		const bool merge = leafBytes(left) + leafBytes(right) <= NodeSize<T>::LEAF_SPACE;
+		// Lay out the entries of both leaves in order. The leaves hold less than two leaves' worth, as one underflows.
+		T keys[2 * NodeSize<T>::LEAF_ENTRIES];
+		RecordId rids[2 * NodeSize<T>::LEAF_ENTRIES];
+		char payloads[2 * NodeSize<T>::LEAF_SPACE];
+		const int nl = unpackLeaf(left, keys, rids, payloads);
+		const int nr = unpackLeaf(right, keys + nl, rids + nl, payloads + nl * payloadSize);
+		if (merge)
+		{
+			// The entries of the right leaf follow those of the left one, which takes its place in the chain
+			packLeaf(left, keys, rids, payloads, nl + nr);
+			parent->countArray[sepIndex] = nl + nr;
+			left->rightSibPageNo = right->rightSibPageNo;
+			setLeftSibling<T>(left->rightSibPageNo, parent->pageNoArray[sepIndex]);
+			const PageId rightPageNo = parent->pageNoArray[sepIndex + 1];
+			removeSeparator(parent, sepIndex);
+			freeNode<T>(rightPageNo, rightPage);
+			return true;
+		}
+
+		// Even the bytes of the leaves out. The first key of the right leaf becomes the separator.
+		const int leftCount = splitPoint(keys, nl + nr);
+		packLeaf(left, keys, rids, payloads, leftCount);
+		packLeaf(right, keys + leftCount, rids + leftCount, payloads + leftCount * payloadSize, nl + nr - leftCount);
+		parent->keyArray[sepIndex] = keys[leftCount];
+		setPrefix(parent, sepIndex);
+		parent->countArray[sepIndex] = leftCount;
+		parent->countArray[sepIndex + 1] = nl + nr - leftCount;
+		return false;
+	}
+
+	template <class T>
+	bool BTreeIndex::rebalanceNonLeaves(NonLeafNode<T> *parent, const int sepIndex, NonLeafNode<T> *left, Page *rightPage)
+	{
+		const int NONLEAF = NodeSize<T>::NONLEAF;
+		NonLeafNode<T> *right = (NonLeafNode<T> *)rightPage;
+		const int nl = keyCount(left, NONLEAF);
+		const int nr = keyCount(right, NONLEAF);
+		if (nl + 1 + nr <= NONLEAF)
+		{
+			// The separator comes down between the keys of the two nodes
+			left->keyArray[nl] = parent->keyArray[sepIndex];
+			memcpy(&left->keyArray[nl + 1], right->keyArray, nr * sizeof(T));
+			memcpy(&left->pageNoArray[nl + 1], right->pageNoArray, (nr + 1) * sizeof(PageId));
+			memcpy(&left->countArray[nl + 1], right->countArray, (nr + 1) * sizeof(std::uint32_t));
+			left->header.keyCount = nl + 1 + nr;
+			setPrefixes(left, nl);
+			parent->countArray[sepIndex] += parent->countArray[sepIndex + 1];
+			const PageId rightPageNo = parent->pageNoArray[sepIndex + 1];
+			removeSeparator(parent, sepIndex);
+			freeNode<T>(rightPageNo, rightPage);
+			return true;
+		}
+
+		// Lay out the keys of both nodes, with the separator between them, and their children in order.
+		// The middle key goes up as the new separator.
+		T keys[2 * NodeSize<T>::NONLEAF + 1];
+		PageId pages[2 * NodeSize<T>::NONLEAF + 2];
+		const int total = nl + 1 + nr;
+		memcpy(keys, left->keyArray, nl * sizeof(T));
+		keys[nl] = parent->keyArray[sepIndex];
+		memcpy(keys + nl + 1, right->keyArray, nr * sizeof(T));
+		memcpy(pages, left->pageNoArray, (nl + 1) * sizeof(PageId));
+		memcpy(pages + nl + 1, right->pageNoArray, (nr + 1) * sizeof(PageId));
+		std::uint32_t counts[2 * NodeSize<T>::NONLEAF + 2];
+		memcpy(counts, left->countArray, (nl + 1) * sizeof(std::uint32_t));
+		memcpy(counts + nl + 1, right->countArray, (nr + 1) * sizeof(std::uint32_t));
+		const int half = total / 2;
+		left->header.keyCount = half;
+		right->header.keyCount = total - half - 1;
+		memcpy(left->keyArray, keys, half * sizeof(T));
+		memcpy(left->pageNoArray, pages, (half + 1) * sizeof(PageId));
+		memcpy(right->keyArray, keys + half + 1, (total - half - 1) * sizeof(T));
+		memcpy(right->pageNoArray, pages + half + 1, (total - half) * sizeof(PageId));
+		memcpy(left->countArray, counts, (half + 1) * sizeof(std::uint32_t));
+		memcpy(right->countArray, counts + half + 1, (total - half) * sizeof(std::uint32_t));
+		parent->keyArray[sepIndex] = keys[half];
+		setPrefixes(left, 0);
+		setPrefixes(right, 0);
+		setPrefix(parent, sepIndex);
+		parent->countArray[sepIndex] = subtreeCount(left);
+		parent->countArray[sepIndex + 1] = subtreeCount(right);
+		return false;
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::lookup
+	// -----------------------------------------------------------------------------
+
+	size_t BTreeIndex::lookup(const void *key, std::vector<RecordId> &out)
+	{
+		return (this->*lookupFn)(key, &out);
+	}
+
+	bool BTreeIndex::contains(const void *key)
+	{
+		return (this->*lookupFn)(key, NULL) > 0;
+	}
+
+	template <class T>
+	size_t BTreeIndex::lookupTyped(const void *key, std::vector<RecordId> *out)
+	{
+		const T value = KeyTraits<T>::get(key);
+		const size_t start = out == NULL ? 0 : out->size();
+		std::vector<RecordId> held;
+		while (true)
+		{
+			// The write buffer is searched before the tree, so that a flush in between shows in writeBufferFlushes
+			const bool readBuffer = bufferedInserts > 0;
+			std::uint64_t flushes = 0;
+			size_t heldCount = 0;
+			if (readBuffer)
+			{
+				held.clear();
+				heldCount = readWriteBuffer(value, true, value, true, out == NULL ? NULL : &held, flushes);
+				if (heldCount > 0 && out == NULL)
+				{
+					return heldCount;
+				}
+			}
+			size_t count;
+			while (!tryLookup(value, out, count))
+			{
+			}
+			if (!readBuffer || writeBufferFlushes == flushes)
+			{
+				if (out != NULL)
+				{
+					out->insert(out->end(), held.begin(), held.end());
+				}
+				return count + heldCount;
+			}
+			if (out != NULL)
+			{
+				out->resize(start);
+			}
+		}
+	}
+
+	template <class T>
+	bool BTreeIndex::tryLookup(const T &key, std::vector<RecordId> *out, size_t &count)
+	{
+		const size_t start = out == NULL ? 0 : out->size();
+		DescentPath path;
+		PageId pageNo;
+		Page *page;
+		std::uint64_t version;
+		if (!descend(key, path, pageNo, page, version))
+		{
+			return false;
+		}
+		count = 0;
+		while (true)
+		{
+			LeafNode<T> *leaf = (LeafNode<T> *)page;
+			const int n = keyCount(leaf, leafOccupancy);
+			// The posting list of key
+			int first, end;
+			leafRange(leaf, key, first, end);
+			if (out == NULL)
+			{
+				end = std::min(end, first + 1);
+			}
+			else
+			{
+				for (int i = first; i < end; i++)
+				{
+					out->push_back(leafRid(leaf, i));
+				}
+			}
+			count += end - first;
+			// A key equal to a separator is looked for left of it, so even a leaf without it can end on the way to it
+			const PageId sibPageNo = end == n && (out != NULL || count == 0) ? leaf->rightSibPageNo : (PageId)-1;
+			if (sibPageNo == (PageId)-1)
+			{
+				const bool valid = latches.get(pageNo).validate(version);
+				bufMgr->unPinPage(file, pageNo, false);
+				if (!valid && out != NULL)
+				{
+					out->resize(start);
+				}
+				return valid;
+			}
+			Page *sibPage;
+			bufMgr->readPage(file, sibPageNo, sibPage);
+			const std::uint64_t sibVersion = latches.get(sibPageNo).readLock();
+			const bool valid = latches.get(pageNo).validate(version);
+			bufMgr->unPinPage(file, pageNo, false);
+			if (!valid)
+			{
+				bufMgr->unPinPage(file, sibPageNo, false);
+				if (out != NULL)
+				{
+					out->resize(start);
+				}
+				return false;
+			}
+			pageNo = sibPageNo;
+			page = sibPage;
+			version = sibVersion;
+		}
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::countRange
+	// -----------------------------------------------------------------------------
+
+	size_t BTreeIndex::countRange(const void *lowVal, const Operator lowOp, const void *highVal, const Operator highOp)
+	{
+		if (lowOp != GT && lowOp != GTE)
+		{
+			throw BadOpcodesException();
+		}
+		if (highOp != LT && highOp != LTE)
+		{
+			throw BadOpcodesException();
+		}
+		return (this->*countRangeFn)(lowVal, lowOp, highVal, highOp);
+	}
+
+	size_t BTreeIndex::rank(const void *key)
+	{
+		applyWriteBuffer();
+		return (this->*countBelowFn)(key, false);
+	}
+
+	bool BTreeIndex::select(const size_t k, void *outKey, RecordId &outRid)
+	{
+		applyWriteBuffer();
+		return (this->*selectFn)(k, outKey, outRid);
+	}
+
+	template <class T>
+	size_t BTreeIndex::countRangeTyped(const void *lowVal, const Operator lowOp, const void *highVal, const Operator highOp)
+	{
+		const T low = KeyTraits<T>::get(lowVal);
+		const T high = KeyTraits<T>::get(highVal);
+		if (low > high)
+		{
+			throw BadScanrangeException();
+		}
+		while (true)
+		{
+			// The write buffer is searched before the tree, as lookups search it
+			const bool readBuffer = bufferedInserts > 0;
+			std::uint64_t flushes = 0;
+			const size_t held = readBuffer ? readWriteBuffer(low, lowOp == GTE, high, highOp == LTE, NULL, flushes) : 0;
+			// Entries up to the high bound, less those below the low bound
+			size_t upTo, below;
+			while (!tryCountBelow(high, highOp == LTE, upTo))
+			{
+			}
+			while (!tryCountBelow(low, lowOp == GT, below))
+			{
+			}
+			if (!readBuffer || writeBufferFlushes == flushes)
+			{
+				// Deletes between the two descents can leave fewer entries up to the high bound than below the low one
+				return (upTo > below ? upTo - below : 0) + held;
+			}
+		}
+	}
+
+	template <class T>
+	size_t BTreeIndex::countBelowTyped(const void *key, const bool inclusive)
+	{
+		const T value = KeyTraits<T>::get(key);
+		size_t count;
+		while (!tryCountBelow(value, inclusive, count))
+		{
+		}
+		return count;
+	}
+
+	template <class T>
+	bool BTreeIndex::tryCountBelow(const T &key, const bool inclusive, size_t &count)
+	{
+		const std::uint64_t rootVersion = rootLatch.readLock();
+		PageId pageNo = rootPageNum;
+		Page *page;
+		std::uint64_t version;
+		bool hot = pinNode(pageNo, page, version);
+		if (!rootLatch.validate(rootVersion))
+		{
+			unpinNode(pageNo, hot);
+			return false;
+		}
+		hot = hot || keepHot(pageNo, page, 0);
+		count = 0;
+		bool aboveLeaves = false;
+		for (int depth = 1; !aboveLeaves; depth++)
+		{
+			NonLeafNode<T> *node = (NonLeafNode<T> *)page;
+			const int n = keyCount(node, NodeSize<T>::NONLEAF);
+			// Children left of the one taken hold only keys below key, or up to it if inclusive, and those right of it none
+			const int index = separatorBound(searchKernel(), node, n, key, inclusive);
+			size_t left = 0;
+			for (int i = 0; i < index; i++)
+			{
+				left += __atomic_load_n(&node->countArray[i], __ATOMIC_RELAXED);
+			}
+			const PageId child = node->pageNoArray[index];
+			aboveLeaves = node->header.level == 1;
+			if (!latches.get(pageNo).validate(version))
+			{
+				unpinNode(pageNo, hot);
+				return false;
+			}
+			Page *childPage;
+			std::uint64_t childVersion;
+			const bool childHot = pinNode(child, childPage, childVersion);
+			const bool valid = latches.get(pageNo).validate(version);
+			unpinNode(pageNo, hot);
+			if (!valid)
+			{
+				unpinNode(child, childHot);
+				return false;
+			}
+			count += left;
+			pageNo = child;
+			page = childPage;
+			version = childVersion;
+			hot = childHot || (!aboveLeaves && keepHot(child, childPage, depth));
+		}
+		LeafNode<T> *leaf = (LeafNode<T> *)page;
+		count += leafBound(leaf, key, inclusive);
+		const bool valid = latches.get(pageNo).validate(version);
+		bufMgr->unPinPage(file, pageNo, false);
+		return valid;
+	}
+
+	template <class T>
+	bool BTreeIndex::selectTyped(const size_t k, void *outKey, RecordId &outRid)
+	{
+		T key;
+		RecordId rid;
+		bool found;
+		while (!trySelect(k, key, rid, found))
+		{
+		}
+		if (found)
+		{
+			memcpy(outKey, &key, sizeof(T));
+			outRid = rid;
+		}
+		return found;
+	}
+
+	template <class T>
+	bool BTreeIndex::trySelect(const size_t k, T &outKey, RecordId &outRid, bool &found)
+	{
+		const std::uint64_t rootVersion = rootLatch.readLock();
+		PageId pageNo = rootPageNum;
+		Page *page;
+		std::uint64_t version;
+		bool hot = pinNode(pageNo, page, version);
+		if (!rootLatch.validate(rootVersion))
+		{
+			unpinNode(pageNo, hot);
+			return false;
+		}
+		hot = hot || keepHot(pageNo, page, 0);
+		// Position among the entries of the subtree of the node
+		size_t position = k;
+		bool aboveLeaves = false;
+		for (int depth = 1; !aboveLeaves; depth++)
+		{
+			const bool atRoot = depth == 1;
+			NonLeafNode<T> *node = (NonLeafNode<T> *)page;
+			const int n = keyCount(node, NodeSize<T>::NONLEAF);
+			int index = 0;
+			for (; index <= n; index++)
+			{
+				const std::uint32_t count = __atomic_load_n(&node->countArray[index], __ATOMIC_RELAXED);
+				if (position < count)
+				{
+					break;
+				}
+				position -= count;
+			}
+			aboveLeaves = node->header.level == 1;
+			const PageId child = index <= n ? node->pageNoArray[index] : (PageId)-1;
+			if (!latches.get(pageNo).validate(version) || child == (PageId)-1)
+			{
+				// Past the last entry. Below the root, that can only come from a count that was being changed.
+				const bool valid = latches.get(pageNo).validate(version);
+				unpinNode(pageNo, hot);
+				found = false;
+				return valid && atRoot && child == (PageId)-1;
+			}
+			Page *childPage;
+			std::uint64_t childVersion;
+			const bool childHot = pinNode(child, childPage, childVersion);
+			const bool valid = latches.get(pageNo).validate(version);
+			unpinNode(pageNo, hot);
+			if (!valid)
+			{
+				unpinNode(child, childHot);
+				return false;
+			}
+			pageNo = child;
+			page = childPage;
+			version = childVersion;
+			hot = childHot || (!aboveLeaves && keepHot(child, childPage, depth));
+		}
+		LeafNode<T> *leaf = (LeafNode<T> *)page;
+		const bool inLeaf = position < (size_t)keyCount(leaf, leafOccupancy);
+		if (inLeaf)
+		{
+			outKey = leafKey(leaf, (int)position);
+			outRid = leafRid(leaf, (int)position);
+		}
+		const bool valid = latches.get(pageNo).validate(version);
+		bufMgr->unPinPage(file, pageNo, false);
+		found = true;
+		return valid && inLeaf;
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::startScan
+	// -----------------------------------------------------------------------------
+	/**
+	 * Begin a filtered scan of the index.  For instance, if the method is called
+	 * using ("a",GT,"d",LTE) then we should seek all entries with a value
+	 * greater than "a" and less than or equal to "d".
+	 * If another scan is already executing, that needs to be ended here.
+	 * Set up all the variables for scan. Start from root to find out the leaf page that contains the first RecordID
+	 * that satisfies the scan parameters. Keep that page pinned in the buffer pool.
+	 * @param lowValParm	Low value of range, pointer to integer / double / char string
+	 * @param lowOpParm		Low operator (GT/GTE)
+	 * @param highValParm	High value of range, pointer to integer / double / char string
+	 * @param highOpParm	High operator (LT/LTE)
+	 * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
+	 * @throws  BadScanrangeException If lowVal > highval
+	 * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that satisfies the scan criteria.
+	 **/
+	void BTreeIndex::startScan(const void *lowValParm,
+							   const Operator lowOpParm,
+							   const void *highValParm,
+							   const Operator highOpParm)
+	{
+		if (scan.isOpen())
+		{
+			endScan();
+		}
+		scan = openScan(lowValParm, lowOpParm, highValParm, highOpParm);
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::openScan
+	// -----------------------------------------------------------------------------
+
+	ScanCursor BTreeIndex::openScan(const void *lowValParm,
+									const Operator lowOpParm,
+									const void *highValParm,
+									const Operator highOpParm,
+									const ScanOptions &options)
+	{
+		if (lowOpParm != GT && lowOpParm != GTE)
+		{
+			throw BadOpcodesException();
+		}
+		if (highOpParm != LT && highOpParm != LTE)
+		{
+			throw BadOpcodesException();
+		}
+		ScanCursor cursor;
+		cursor.lowOp = lowOpParm;
+		cursor.highOp = highOpParm;
+		cursor.maxReadahead = std::max(0, std::min(options.maxReadahead, MAX_READAHEAD));
+		cursor.readahead = std::min(1, cursor.maxReadahead);
+		// A snapshot scan reads its leaves into a buffer of its own
+		cursor.snapshotLeaf.resize(options.snapshot ? Page::SIZE : 0);
+		applyWriteBuffer();
+		(this->*openScanFn)(cursor, lowValParm, highValParm);
+		return cursor;
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::openReverseScan
+	// -----------------------------------------------------------------------------
+
+	ScanCursor BTreeIndex::openReverseScan(const void *lowValParm,
+										   const Operator lowOpParm,
+										   const void *highValParm,
+										   const Operator highOpParm,
+										   const ScanOptions &options)
+	{
+		if (lowOpParm != GT && lowOpParm != GTE)
+		{
+			throw BadOpcodesException();
+		}
+		if (highOpParm != LT && highOpParm != LTE)
+		{
+			throw BadOpcodesException();
+		}
+		ScanCursor cursor;
+		cursor.reverse = true;
+		cursor.lowOp = lowOpParm;
+		cursor.highOp = highOpParm;
+		cursor.maxReadahead = std::max(0, std::min(options.maxReadahead, MAX_READAHEAD));
+		cursor.readahead = std::min(1, cursor.maxReadahead);
+		cursor.snapshotLeaf.resize(options.snapshot ? Page::SIZE : 0);
+		applyWriteBuffer();
+		(this->*openScanFn)(cursor, lowValParm, highValParm);
+		return cursor;
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::compositeKey
+	// -----------------------------------------------------------------------------
+
+	CompositeKey BTreeIndex::compositeKey(const void *const *values, const int count, const bool high) const
+	{
+		if (attributeType != COMPOSITE || count < 0 || count > (int)keyColumns.size())
+		{
+			throw BadIndexInfoException(keyColumnsMismatch);
+		}
+		CompositeKey key;
+		int size = 0;
+		for (int i = 0; i < count; i++)
+		{
+			size += encodeKeyColumn(keyColumns[i].type, values[i], key.value + size);
+		}
+		// Every encoded key column is at least all zero bytes and at most all one bytes
+		memset(key.value + size, high ? 0xff : 0, COMPOSITESIZE - size);
+		return key;
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::openPrefixScan
+	// -----------------------------------------------------------------------------
+
+	ScanCursor BTreeIndex::openPrefixScan(const void *const *values, const int count, const ScanOptions &options)
+	{
+		const CompositeKey low = compositeKey(values, count);
+		const CompositeKey high = compositeKey(values, count, true);
+		return openScan(&low, GTE, &high, LTE, options);
+	}
+
+	template <class T>
+	void BTreeIndex::openScanTyped(ScanCursor &cursor, const void *lowValParm, const void *highValParm)
+	{
+		const T lowVal = cursor.lowVal<T>() = KeyTraits<T>::get(lowValParm);
+		const T highVal = cursor.highVal<T>() = KeyTraits<T>::get(highValParm);
+		if (lowVal > highVal)
+		{
+			throw BadScanrangeException();
+		}
+		if (!cursor.snapshotLeaf.empty())
+		{
+			openSnapshotScan<T>(cursor);
+			return;
+		}
+		// Counted before the descent, so that no leaf the cursor reaches is reused while it is open
+		openCursors++;
+		DescentPath path;
+		PageId leafPageNo;
+		Page *leaf;
+		std::uint64_t version;
+		// A reverse scan starts from the last leaf that can hold the high bound
+		while (!(cursor.reverse ? descend(highVal, path, leafPageNo, leaf, version, true)
+								: descend(lowVal, path, leafPageNo, leaf, version)))
+		{
+		}
+		// Remember where the leaf is in its parent, for readahead
+		cursor.parentPageNum = path.pageNo[path.depth - 1];
+		cursor.childIndex = path.index[path.depth - 1];
+		cursor.prefetchedUpTo = cursor.childIndex;
+		cursor.currentPageNum = leafPageNo;
+		cursor.currentPageData = leaf;
+		// The first entry is looked up from the low bound
+		cursor.leafVersion = version;
+		cursor.nextEntry = -1;
+		cursor.returnedAny = false;
+		cursor.returnedBehind = true;
+		cursor.lastRun.clear();
+		cursor.stats.leavesScanned++;
+		readAhead<T>(cursor);
+
+		// Find the first entry above the low bound, moving right if this leaf has none, or for a reverse
+		// scan the last one below the high bound, moving left
+		T key;
+		RecordId rid;
+		if (cursor.reverse ? peekEntryReverse(cursor, key, rid) && (cursor.lowOp == GTE ? key >= lowVal : key > lowVal)
+						   : peekEntry(cursor, key, rid) && (cursor.highOp == LTE ? key <= highVal : key < highVal))
+		{
+			cursor.index = this;
+			return;
+		}
+		bufMgr->unPinPage(file, cursor.currentPageNum, false);
+		openCursors--;
+		throw NoSuchKeyFoundException();
+	}
+
+	// -----------------------------------------------------------------------------
+	// Leaf traversal
+	// -----------------------------------------------------------------------------
+
+	template <class T>
+	bool BTreeIndex::peekEntry(ScanCursor &cursor, T &key, RecordId &rid, char *payload, int *postingStart, int *postingEnd)
+	{
+		// The cursor is about to move, and only the caller knows whether the entry found matches
+		cursor.postingStart = -1;
+		while (true)
+		{
+			LeafNode<T> *node = (LeafNode<T> *)cursor.currentPageData;
+			VersionLatch &latch = latches.get(cursor.currentPageNum);
+			const std::uint64_t version = latch.readLock();
+			int next = cursor.nextEntry;
+			if (version != cursor.leafVersion || next < 0)
+			{
+				next = scanPosition(cursor, node, version == cursor.leafVersion);
+				if (next < 0)
+				{
+					if (latch.validate(version))
+					{
+						relocate<T>(cursor);
+					}
+					continue;
+				}
+			}
+			const int n = keyCount(node, leafOccupancy);
+			if (next < n)
+			{
+				// A scan moves on from one list to the next
+				int start, end, group = cursor.postingGroup + 1;
+				leafPosting(node, next, key, start, end, &group);
+				rid = leafRid(node, next);
+				if (payload != NULL)
+				{
+					memcpy(payload, leafPayload(node, next), payloadSize);
+				}
+				if (!latch.validate(version))
+				{
+					continue;
+				}
+				cursor.nextEntry = next;
+				cursor.leafVersion = version;
+				cursor.postingGroup = group;
+				if (postingStart != NULL)
+				{
+					*postingStart = start;
+					*postingEnd = end;
+				}
+				return true;
+			}
+			const PageId sibPageNo = node->rightSibPageNo;
+			if (!latch.validate(version))
+			{
+				continue;
+			}
+			cursor.nextEntry = next;
+			cursor.leafVersion = version;
+			if (sibPageNo == (PageId)-1)
+			{
+				return false;
+			}
+			moveToLeaf<T>(cursor, sibPageNo, version);
+		}
+	}
+
+	template <class T>
+	int BTreeIndex::scanPosition(ScanCursor &cursor, LeafNode<T> *node, const bool unchanged)
+	{
+		// Deletes move the smallest entries of a leaf to its left sibling, or all of them when the leaf is
+		// freed. So once the leaf has changed, the position found in it only holds if entries the cursor has
+		// already passed are still in it.
+		if (!cursor.returnedAny)
+		{
+			const T &lowVal = cursor.lowVal<T>();
+			const int position = leafBound(node, lowVal, cursor.lowOp == GT);
+			return unchanged || position > 0 ? position : -1;
+		}
+		// Entries with the same key keep their order when inserts and deletes move them, so the
+		// scan carries on right after the last record id returned
+		int first, end;
+		leafRange(node, cursor.lastVal<T>(), first, end);
+		if (cursor.returnedBehind)
+		{
+			for (int i = first; i < end; i++)
+			{
+				if (leafRid(node, i) == cursor.lastRid)
+				{
+					return i + 1;
+				}
+			}
+		}
+		// The last entry is in another leaf or was deleted, so carry on after the last duplicate already returned.
+		// Inserts put duplicates after those in the leftmost leaf of the key, which can be before ones returned
+		// from the next leaf, so from here on the last entry returned does not tell where the cursor is.
+		cursor.returnedBehind = false;
+		std::sort(cursor.lastRun.begin(), cursor.lastRun.end(), ridLess);
+		for (int i = end - 1; i >= first; i--)
+		{
+			if (std::binary_search(cursor.lastRun.begin(), cursor.lastRun.end(), leafRid(node, i), ridLess))
+			{
+				return i + 1;
+			}
+		}
+		return unchanged ? first : -1;
+	}
+
+	template <class T>
+	bool BTreeIndex::peekEntryReverse(ScanCursor &cursor, T &key, RecordId &rid, char *payload, int *postingStart, int *postingEnd)
+	{
+		cursor.postingStart = -1;
+		while (true)
+		{
+			LeafNode<T> *node = (LeafNode<T> *)cursor.currentPageData;
+			VersionLatch &latch = latches.get(cursor.currentPageNum);
+			const std::uint64_t version = latch.readLock();
+			int next = cursor.nextEntry;
+			if (version != cursor.leafVersion || next < 0)
+			{
+				next = scanPositionReverse(cursor, node, version == cursor.leafVersion);
+				if (next < 0)
+				{
+					if (latch.validate(version))
+					{
+						relocate<T>(cursor);
+					}
+					continue;
+				}
+			}
+			if (next > 0)
+			{
+				int start, end, group = cursor.postingGroup - 1;
+				leafPosting(node, next - 1, key, start, end, &group);
+				rid = leafRid(node, next - 1);
+				if (payload != NULL)
+				{
+					memcpy(payload, leafPayload(node, next - 1), payloadSize);
+				}
+				if (!latch.validate(version))
+				{
+					continue;
+				}
+				cursor.nextEntry = next;
+				cursor.leafVersion = version;
+				cursor.postingGroup = group;
+				if (postingStart != NULL)
+				{
+					*postingStart = start;
+					*postingEnd = end;
+				}
+				return true;
+			}
+			const PageId sibPageNo = node->leftSibPageNo;
+			if (!latch.validate(version))
+			{
+				continue;
+			}
+			cursor.nextEntry = 0;
+			cursor.leafVersion = version;
+			if (sibPageNo == (PageId)-1)
+			{
+				return false;
+			}
+			moveToLeaf<T>(cursor, sibPageNo, version);
+		}
+	}
+
+	template <class T>
+	int BTreeIndex::scanPositionReverse(ScanCursor &cursor, LeafNode<T> *node, const bool unchanged)
+	{
+		// Deletes move the largest entries of a leaf to its right sibling. The position found in a leaf that has
+		// changed only holds if an entry the cursor has passed is still in it, as everything moved is after it.
+		const int n = keyCount(node, leafOccupancy);
+		if (!cursor.returnedAny)
+		{
+			const T &highVal = cursor.highVal<T>();
+			const int position = leafBound(node, highVal, cursor.highOp == LTE);
+			return unchanged || position < n ? position : -1;
+		}
+		// Larger keys have all been returned. Duplicates keep their order and new ones are inserted after them,
+		// so the duplicates of the last key still to come are those before the first one returned.
+		int first, end;
+		leafRange(node, cursor.lastVal<T>(), first, end);
+		std::sort(cursor.lastRun.begin(), cursor.lastRun.end(), ridLess);
+		int position = end;
+		for (int i = first; i < end; i++)
+		{
+			if (std::binary_search(cursor.lastRun.begin(), cursor.lastRun.end(), leafRid(node, i), ridLess))
+			{
+				position = i;
+				break;
+			}
+		}
+		return unchanged || position < n ? position : -1;
+	}
+
+	template <class T>
+	void BTreeIndex::relocate(ScanCursor &cursor)
+	{
+		DescentPath path;
+		PageId leafPageNo;
+		Page *leaf;
+		std::uint64_t version;
+		while (!(cursor.reverse
+					 ? descend(cursor.returnedAny ? cursor.lastVal<T>() : cursor.highVal<T>(), path, leafPageNo, leaf, version, true)
+					 : descend(cursor.returnedAny ? cursor.lastVal<T>() : cursor.lowVal<T>(), path, leafPageNo, leaf, version)))
+		{
+		}
+		bufMgr->unPinPage(file, cursor.currentPageNum, false);
+		cursor.currentPageNum = leafPageNo;
+		cursor.currentPageData = leaf;
+		cursor.leafVersion = version;
+		cursor.nextEntry = -1;
+		cursor.parentPageNum = path.pageNo[path.depth - 1];
+		cursor.childIndex = path.index[path.depth - 1];
+		cursor.prefetchedUpTo = cursor.childIndex;
+	}
+
+	template <class T>
+	bool BTreeIndex::moveToLeaf(ScanCursor &cursor, const PageId sibPageNo, const std::uint64_t version)
+	{
+		Page *sibPage;
+		const bool diskRead = bufMgr->readPage(file, sibPageNo, sibPage);
+		const std::uint64_t sibVersion = latches.get(sibPageNo).readLock();
+		// The sibling pointer was read at version; a split since may have put a new leaf in between
+		if (!latches.get(cursor.currentPageNum).validate(version))
+		{
+			bufMgr->unPinPage(file, sibPageNo, false);
+			return false;
+		}
+		bufMgr->unPinPage(file, cursor.currentPageNum, false);
+		cursor.currentPageNum = sibPageNo;
+		cursor.currentPageData = sibPage;
+		cursor.leafVersion = sibVersion;
+		// The entries returned were all in this leaf or before it while the sibling was at sibVersion, so none
+		// were in the sibling then. Otherwise the place is found from what was returned. A reverse scan always
+		// finds it from what was returned, as merges move entries already returned into the left sibling.
+		cursor.nextEntry = !cursor.reverse && cursor.returnedAny && cursor.returnedBehind ? 0 : -1;
+		cursor.stats.leavesScanned++;
+
+		if (cursor.parentPageNum != (PageId)-1)
+		{
+			cursor.childIndex += cursor.reverse ? -1 : 1;
+			if (cursor.childIndex < 0)
+			{
+				// The left sibling has another parent
+				cursor.parentPageNum = -1;
+			}
+		}
+		// Leaves read ahead before this one were passed by, or will not be reached
+		std::vector<PageId>::iterator ahead = std::find(cursor.prefetchedPages.begin(), cursor.prefetchedPages.end(), sibPageNo);
+		if (ahead != cursor.prefetchedPages.end())
+		{
+			cursor.prefetchedPages.erase(cursor.prefetchedPages.begin(), ahead + 1);
+			if (!diskRead)
+			{
+				cursor.stats.prefetchHits++;
+			}
+		}
+		cursor.readahead = std::min(2 * cursor.readahead, cursor.maxReadahead);
+		readAhead<T>(cursor);
+		return true;
+	}
+
+	// -----------------------------------------------------------------------------
+	// Leaf readahead
+	// -----------------------------------------------------------------------------
+
+	template <class T>
+	void BTreeIndex::readAhead(ScanCursor &cursor)
+	{
+		if (cursor.readahead == 0)
+		{
+			return;
+		}
+		const T &lowVal = cursor.lowVal<T>();
+		const T &highVal = cursor.highVal<T>();
+		PageId ahead[MAX_READAHEAD];
+		int numAhead = 0;
+		int upTo = cursor.prefetchedUpTo;
+		// The parent is read without latching it, so collect the leaves first and only use them if it was unchanged
+		for (int attempt = 0; attempt < 2; attempt++)
+		{
+			if (cursor.parentPageNum == (PageId)-1)
+			{
+				LeafNode<T> *leaf = (LeafNode<T> *)cursor.currentPageData;
+				const T first = leafKey(leaf, 0);
+				if (keyCount(leaf, leafOccupancy) == 0 ||
+					!findParent(first, cursor.currentPageNum, cursor.parentPageNum, cursor.childIndex))
+				{
+					cursor.parentPageNum = -1;
+					return;
+				}
+				cursor.prefetchedUpTo = cursor.childIndex;
+			}
+			Page *parentPage;
+			bufMgr->readPage(file, cursor.parentPageNum, parentPage);
+			NonLeafNode<T> *parent = (NonLeafNode<T> *)parentPage;
+			VersionLatch &latch = latches.get(cursor.parentPageNum);
+			const std::uint64_t version = latch.readLock();
+			const int n = keyCount(parent, NodeSize<T>::NONLEAF);
+			// Past the last child, or the leaf moved to another parent
+			bool valid = cursor.childIndex <= n && parent->pageNoArray[cursor.childIndex] == cursor.currentPageNum;
+			numAhead = 0;
+			if (cursor.reverse)
+			{
+				upTo = std::min(cursor.prefetchedUpTo, cursor.childIndex);
+				const int last = std::max(0, cursor.childIndex - cursor.readahead);
+				for (int i = upTo - 1; valid && i >= last; i--)
+				{
+					// Child i holds no key above the separator on its right, so nothing past the low bound is read
+					const T &separator = parent->keyArray[i];
+					if (cursor.lowOp == GTE ? separator < lowVal : separator <= lowVal)
+					{
+						break;
+					}
+					ahead[numAhead++] = parent->pageNoArray[i];
+					upTo = i;
+				}
+			}
+			else
+			{
+				upTo = std::max(cursor.prefetchedUpTo, cursor.childIndex);
+				const int last = std::min(n, cursor.childIndex + cursor.readahead);
+				for (int i = upTo + 1; valid && i <= last; i++)
+				{
+					// Child i holds no key below its separator, so nothing past the high bound is read
+					const T &separator = parent->keyArray[i - 1];
+					if (cursor.highOp == LTE ? separator > highVal : separator >= highVal)
+					{
+						break;
+					}
+					ahead[numAhead++] = parent->pageNoArray[i];
+					upTo = i;
+				}
+			}
+			valid = latch.validate(version) && valid;
+			bufMgr->unPinPage(file, cursor.parentPageNum, false);
+			if (valid)
+			{
+				break;
+			}
+			numAhead = 0;
+			cursor.parentPageNum = -1;
+		}
+		for (int i = 0; i < numAhead; i++)
+		{
+			if (bufMgr->prefetchPage(file, ahead[i]))
+			{
+				cursor.stats.leavesPrefetched++;
+				cursor.prefetchedPages.push_back(ahead[i]);
+			}
+		}
+		if (cursor.parentPageNum != (PageId)-1)
+		{
+			cursor.prefetchedUpTo = upTo;
+		}
+	}
+
+	template <class T>
+	bool BTreeIndex::findParent(const T &key, const PageId leafPageNo, PageId &parentPageNo, int &index)
+	{
+		DescentPath path;
+		PageId pageNo;
+		Page *leaf;
+		std::uint64_t leafVersion;
+		if (!descend(key, path, pageNo, leaf, leafVersion))
+		{
+			return false;
+		}
+		bufMgr->unPinPage(file, pageNo, false);
+
+		NonLeafNode<T> *node;
+		const PageId nodePageNo = path.pageNo[path.depth - 1];
+		Page *nodePage;
+		bufMgr->readPage(file, nodePageNo, nodePage);
+		node = (NonLeafNode<T> *)nodePage;
+		const std::uint64_t version = latches.get(nodePageNo).readLock();
+		const int n = keyCount(node, NodeSize<T>::NONLEAF);
+		int i = path.index[path.depth - 1];
+		// Duplicates of key can fill several leaves, so the leaf may be further right
+		while (i <= n && node->pageNoArray[i] != leafPageNo)
+		{
+			i++;
+		}
+		const bool valid = latches.get(nodePageNo).validate(version);
+		bufMgr->unPinPage(file, nodePageNo, false);
+		if (!valid || i > n)
+		{
+			return false;
+		}
+		parentPageNo = nodePageNo;
+		index = i;
+		return true;
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::scanNext
+	// -----------------------------------------------------------------------------
+
+	void BTreeIndex::scanNext(RecordId &outRid)
+	{
+		scan.scanNext(outRid);
+	}
+
+	void BTreeIndex::scanNext(RecordId &outRid, char *payload)
+	{
+		scan.scanNext(outRid, payload);
+	}
+
+	template <class T>
+	void BTreeIndex::scanNextTyped(ScanCursor &cursor, RecordId &outRid, char *payload)
+	{
+		if (cursor.snapshotEpoch != 0)
+		{
+			if (scanSnapshotBatch<T>(cursor, &outRid, payload, 1) == 0)
+			{
+				throw IndexScanCompletedException();
+			}
+			return;
+		}
+		T key;
+		RecordId rid;
+		// Copied out only once the entry is known to match
+		char entryPayload[MAX_PAYLOAD_SIZE];
+		bool found = false;
+		// The rest of the posting list of the last entry returned has its key, so while the leaf is unchanged
+		// its entries are returned without reading or checking their key
+		const int entry = cursor.reverse ? cursor.nextEntry - 1 : cursor.nextEntry;
+		if (cursor.postingStart >= 0 && entry >= cursor.postingStart && entry < cursor.postingEnd)
+		{
+			LeafNode<T> *node = (LeafNode<T> *)cursor.currentPageData;
+			VersionLatch &latch = latches.get(cursor.currentPageNum);
+			if (latch.readLock() == cursor.leafVersion)
+			{
+				rid = leafRid(node, entry);
+				memcpy(entryPayload, leafPayload(node, entry), payloadSize);
+				key = cursor.lastVal<T>();
+				found = latch.validate(cursor.leafVersion);
+			}
+		}
+		int postingStart = -1, postingEnd = -1;
+		// Entries are sorted and the scan started above the low bound, so only the high bound needs checking,
+		// or only the low bound for a reverse scan
+		if (!found &&
+			(cursor.reverse ? !peekEntryReverse(cursor, key, rid, entryPayload, &postingStart, &postingEnd) ||
+								  !(cursor.lowOp == GTE ? key >= cursor.lowVal<T>() : key > cursor.lowVal<T>())
+							: !peekEntry(cursor, key, rid, entryPayload, &postingStart, &postingEnd) ||
+								  !(cursor.highOp == LTE ? key <= cursor.highVal<T>() : key < cursor.highVal<T>())))
+		{
+			throw IndexScanCompletedException();
+		}
+		if (!found)
+		{
+			cursor.postingStart = postingStart;
+			cursor.postingEnd = postingEnd;
+		}
+		outRid = rid;
+		if (payload != NULL)
+		{
+			memcpy(payload, entryPayload, payloadSize);
+		}
+		cursor.nextEntry += cursor.reverse ? -1 : 1;
+		if (!cursor.returnedAny || cursor.lastVal<T>() != key)
+		{
+			// Entries with smaller keys are all before this one
+			cursor.lastRun.clear();
+			cursor.returnedBehind = true;
+		}
+		cursor.returnedAny = true;
+		cursor.lastVal<T>() = key;
+		cursor.lastRid = rid;
+		cursor.lastRun.push_back(rid);
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::scanNextBatch
+	// -----------------------------------------------------------------------------
+
+	size_t BTreeIndex::scanNextBatch(RecordId *out, size_t max)
+	{
+		return scan.scanNextBatch(out, max);
+	}
+
+	size_t BTreeIndex::scanNextBatch(RecordId *out, char *payloads, size_t max)
+	{
+		return scan.scanNextBatch(out, payloads, max);
+	}
+
+	template <class T>
+	size_t BTreeIndex::scanNextBatchTyped(ScanCursor &cursor, RecordId *out, char *payloads, size_t max)
+	{
+		if (cursor.snapshotEpoch != 0)
+		{
+			return scanSnapshotBatch<T>(cursor, out, payloads, max);
+		}
+		if (cursor.reverse)
+		{
+			return scanNextBatchReverse<T>(cursor, out, payloads, max);
+		}
+		const T &highVal = cursor.highVal<T>();
+		size_t count = 0;
+		T key;
+		RecordId rid;
+		while (count < max && peekEntry(cursor, key, rid))
+		{
+			LeafNode<T> *node = (LeafNode<T> *)cursor.currentPageData;
+			VersionLatch &latch = latches.get(cursor.currentPageNum);
+			const std::uint64_t version = cursor.leafVersion;
+			// Entries of this leaf up to the high bound all match, so find where they end once, from the posting lists
+			const int from = cursor.nextEntry;
+			const int end = std::max(from, leafBound(node, highVal, cursor.highOp == LTE));
+			const int take = (int)std::min((size_t)(end - from), max - count);
+			// Entries at the end of the batch with the same key as the last one, which are those of its posting list
+			int run = 0;
+			int postingStart = -1, postingEnd = -1;
+			if (take > 0)
+			{
+				for (int i = 0; i < take; i++)
+				{
+					out[count + i] = leafRid(node, from + i);
+				}
+				if (payloads != NULL)
+				{
+					for (int i = 0; i < take; i++)
+					{
+						memcpy(payloads + (count + i) * payloadSize, leafPayload(node, from + i), payloadSize);
+					}
+				}
+				leafPosting(node, from + take - 1, key, postingStart, postingEnd);
+				rid = out[count + take - 1];
+				run = from + take - std::max(from, postingStart);
+			}
+			if (!latch.validate(version))
+			{
+				// Copied while a writer changed the leaf; peekEntry finds the place again
+				continue;
+			}
+			if (take == 0)
+			{
+				// The high bound was reached
+				break;
+			}
+			if (run < take || !cursor.returnedAny || cursor.lastVal<T>() != key)
+			{
+				cursor.lastRun.clear();
+				cursor.returnedBehind = true;
+			}
+			cursor.lastRun.insert(cursor.lastRun.end(), out + count + take - run, out + count + take);
+			count += take;
+			cursor.nextEntry += take;
+			cursor.postingStart = postingStart;
+			cursor.postingEnd = postingEnd;
+			cursor.returnedAny = true;
+			cursor.lastVal<T>() = key;
+			cursor.lastRid = rid;
+		}
+		return count;
+	}
+
+	template <class T>
+	size_t BTreeIndex::scanNextBatchReverse(ScanCursor &cursor, RecordId *out, char *payloads, size_t max)
+	{
+		const T &lowVal = cursor.lowVal<T>();
+		size_t count = 0;
+		T key;
+		RecordId rid;
+		while (count < max && peekEntryReverse(cursor, key, rid))
+		{
+			LeafNode<T> *node = (LeafNode<T> *)cursor.currentPageData;
+			VersionLatch &latch = latches.get(cursor.currentPageNum);
+			const std::uint64_t version = cursor.leafVersion;
+			// Entries of this leaf down to the low bound all match, so find where they end once
+			const int from = cursor.nextEntry;
+			const int end = std::min(from, leafBound(node, lowVal, cursor.lowOp == GT));
+			const int take = (int)std::min((size_t)(from - end), max - count);
+			int run = 0;
+			int postingStart = -1, postingEnd = -1;
+			for (int i = 0; i < take; i++)
+			{
+				out[count + i] = leafRid(node, from - 1 - i);
+				if (payloads != NULL)
+				{
+					memcpy(payloads + (count + i) * payloadSize, leafPayload(node, from - 1 - i), payloadSize);
+				}
+			}
+			if (take > 0)
+			{
+				leafPosting(node, from - take, key, postingStart, postingEnd);
+				rid = out[count + take - 1];
+				run = std::min(from, postingEnd) - (from - take);
+			}
+			if (!latch.validate(version))
+			{
+				continue;
+			}
+			if (take == 0)
+			{
+				// The low bound was reached
+				break;
+			}
+			if (run < take || !cursor.returnedAny || cursor.lastVal<T>() != key)
+			{
+				cursor.lastRun.clear();
+			}
+			cursor.lastRun.insert(cursor.lastRun.end(), out + count + take - run, out + count + take);
+			count += take;
+			cursor.nextEntry -= take;
+			cursor.postingStart = postingStart;
+			cursor.postingEnd = postingEnd;
+			cursor.returnedAny = true;
+			cursor.lastVal<T>() = key;
+			cursor.lastRid = rid;
+		}
+		return count;
+	}
+
+	// -----------------------------------------------------------------------------
+	// Snapshot scans
+	// -----------------------------------------------------------------------------
+
+	void BTreeIndex::beginWrite()
+	{
+		while (true)
+		{
+			while (takingSnapshot)
+			{
+				std::this_thread::yield();
+			}
+			activeWriters++;
+			// Counted in before the snapshot looks, or held back until it is taken
+			if (!takingSnapshot)
+			{
+				return;
+			}
+			activeWriters--;
+		}
+	}
+
+	std::uint64_t BTreeIndex::openSnapshot(PageId &rootPageNo)
+	{
+		while (takingSnapshot.exchange(true))
+		{
+			std::this_thread::yield();
+		}
+		// An insert or delete under way may have changed some of its nodes without copying them
+		while (activeWriters > 0)
+		{
+			std::this_thread::yield();
+		}
+		std::uint64_t epoch;
+		{
+			std::lock_guard<std::mutex> guard(snapshotMutex);
+			epoch = ++snapshotClock;
+			snapshotEpochs.insert(epoch);
+			newestSnapshot = epoch;
+		}
+		rootPageNo = rootPageNum;
+		takingSnapshot = false;
+		return epoch;
+	}
+
+	void BTreeIndex::closeSnapshot(const std::uint64_t epoch)
+	{
+		std::lock_guard<std::mutex> guard(snapshotMutex);
+		snapshotEpochs.erase(snapshotEpochs.find(epoch));
+		newestSnapshot = snapshotEpochs.empty() ? 0 : *snapshotEpochs.rbegin();
+		// A snapshot reads the oldest copy of a node made for one at least as new, so copies made before the
+		// oldest open snapshot was taken are read by none
+		const std::uint64_t oldest = snapshotEpochs.empty() ? ~(std::uint64_t)0 : *snapshotEpochs.begin();
+		for (std::unordered_map<PageId, std::vector<std::unique_ptr<NodeCopy> > >::iterator it = nodeCopies.begin();
+			 it != nodeCopies.end();)
+		{
+			std::vector<std::unique_ptr<NodeCopy> > &copies = it->second;
+			size_t unread = 0;
+			while (unread < copies.size() && copies[unread]->epoch < oldest)
+			{
+				unread++;
+			}
+			copies.erase(copies.begin(), copies.begin() + unread);
+			nodeCopyCount -= unread;
+			it = copies.empty() ? nodeCopies.erase(it) : ++it;
+		}
+	}
+
+	void BTreeIndex::preserveNode(const PageId pageNo)
+	{
+		const std::uint64_t newest = newestSnapshot;
+		if (newest == 0)
+		{
+			return;
+		}
+		// Changes since the last copy are seen by no open snapshot, which are all older than it
+		std::uint64_t &copied = latches.copied(pageNo);
+		if (copied >= newest)
+		{
+			return;
+		}
+		copied = newest;
+		std::unique_ptr<NodeCopy> copy(new NodeCopy);
+		copy->epoch = newest;
+		Page *page;
+		bufMgr->readPage(file, pageNo, page);
+		memcpy(copy->data, page, Page::SIZE);
+		bufMgr->unPinPage(file, pageNo, false);
+		std::lock_guard<std::mutex> guard(snapshotMutex);
+		nodeCopies[pageNo].push_back(std::move(copy));
+		nodeCopyCount++;
+	}
+
+	void BTreeIndex::preservePath(const DescentPath &path, const int top)
+	{
+		for (int d = top; d < path.depth; d++)
+		{
+			preserveNode(path.pageNo[d]);
+		}
+	}
+
+	void BTreeIndex::readSnapshotNode(const PageId pageNo, const std::uint64_t epoch, char *out)
+	{
+		VersionLatch &latch = latches.get(pageNo);
+		while (true)
+		{
+			// Copies are looked for once the version is read, as a writer copies the node under its latch
+			const std::uint64_t version = latch.readLock();
+			{
+				std::lock_guard<std::mutex> guard(snapshotMutex);
+				std::unordered_map<PageId, std::vector<std::unique_ptr<NodeCopy> > >::const_iterator found = nodeCopies.find(pageNo);
+				if (found != nodeCopies.end())
+				{
+					for (size_t i = 0; i < found->second.size(); i++)
+					{
+						if (found->second[i]->epoch >= epoch)
+						{
+							memcpy(out, found->second[i]->data, Page::SIZE);
+							return;
+						}
+					}
+				}
+			}
+			// No writer has changed the node since the snapshot was taken, as long as none has by the time it is copied
+			Page *page;
+			bufMgr->readPage(file, pageNo, page);
+			memcpy(out, page, Page::SIZE);
+			const bool valid = latch.validate(version);
+			bufMgr->unPinPage(file, pageNo, false);
+			if (valid)
+			{
+				return;
+			}
+		}
+	}
+
+	template <class T>
+	void BTreeIndex::openSnapshotScan(ScanCursor &cursor)
+	{
+		openCursors++;
+		PageId pageNo;
+		cursor.snapshotEpoch = openSnapshot(pageNo);
+		// Down from the root of the snapshot, as descend goes down the tree
+		const T &key = cursor.reverse ? cursor.highVal<T>() : cursor.lowVal<T>();
+		char *node = &cursor.snapshotLeaf[0];
+		while (true)
+		{
+			readSnapshotNode(pageNo, cursor.snapshotEpoch, node);
+			NonLeafNode<T> *nonLeaf = (NonLeafNode<T> *)node;
+			pageNo = nonLeaf->pageNoArray[separatorBound(searchKernel(), nonLeaf, keyCount(nonLeaf, NodeSize<T>::NONLEAF), key,
+														 cursor.reverse)];
+			if (nonLeaf->header.level == 1)
+			{
+				break;
+			}
+		}
+		readSnapshotNode(pageNo, cursor.snapshotEpoch, node);
+		cursor.currentPageNum = pageNo;
+		cursor.stats.leavesScanned++;
+		LeafNode<T> *leaf = (LeafNode<T> *)node;
+		cursor.nextEntry = cursor.reverse ? leafBound(leaf, cursor.highVal<T>(), cursor.highOp == LTE)
+										  : leafBound(leaf, cursor.lowVal<T>(), cursor.lowOp == GT);
+		if (peekSnapshotEntry<T>(cursor))
+		{
+			const T first = leafKey(leaf, cursor.reverse ? cursor.nextEntry - 1 : cursor.nextEntry);
+			if (cursor.reverse ? (cursor.lowOp == GTE ? first >= cursor.lowVal<T>() : first > cursor.lowVal<T>())
+							   : (cursor.highOp == LTE ? first <= cursor.highVal<T>() : first < cursor.highVal<T>()))
+			{
+				cursor.index = this;
+				return;
+			}
+		}
+		closeSnapshot(cursor.snapshotEpoch);
+		cursor.snapshotEpoch = 0;
+		openCursors--;
+		throw NoSuchKeyFoundException();
+	}
+
+	template <class T>
+	bool BTreeIndex::peekSnapshotEntry(ScanCursor &cursor)
+	{
+		LeafNode<T> *leaf = (LeafNode<T> *)&cursor.snapshotLeaf[0];
+		while (cursor.reverse ? cursor.nextEntry <= 0 : cursor.nextEntry >= keyCount(leaf, leafOccupancy))
+		{
+			// The sibling links of the leaves as of the snapshot lead through its leaves only
+			const PageId sibPageNo = cursor.reverse ? leaf->leftSibPageNo : leaf->rightSibPageNo;
+			if (sibPageNo == (PageId)-1)
+			{
+				return false;
+			}
+			readSnapshotNode(sibPageNo, cursor.snapshotEpoch, &cursor.snapshotLeaf[0]);
+			cursor.currentPageNum = sibPageNo;
+			cursor.stats.leavesScanned++;
+			cursor.nextEntry = cursor.reverse ? keyCount(leaf, leafOccupancy) : 0;
+		}
+		return true;
+	}
+
+	template <class T>
+	size_t BTreeIndex::scanSnapshotBatch(ScanCursor &cursor, RecordId *out, char *payloads, size_t max)
+	{
+		LeafNode<T> *leaf = (LeafNode<T> *)&cursor.snapshotLeaf[0];
+		size_t count = 0;
+		while (count < max && peekSnapshotEntry<T>(cursor))
+		{
+			// The copy of the leaf cannot change, so the entries up to the bound are found once per leaf
+			const int from = cursor.nextEntry;
+			int take;
+			if (cursor.reverse)
+			{
+				const int end = std::min(from, leafBound(leaf, cursor.lowVal<T>(), cursor.lowOp == GT));
+				take = (int)std::min((size_t)(from - end), max - count);
+				for (int i = 0; i < take; i++)
+				{
+					out[count + i] = leafRid(leaf, from - 1 - i);
+					if (payloads != NULL)
+					{
+						memcpy(payloads + (count + i) * payloadSize, leafPayload(leaf, from - 1 - i), payloadSize);
+					}
+				}
+				cursor.nextEntry -= take;
+			}
+			else
+			{
+				const int end = std::max(from, leafBound(leaf, cursor.highVal<T>(), cursor.highOp == LTE));
+				take = (int)std::min((size_t)(end - from), max - count);
+				for (int i = 0; i < take; i++)
+				{
+					out[count + i] = leafRid(leaf, from + i);
+					if (payloads != NULL)
+					{
+						memcpy(payloads + (count + i) * payloadSize, leafPayload(leaf, from + i), payloadSize);
+					}
+				}
+				cursor.nextEntry += take;
+			}
+			if (take == 0)
+			{
+				// The bound was reached
+				break;
+			}
+			count += take;
+		}
+		return count;
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::endScan
+	// -----------------------------------------------------------------------------
+	//
+	void BTreeIndex::endScan()
+	{
+		scan.close();
+	}
+
+	void BTreeIndex::closeScan(ScanCursor &cursor)
+	{
+		if (cursor.snapshotEpoch != 0)
+		{
+			closeSnapshot(cursor.snapshotEpoch);
+			cursor.snapshotEpoch = 0;
+		}
+		else
+		{
+			bufMgr->unPinPage(file, cursor.currentPageNum, false);
+		}
+		openCursors--;
+
+		cursor.index = NULL;
+		cursor.currentPageData = nullptr;
+		cursor.currentPageNum = -1;
+		cursor.nextEntry = -1;
+	}
+
+	// -----------------------------------------------------------------------------
+	// ScanCursor
+	// -----------------------------------------------------------------------------
+
+	ScanCursor::ScanCursor()
+		: index(NULL), nextEntry(-1), reverse(false), currentPageNum(-1), currentPageData(nullptr),
+		  leafVersion(1), postingStart(-1), postingEnd(-1), postingGroup(-1), returnedAny(false), returnedBehind(true),
+		  maxReadahead(0), readahead(0), parentPageNum(-1), childIndex(-1), prefetchedUpTo(-1), snapshotEpoch(0)
+	{
+	}
+
+	ScanCursor::ScanCursor(ScanCursor &&other)
+		: index(NULL)
+	{
+		*this = std::move(other);
+	}
+
+	ScanCursor &ScanCursor::operator=(ScanCursor &&other)
+	{
+		if (this == &other)
+		{
+			return *this;
+		}
+		if (isOpen())
+		{
+			close();
+		}
+		index = other.index;
+		nextEntry = other.nextEntry;
+		reverse = other.reverse;
+		currentPageNum = other.currentPageNum;
+		currentPageData = other.currentPageData;
+		leafVersion = other.leafVersion;
+		postingStart = other.postingStart;
+		postingEnd = other.postingEnd;
+		postingGroup = other.postingGroup;
+		returnedAny = other.returnedAny;
+		returnedBehind = other.returnedBehind;
+		lastRun.swap(other.lastRun);
+		lastRid = other.lastRid;
+		lastValInt = other.lastValInt;
+		lastValDouble = other.lastValDouble;
+		lastValString = other.lastValString;
+		lastValComposite = other.lastValComposite;
+		lowValInt = other.lowValInt;
+		lowValDouble = other.lowValDouble;
+		lowValString = other.lowValString;
+		lowValComposite = other.lowValComposite;
+		highValInt = other.highValInt;
+		highValDouble = other.highValDouble;
+		highValString = other.highValString;
+		highValComposite = other.highValComposite;
+		lowOp = other.lowOp;
+		highOp = other.highOp;
+		maxReadahead = other.maxReadahead;
+		readahead = other.readahead;
+		parentPageNum = other.parentPageNum;
+		childIndex = other.childIndex;
+		prefetchedUpTo = other.prefetchedUpTo;
+		prefetchedPages.swap(other.prefetchedPages);
+		stats = other.stats;
+		snapshotEpoch = other.snapshotEpoch;
+		snapshotLeaf.swap(other.snapshotLeaf);
+		// The leaf pin, or the snapshot, now belongs to this cursor
+		other.index = NULL;
+		return *this;
+	}
+
+	ScanCursor::~ScanCursor()
+	{
+		try
+		{
+			if (isOpen())
+			{
+				close();
+			}
+		}
+		catch (...)
+		{
+		}
+	}
+
+	void ScanCursor::scanNext(RecordId &outRid)
+	{
+		if (!isOpen())
+		{
+			throw ScanNotInitializedException();
+		}
+		(index->*(index->scanNextFn))(*this, outRid, NULL);
+	}
+
+	void ScanCursor::scanNext(RecordId &outRid, char *payload)
+	{
+		if (!isOpen())
+		{
+			throw ScanNotInitializedException();
+		}
+		(index->*(index->scanNextFn))(*this, outRid, payload);
+	}
+
+	size_t ScanCursor::scanNextBatch(RecordId *out, size_t max)
+	{
+		if (!isOpen())
+		{
+			throw ScanNotInitializedException();
+		}
+		return (index->*(index->scanNextBatchFn))(*this, out, NULL, max);
+	}
+
+	size_t ScanCursor::scanNextBatch(RecordId *out, char *payloads, size_t max)
+	{
+		if (!isOpen())
+		{
+			throw ScanNotInitializedException();
+		}
+		return (index->*(index->scanNextBatchFn))(*this, out, payloads, max);
+	}
+
+	void ScanCursor::close()
+	{
+		if (!isOpen())
+		{
+			throw ScanNotInitializedException();
+		}
+		index->closeScan(*this);
+	}
+
+	// -----------------------------------------------------------------------------
+	// insertBatch for each key type
+	// -----------------------------------------------------------------------------
+
+	template void BTreeIndex::insertBatch<int>(const RIDKeyPair<int> *pairs, size_t n);
+	template void BTreeIndex::insertBatch<double>(const RIDKeyPair<double> *pairs, size_t n);
+	template void BTreeIndex::insertBatch<StringKey>(const RIDKeyPair<StringKey> *pairs, size_t n);
+	template void BTreeIndex::insertBatch<CompositeKey>(const RIDKeyPair<CompositeKey> *pairs, size_t n);
 }
@@ -11,11 +11,20 @@
 #include <string>
 #include "string.h"
 #include <sstream>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_map>
 
 #include "types.h"
 #include "page.h"
 #include "file.h"
 #include "buffer.h"
+#include "search_kernel.h"
+#include "node_latch.h"
 
 namespace badgerdb
 {
@@ -27,7 +36,8 @@ namespace badgerdb
   {
     INTEGER = 0,
     DOUBLE = 1,
-    STRING = 2
+    STRING = 2,
+    COMPOSITE = 3
   };
 
   /**
@@ -42,16 +52,329 @@ namespace badgerdb
   };
 
   /**
-   * @brief Number of key slots in B+Tree leaf for INTEGER key.
+   * @brief Number of characters of a STRING attribute that are stored as the key.
    */
-  //                                                  sibling ptr             key               rid
-  const int INTARRAYLEAFSIZE = (Page::SIZE - sizeof(PageId)) / (sizeof(int) + sizeof(RecordId));
+  const int STRINGSIZE = 10;
+
+  /**
+   * @brief Key of a STRING index: the first STRINGSIZE characters of the attribute, zero padded.
+   * Keys compare byte by byte, which orders them like strncmp does.
+   */
+  struct StringKey
+  {
+    char value[STRINGSIZE];
+
+    bool operator==(const StringKey &rhs) const { return memcmp(value, rhs.value, STRINGSIZE) == 0; }
+    bool operator!=(const StringKey &rhs) const { return memcmp(value, rhs.value, STRINGSIZE) != 0; }
+    bool operator<(const StringKey &rhs) const { return memcmp(value, rhs.value, STRINGSIZE) < 0; }
+    bool operator<=(const StringKey &rhs) const { return memcmp(value, rhs.value, STRINGSIZE) <= 0; }
+    bool operator>(const StringKey &rhs) const { return memcmp(value, rhs.value, STRINGSIZE) > 0; }
+    bool operator>=(const StringKey &rhs) const { return memcmp(value, rhs.value, STRINGSIZE) >= 0; }
+  };
+
+  /**
+   * @brief Most columns of a COMPOSITE key.
+   */
+  const int MAX_KEY_COLUMNS = 4;
+
+  /**
+   * @brief Number of bytes of a COMPOSITE key, which its encoded columns must fit in together.
+   */
+  const int COMPOSITESIZE = 32;
+
+  /**
+   * @brief Key of a COMPOSITE index: its columns encoded one after the other and zero padded, so that keys
+   * compare byte by byte like the tuples of their column values. See BTreeIndex::compositeKey.
+   */
+  struct CompositeKey
+  {
+    unsigned char value[COMPOSITESIZE];
+
+    bool operator==(const CompositeKey &rhs) const { return memcmp(value, rhs.value, COMPOSITESIZE) == 0; }
+    bool operator!=(const CompositeKey &rhs) const { return memcmp(value, rhs.value, COMPOSITESIZE) != 0; }
+    bool operator<(const CompositeKey &rhs) const { return memcmp(value, rhs.value, COMPOSITESIZE) < 0; }
+    bool operator<=(const CompositeKey &rhs) const { return memcmp(value, rhs.value, COMPOSITESIZE) <= 0; }
+    bool operator>(const CompositeKey &rhs) const { return memcmp(value, rhs.value, COMPOSITESIZE) > 0; }
+    bool operator>=(const CompositeKey &rhs) const { return memcmp(value, rhs.value, COMPOSITESIZE) >= 0; }
+  };
+
+  /**
+   * @brief Per key type properties of the B+ tree. Specialized for int, double, StringKey and CompositeKey.
+   * type     Datatype stored in the index meta page.
+   * get()    Reads a key from an attribute value in a record or from a scan/insert parameter.
+   * PREFIXED True for keys that compare byte by byte, which non-leaf nodes search by an INTEGER prefix of each.
+   * prefix() Order-preserving INTEGER prefix of the bytes of a key from offset on: of keys that share their
+   *          first offset bytes, those that compare less never have a larger prefix.
+   */
+  template <class T>
+  struct KeyTraits;
+
+  /**
+   * @brief Order-preserving INTEGER prefix of keys that compare byte by byte: their first four bytes, big-endian,
+   * with the sign bit flipped so that signed comparison orders them as unsigned.
+   */
+  inline int bytePrefix(const unsigned char *bytes)
+  {
+    return (int)(((std::uint32_t)bytes[0] << 24 | (std::uint32_t)bytes[1] << 16 | (std::uint32_t)bytes[2] << 8 | bytes[3]) ^
+                 0x80000000u);
+  }
+
+  template <>
+  struct KeyTraits<int>
+  {
+    static const Datatype type = INTEGER;
+    static const bool PREFIXED = false;
+    static int get(const void *value)
+    {
+      int key;
+      memcpy(&key, value, sizeof(int));
+      return key;
+    }
+  };
+
+  template <>
+  struct KeyTraits<double>
+  {
+    static const Datatype type = DOUBLE;
+    static const bool PREFIXED = false;
+    static double get(const void *value)
+    {
+      double key;
+      memcpy(&key, value, sizeof(double));
+      return key;
+    }
+    // Bits of a double that order as unsigned integers like the doubles do: positive ones with the sign bit set,
+    // negative ones with all bits flipped. -0.0 becomes 0.0, which it equals.
+    static std::uint64_t ordered(const double key)
+    {
+      const double value = key == 0 ? 0.0 : key;
+      std::uint64_t bits;
+      memcpy(&bits, &value, sizeof(bits));
+      return bits >> 63 ? ~bits : bits | 0x8000000000000000ull;
+    }
+  };
+
+  template <>
+  struct KeyTraits<StringKey>
+  {
+    static const Datatype type = STRING;
+    static const bool PREFIXED = true;
+    static StringKey get(const void *value)
+    {
+      // The first STRINGSIZE characters, zero-padded and not terminated if the string fills them
+      StringKey key;
+      const size_t length = strnlen((const char *)value, STRINGSIZE);
+      memcpy(key.value, value, length);
+      memset(key.value + length, 0, STRINGSIZE - length);
+      return key;
+    }
+    static int prefix(const StringKey &key, const int offset) { return bytePrefix((const unsigned char *)key.value + offset); }
+  };
+
+  template <>
+  struct KeyTraits<CompositeKey>
+  {
+    static const Datatype type = COMPOSITE;
+    static const bool PREFIXED = true;
+    // Parameters are keys already encoded, as the columns of a record are only known to the index
+    static CompositeKey get(const void *value)
+    {
+      CompositeKey key;
+      memcpy(key.value, value, COMPOSITESIZE);
+      return key;
+    }
+    static int prefix(const CompositeKey &key, const int offset) { return bytePrefix(key.value + offset); }
+  };
+
+  /**
+   * @brief Kind of node held by an index page, recorded in its NodeHeader.
+   */
+  enum NodeType
+  {
+    LEAF_NODE = 1,
+    NON_LEAF_NODE = 2
+  };
+
+  /**
+   * @brief Header at the start of every node page.
+   */
+  struct NodeHeader
+  {
+    /**
+     * Number of keys in a non-leaf, or of entries in a leaf. They fill the first slots, and nothing past them is used.
+     */
+    std::uint16_t keyCount;
+
+    /**
+     * Height of the node above the leaves: 0 for a leaf, 1 for a non-leaf just above the leaves.
+     */
+    std::uint8_t level;
+
+    /**
+     * NodeType of the node.
+     */
+    std::uint8_t type;
+  };
+
+  /**
+   * @brief Space in B+Tree leaf and non-leaf nodes for key type T, computed at compile time.
+   * The node header is padded so that the key array stays aligned for T.
+   */
+  template <class T>
+  struct NodeSize
+  {
+    static const int HEADER = (sizeof(NodeHeader) + alignof(T) - 1) / alignof(T) * alignof(T);
+    //                                            header          posting count         sibling ptrs
+    static const int LEAF_SPACE = Page::SIZE - sizeof(NodeHeader) - sizeof(std::uint32_t) - 2 * sizeof(PageId);
+    //                        key           entry end
+    static const int POSTING = sizeof(T) + sizeof(std::uint16_t);
+    // Entries when every key is different, each with its own posting list
+    static const int LEAF = LEAF_SPACE / (POSTING + sizeof(RecordId));
+    // Entries when they all share one posting list
+    static const int LEAF_ENTRIES = (LEAF_SPACE - POSTING) / sizeof(RecordId);
+    // Key prefix of each non-leaf slot, or one unused slot for keys searched whole
+    static const int PREFIX = KeyTraits<T>::PREFIXED ? sizeof(int) : 0;
+    //                                      header  extra pageNo     extra count                 prefix offset, unused prefix                     key        prefix        pageNo           count
+    static const int NONLEAF = (Page::SIZE - HEADER - sizeof(PageId) - sizeof(std::uint32_t) - (2 * sizeof(int) - PREFIX)) / (sizeof(T) + PREFIX + sizeof(PageId) + sizeof(std::uint32_t));
+  };
+
+  /**
+   * @brief Number of entries with distinct INTEGER keys in B+Tree leaf.
+   */
+  const int INTARRAYLEAFSIZE = NodeSize<int>::LEAF;
 
   /**
    * @brief Number of key slots in B+Tree non-leaf for INTEGER key.
    */
-  //                                                     level     extra pageNo                  key       pageNo
-  const int INTARRAYNONLEAFSIZE = (Page::SIZE - sizeof(int) - sizeof(PageId)) / (sizeof(int) + sizeof(PageId));
+  const int INTARRAYNONLEAFSIZE = NodeSize<int>::NONLEAF;
+
+  /**
+   * @brief Number of entries with distinct DOUBLE keys in B+Tree leaf.
+   */
+  const int DOUBLEARRAYLEAFSIZE = NodeSize<double>::LEAF;
+
+  /**
+   * @brief Number of key slots in B+Tree non-leaf for DOUBLE key.
+   */
+  const int DOUBLEARRAYNONLEAFSIZE = NodeSize<double>::NONLEAF;
+
+  /**
+   * @brief Number of entries with distinct STRING keys in B+Tree leaf.
+   */
+  const int STRINGARRAYLEAFSIZE = NodeSize<StringKey>::LEAF;
+
+  /**
+   * @brief Number of key slots in B+Tree non-leaf for STRING key.
+   */
+  const int STRINGARRAYNONLEAFSIZE = NodeSize<StringKey>::NONLEAF;
+
+  /**
+   * @brief Number of entries with distinct COMPOSITE keys in B+Tree leaf.
+   */
+  const int COMPOSITEARRAYLEAFSIZE = NodeSize<CompositeKey>::LEAF;
+
+  /**
+   * @brief Number of key slots in B+Tree non-leaf for COMPOSITE key.
+   */
+  const int COMPOSITEARRAYNONLEAFSIZE = NodeSize<CompositeKey>::NONLEAF;
+
+  /**
+   * @brief Default fraction of the space in each node that the bulk loader fills.
+   * Lower values leave room for later inserts before the first splits happen.
+   */
+  const double DEFAULT_FILL_FACTOR = 1.0;
+
+  /**
+   * @brief Most threads a bulk load splits the scan of the base relation over.
+   */
+  const int MAX_BUILD_THREADS = 64;
+
+  /**
+   * @brief Default for the most leaves a scan reads ahead of its position. See ScanOptions.
+   */
+  const int DEFAULT_READAHEAD = 8;
+
+  /**
+   * @brief Upper limit of ScanOptions::maxReadahead.
+   */
+  const int MAX_READAHEAD = 64;
+
+  /**
+   * @brief Default fraction of a node's space that the left node keeps when an append splits the rightmost
+   * leaf or non-leaf. See BTreeIndex::setAppendFill.
+   */
+  const double DEFAULT_APPEND_FILL = 0.9;
+
+  /**
+   * @brief Most levels a tree can have, bounding the path an insert records on its way down.
+   */
+  const int MAX_HEIGHT = 32;
+
+  /**
+   * @brief Default number of levels, from the root down, whose non-leaf nodes an index keeps in its hot-node cache.
+   */
+  const int DEFAULT_HOT_LEVELS = 2;
+
+  /**
+   * @brief Most nodes in the hot-node cache of an index, each of which keeps a buffer frame pinned.
+   */
+  const int MAX_HOT_NODES = 16;
+
+  /**
+   * @brief Most payload columns a covering index can store with each entry.
+   */
+  const int MAX_PAYLOAD_COLUMNS = 4;
+
+  /**
+   * @brief Most payload bytes a covering index can store with each entry, over all its payload columns.
+   */
+  const int MAX_PAYLOAD_SIZE = 64;
+
+  /**
+   * @brief Fixed-width attribute of the base relation that a covering index stores next to each record id,
+   * so that scans return it without reading the record.
+   */
+  struct PayloadColumn
+  {
+    /**
+     * Offset of the attribute inside the record.
+     */
+    int offset;
+
+    /**
+     * Length of the attribute in bytes.
+     */
+    int length;
+
+    void set(int o, int l)
+    {
+      offset = o;
+      length = l;
+    }
+  };
+
+  /**
+   * @brief Attribute of the base relation that is a column of the key of a COMPOSITE index. Keys order
+   * entries by their first column, then by their second, and so on.
+   */
+  struct KeyColumn
+  {
+    /**
+     * Offset of the attribute inside the record.
+     */
+    int offset;
+
+    /**
+     * Type of the attribute: INTEGER, DOUBLE or STRING.
+     */
+    Datatype type;
+
+    void set(int o, Datatype t)
+    {
+      offset = o;
+      type = t;
+    }
+  };
 
   /**
    * @brief Structure to store a key-rid pair. It is used to pass the pair to functions that
@@ -80,10 +403,15 @@ namespace badgerdb
   public:
     PageId pageNo;
     T key;
-    void set(int p, T k)
+    /**
+     * Number of entries in the subtree of pageNo, for the entry counts of the parent.
+     */
+    std::uint32_t count;
+    void set(int p, T k, std::uint32_t c = 0)
     {
       pageNo = p;
       key = k;
+      count = c;
     }
   };
 
@@ -101,6 +429,25 @@ namespace badgerdb
       return r1.rid.page_number < r2.rid.page_number;
   }
 
+  /**
+   * @brief Inserts held back by the write buffer of an index. They are appended as they come, and only sorted
+   * when a point read searches them, into runs that are merged as they grow, so that inserts alone cost an
+   * append each and a read searches a few sorted runs.
+   */
+  template <class T>
+  struct BufferedInserts
+  {
+    /**
+     * Inserts that came since the last point read, in the order they came.
+     */
+    std::vector<RIDKeyPair<T> > pending;
+
+    /**
+     * Sorted runs, each more than twice as long as the one after it.
+     */
+    std::vector<std::vector<RIDKeyPair<T> > > runs;
+  };
+
   /**
    * @brief The meta page, which holds metadata for Index file, is always first page of the btree index file and is cast
    * to the following structure to store or retrieve information from it.
@@ -130,118 +477,263 @@ namespace badgerdb
      * Page number of root page of the B+ Tree inside the file index file.
      */
     PageId rootPageNo;
+
+    /**
+     * First page of the list of pages freed by deletes, -1 if there is none. A freed page
+     * is an empty leaf whose rightSibPageNo is the next page of the list.
+     */
+    PageId freePageNo;
+
+    /**
+     * Number of payload columns stored with each entry, 0 unless the index is a covering index.
+     */
+    int payloadColumnCount;
+
+    /**
+     * Payload columns, in the order their bytes are stored.
+     */
+    PayloadColumn payloadColumns[MAX_PAYLOAD_COLUMNS];
+
+    /**
+     * Number of key columns, 0 unless attrType is COMPOSITE.
+     */
+    int keyColumnCount;
+
+    /**
+     * Key columns of a COMPOSITE index, in the order they are encoded in each key.
+     */
+    KeyColumn keyColumns[MAX_KEY_COLUMNS];
   };
 
   /*
   Each node is a page, so once we read the page in we just cast the pointer to the page to this struct and use it to access the parts
   These structures basically are the format in which the information is stored in the pages for the index file depending on what kind of
-  node they are. The level memeber of each non leaf structure seen below is set to 1 if the nodes
-  at this level are just above the leaf nodes. Otherwise set to 0.
+  node they are. Both start with a NodeHeader holding the number of keys, so slots past them are never read,
+  and any key value, -1 included, can be stored.
   */
 
   /**
-   * @brief Structure for all non-leaf nodes when the key is of INTEGER type.
+   * @brief Structure for all non-leaf nodes when the key is of type T.
    */
-  struct NonLeafNodeInt
+  template <class T>
+  struct NonLeafNode
   {
     /**
-     * Level of the node in the tree.
+     * Key count, level and type of the node.
      */
-    int level;
+    NodeHeader header;
 
     /**
      * Stores keys.
      */
-    int keyArray[INTARRAYNONLEAFSIZE];
+    T keyArray[NodeSize<T>::NONLEAF];
 
     /**
      * Stores page numbers of child pages which themselves are other non-leaf/leaf nodes in the tree.
      */
-    PageId pageNoArray[INTARRAYNONLEAFSIZE + 1];
+    PageId pageNoArray[NodeSize<T>::NONLEAF + 1];
+
+    /**
+     * Number of leaf entries in the subtree of each child, for counting and ranking without reading the leaves.
+     * Inserts and deletes add to them atomically without latching the node, so they are read atomically too.
+     */
+    std::uint32_t countArray[NodeSize<T>::NONLEAF + 1];
+
+    /**
+     * Number of leading bytes all the keys share, which their prefixes start after. Unused unless
+     * KeyTraits<T>::PREFIXED.
+     */
+    int prefixOffset;
+
+    /**
+     * KeyTraits<T>::prefix of each key from prefixOffset on, which descents search with the INTEGER search kernel,
+     * comparing whole keys only among those with the same prefix. Unused unless KeyTraits<T>::PREFIXED, as
+     * INTEGER keys are searched with the kernel directly and DOUBLE keys compare as fast as their prefixes would.
+     */
+    int prefixArray[KeyTraits<T>::PREFIXED ? NodeSize<T>::NONLEAF : 1];
   };
 
   /**
-   * @brief Structure for all leaf nodes when the key is of INTEGER type.
+   * @brief Structure for all leaf nodes when the key is of type T.
+   * Entries with the same key share one posting list, which holds the key once. The entries, each a record id
+   * followed by the payload of a covering index, fill data from the front in index order. The posting lists
+   * fill it from the back: one past the last entry of each list, then the keys, both in key order, so that the
+   * keys are a sorted array ending at the end of the page. A key with more entries than a leaf holds goes on in
+   * the leaves to its right, each holding a posting list of it.
    */
-  struct LeafNodeInt
+  template <class T>
+  struct LeafNode
   {
     /**
-     * Stores keys.
+     * Entry count, level and type of the node.
      */
-    int keyArray[INTARRAYLEAFSIZE];
+    NodeHeader header;
 
     /**
-     * Stores RecordIds.
+     * Number of posting lists, that is of distinct keys.
      */
-    RecordId ridArray[INTARRAYLEAFSIZE];
+    std::uint32_t postingCount;
 
     /**
      * Page number of the leaf on the right side.
      * This linking of leaves allows to easily move from one leaf to the next leaf during index scan.
      */
     PageId rightSibPageNo;
+
+    /**
+     * Page number of the leaf on the left side, -1 for the leftmost leaf. Followed by descending scans.
+     * A leaf is latched whenever its left sibling changes, so readers can trust it once the leaf validates.
+     */
+    PageId leftSibPageNo;
+
+    /**
+     * Entries from the front, posting lists from the back.
+     */
+    char data[NodeSize<T>::LEAF_SPACE];
   };
 
+  typedef NonLeafNode<int> NonLeafNodeInt;
+  typedef LeafNode<int> LeafNodeInt;
+  typedef NonLeafNode<double> NonLeafNodeDouble;
+  typedef LeafNode<double> LeafNodeDouble;
+  typedef NonLeafNode<StringKey> NonLeafNodeString;
+  typedef LeafNode<StringKey> LeafNodeString;
+  typedef NonLeafNode<CompositeKey> NonLeafNodeComposite;
+  typedef LeafNode<CompositeKey> LeafNodeComposite;
+
+  static_assert(sizeof(NonLeafNodeInt) <= Page::SIZE && sizeof(LeafNodeInt) <= Page::SIZE,
+                "INTEGER nodes must fit in a page");
+  static_assert(sizeof(NonLeafNodeDouble) <= Page::SIZE && sizeof(LeafNodeDouble) <= Page::SIZE,
+                "DOUBLE nodes must fit in a page");
+  static_assert(sizeof(NonLeafNodeString) <= Page::SIZE && sizeof(LeafNodeString) <= Page::SIZE,
+                "STRING nodes must fit in a page");
+  static_assert(sizeof(NonLeafNodeComposite) <= Page::SIZE && sizeof(LeafNodeComposite) <= Page::SIZE,
+                "COMPOSITE nodes must fit in a page");
+
   /**
-   * @brief BTreeIndex class. It implements a B+ Tree index on a single attribute of a
-   * relation. This index supports only one scan at a time.
+   * @brief Options of the bulk load of a new index by the BTreeIndex constructor.
    */
-  class BTreeIndex
+  struct BuildOptions
   {
+    /**
+     * Threads that scan the relation and sort its pairs, each over its own range of the relation's pages.
+     * At most MAX_BUILD_THREADS.
+     */
+    int threads;
 
-  private:
     /**
-     * File object for the index file.
+     * Bytes of pairs held in memory at once. 0 sorts every pair in memory; otherwise an ExternalSort with
+     * this budget writes sorted runs to a temporary file and its merged output is packed into leaves as it
+     * comes. Such a build scans the relation on one thread. A budget with more pages than the buffer pool
+     * has frames merges no more runs at once than the pool has room for.
      */
-    File *file;
+    size_t sortMemory;
+
+    BuildOptions()
+        : threads(1), sortMemory(0)
+    {
+    }
+  };
 
+  /**
+   * @brief Options of a scan opened with BTreeIndex::openScan().
+   */
+  struct ScanOptions
+  {
     /**
-     * Buffer Manager Instance.
+     * Most leaves to bring into the buffer pool ahead of the scan. The window starts at one leaf and
+     * doubles every time the scan moves to the next leaf, so short scans read little ahead, and it
+     * never reaches past the high bound of the scan. 0 turns readahead off; at most MAX_READAHEAD.
      */
-    BufMgr *bufMgr;
+    int maxReadahead;
 
     /**
-     * Page number of meta page.
+     * Read the index as it was when the scan was opened. Writers keep copies of the nodes they change for
+     * the scan, which therefore neither sees their changes nor holds them up, and the copies are freed once
+     * no open snapshot scan needs them. Such a scan pins no leaf between calls and reads no leaf ahead.
      */
-    PageId headerPageNum;
+    bool snapshot;
 
+    ScanOptions()
+        : maxReadahead(DEFAULT_READAHEAD), snapshot(false)
+    {
+    }
+  };
+
+  /**
+   * @brief Leaf read statistics of a scan.
+   */
+  struct ScanStats
+  {
     /**
-     * page number of root page of B+ tree inside index file.
+     * Leaves the scan has been positioned on.
      */
-    PageId rootPageNum;
+    int leavesScanned;
 
     /**
-     * Datatype of attribute over which index is built.
+     * Leaves read from disk by readahead.
      */
-    Datatype attributeType;
+    int leavesPrefetched;
 
     /**
-     * Offset of attribute, over which index is built, inside records.
+     * Leaves the scan moved to that its own readahead had read from disk and that were still in the
+     * buffer pool. Leaves that were in the pool before readahead reached them do not count. Readahead
+     * reads each leaf before the scan gets to it rather than while the scan goes on, so these are reads
+     * done early, not reads overlapped with the scan.
      */
-    int attrByteOffset;
+    int prefetchHits;
 
     /**
-     * Number of keys in leaf node, depending upon the type of key.
+     * Clears all values
      */
-    int leafOccupancy;
+    void clear()
+    {
+      leavesScanned = leavesPrefetched = prefetchHits = 0;
+    }
 
     /**
-     * Number of keys in non-leaf node, depending upon the type of key.
+     * Constructor
      */
-    int nodeOccupancy;
+    ScanStats()
+    {
+      clear();
+    }
+  };
 
-    // MEMBERS SPECIFIC TO SCANNING
+  class BTreeIndex;
+
+  /**
+   * @brief Position of one range scan over a BTreeIndex. Returned by BTreeIndex::openScan() or,
+   * for a scan returning entries from the high bound down, BTreeIndex::openReverseScan().
+   * A cursor pins only the leaf it is positioned on, so many cursors can be open on one index.
+   * Closing or destroying the cursor unpins the leaf. Cursors can be moved but not copied.
+   * The leaf is read without latching it. When a writer has changed the leaf since the cursor last
+   * read it, the cursor finds its place again from the last entry it returned, from the root if deletes
+   * may have moved entries into the leaf on the left, so entries that inserts and deletes move are
+   * neither skipped nor returned twice. A cursor must be used by one thread at a time.
+   */
+  class ScanCursor
+  {
+  private:
+    friend class BTreeIndex;
 
     /**
-     * True if an index scan has been started.
+     * Index being scanned. NULL while the cursor is not open.
      */
-    bool scanExecuting;
+    BTreeIndex *index;
 
     /**
-     * Index of next entry to be scanned in current leaf being scanned.
+     * Index of next entry to be scanned in current leaf being scanned. -1 until the cursor has found
+     * its place in a leaf it has just moved to. A reverse scan keeps the index after the next entry,
+     * so that 0 means the leaf is done.
      */
     int nextEntry;
 
+    /**
+     * True if the scan returns entries in descending key order, moving left through the leaves.
+     */
+    bool reverse;
+
     /**
      * Page number of current page being scanned.
      */
@@ -253,64 +745,1303 @@ namespace badgerdb
     Page *currentPageData;
 
     /**
-     * Low INTEGER value for scan.
+     * Version of the current leaf at which nextEntry was found, or at which the cursor moved to the leaf.
      */
-    int lowValInt;
+    std::uint64_t leafVersion;
 
     /**
-     * Low DOUBLE value for scan.
+     * Entries of the current leaf, at leafVersion, in the posting list of the last entry returned: from
+     * postingStart up to postingEnd, or none while postingStart is -1. They have the key of that entry, so the
+     * scan returns them without checking their key against its bound.
      */
-    double lowValDouble;
+    int postingStart;
+    int postingEnd;
 
     /**
-     * Low STRING value for scan.
+     * Index in its leaf of the posting list of the last entry peeked, from which a scan guesses the next one.
      */
-    std::string lowValString;
+    int postingGroup;
 
     /**
-     * High INTEGER value for scan.
+     * True once the cursor has returned an entry.
      */
-    int highValInt;
+    bool returnedAny;
 
     /**
-     * High DOUBLE value for scan.
+     * True while every entry returned is in a leaf before the current one or before nextEntry in it,
+     * so that the cursor can go on from the last entry returned.
      */
-    double highValDouble;
+    bool returnedBehind;
 
     /**
-     * High STRING value for scan.
+     * Record ids of the entries returned with the key of the last one.
+     * Deletes can remove the last entry returned, and these tell its duplicates still to come from those
+     * already returned.
      */
-    std::string highValString;
+    std::vector<RecordId> lastRun;
 
     /**
-     * Low Operator. Can only be GT(>) or GTE(>=).
+     * Record id of the last entry returned.
      */
-    Operator lowOp;
+    RecordId lastRid;
+
+    /**
+     * Key of the last entry returned, by key type.
+     */
+    int lastValInt;
+    double lastValDouble;
+    StringKey lastValString;
+    CompositeKey lastValComposite;
+
+    /**
+     * Low INTEGER value for scan.
+     */
+    int lowValInt;
+
+    /**
+     * Low DOUBLE value for scan.
+     */
+    double lowValDouble;
+
+    /**
+     * Low STRING value for scan.
+     */
+    StringKey lowValString;
+
+    /**
+     * Low COMPOSITE value for scan.
+     */
+    CompositeKey lowValComposite;
+
+    /**
+     * High INTEGER value for scan.
+     */
+    int highValInt;
+
+    /**
+     * High DOUBLE value for scan.
+     */
+    double highValDouble;
+
+    /**
+     * High STRING value for scan.
+     */
+    StringKey highValString;
+
+    /**
+     * High COMPOSITE value for scan.
+     */
+    CompositeKey highValComposite;
+
+    /**
+     * Low Operator. Can only be GT(>) or GTE(>=).
+     */
+    Operator lowOp;
 
     /**
      * High Operator. Can only be LT(<) or LTE(<=).
      */
-    Operator highOp;
+    Operator highOp;
+
+    /**
+     * Most leaves to read ahead, from ScanOptions.
+     */
+    int maxReadahead;
+
+    /**
+     * Current readahead window, in leaves.
+     */
+    int readahead;
+
+    /**
+     * Parent of the current leaf, used to find the leaves to read ahead. -1 if not known.
+     */
+    PageId parentPageNum;
+
+    /**
+     * Index of the current leaf among the children of parentPageNum.
+     */
+    int childIndex;
+
+    /**
+     * Index, among the children of parentPageNum, of the last leaf handed to readahead. For a
+     * reverse scan, the lowest.
+     */
+    int prefetchedUpTo;
+
+    /**
+     * Leaves readahead read from disk for this cursor that the scan has not moved to yet, in scan order.
+     */
+    std::vector<PageId> prefetchedPages;
+
+    /**
+     * Leaf read statistics.
+     */
+    ScanStats stats;
+
+    /**
+     * Epoch of the snapshot a snapshot scan reads the index as of, 0 for any other scan.
+     */
+    std::uint64_t snapshotEpoch;
+
+    /**
+     * Copy of the current leaf as of snapshotEpoch, which a snapshot scan reads in place of the pinned leaf.
+     */
+    std::vector<char> snapshotLeaf;
+
+    /**
+     * Low and high bound of the scan for key type T.
+     */
+    template <class T>
+    T &lowVal();
+    template <class T>
+    T &highVal();
+    template <class T>
+    T &lastVal();
+
+    ScanCursor(const ScanCursor &) = delete;
+    ScanCursor &operator=(const ScanCursor &) = delete;
+
+  public:
+    /**
+     * Construct a cursor that is not open.
+     */
+    ScanCursor();
+
+    /**
+     * Take over the scan of another cursor, which is left closed.
+     */
+    ScanCursor(ScanCursor &&other);
+    ScanCursor &operator=(ScanCursor &&other);
+
+    /**
+     * Closes the cursor if it is open.
+     */
+    ~ScanCursor();
+
+    /**
+     * True between a successful BTreeIndex::openScan and close.
+     */
+    bool isOpen() const { return index != NULL; }
+
+    /**
+     * Leaf read statistics of the scan so far.
+     */
+    const ScanStats &getStats() const { return stats; }
+
+    /**
+     * Fetch the record id of the next index entry that matches the scan, moving to the right sibling
+     * once the current leaf is exhausted.
+     * @param outRid	RecordId of next record found that satisfies the scan criteria returned in this
+     * @throws ScanNotInitializedException If the cursor is not open.
+     * @throws IndexScanCompletedException If no more records, satisfying the scan criteria, are left to be scanned.
+     **/
+    void scanNext(RecordId &outRid);
+
+    /**
+     * Like scanNext, and also copy the payload of the entry, BTreeIndex::getPayloadSize() bytes, to payload.
+     **/
+    void scanNext(RecordId &outRid, char *payload);
+
+    /**
+     * Fetch the record ids of up to max next index entries that match the scan, moving through
+     * as many leaves as needed. The high bound is checked once per leaf rather than once per entry.
+     * @param out	Array receiving the record ids
+     * @param max	Capacity of out
+     * @return	Number of record ids stored in out. Zero once the scan is complete.
+     * @throws ScanNotInitializedException If the cursor is not open.
+     **/
+    size_t scanNextBatch(RecordId *out, size_t max);
+
+    /**
+     * Like scanNextBatch, and also copy the payloads of the entries to payloads, BTreeIndex::getPayloadSize()
+     * bytes each in the order of out, so that an index-only scan never reads the base relation.
+     * @param payloads	Array receiving the payloads, with room for max of them
+     **/
+    size_t scanNextBatch(RecordId *out, char *payloads, size_t max);
+
+    /**
+     * Unpin the current leaf and close the cursor.
+     * @throws ScanNotInitializedException If the cursor is not open.
+     **/
+    void close();
+  };
+
+  /**
+   * @brief BTreeIndex class. It implements a B+ Tree index on a single attribute of a
+   * relation. Any number of scans can be open on it through openScan, besides the one run by startScan.
+   * insertEntry, deleteEntry and openScan cursors may be used from many threads at once, provided the buffer
+   * manager is only shared with other thread-safe users. Readers descend with optimistic lock coupling: every
+   * node has a version latch, readers check that the versions they read are unchanged and restart
+   * from the root if not, and an insert or delete latches only the nodes that it changes.
+   * startScan, scanNext and endScan share one cursor and are meant for a single thread.
+   */
+  class BTreeIndex
+  {
+
+  private:
+    /**
+     * File object for the index file.
+     */
+    File *file;
+
+    /**
+     * Buffer Manager Instance.
+     */
+    BufMgr *bufMgr;
+
+    /**
+     * Page number of meta page.
+     */
+    PageId headerPageNum;
+
+    /**
+     * page number of root page of B+ tree inside index file.
+     */
+    PageId rootPageNum;
+
+    /**
+     * Datatype of attribute over which index is built.
+     */
+    Datatype attributeType;
+
+    /**
+     * Offset of attribute, over which index is built, inside records. The first key column of a COMPOSITE index.
+     */
+    int attrByteOffset;
+
+    /**
+     * Columns of the key of a COMPOSITE index. Empty for other indexes.
+     */
+    std::vector<KeyColumn> keyColumns;
+
+    /**
+     * Most entries in a leaf, when they all share one posting list. Depends upon the type of key and, for a
+     * covering index, the payload size.
+     */
+    int leafOccupancy;
+
+    /**
+     * Most posting lists in a leaf, when each holds one entry.
+     */
+    int postingOccupancy;
+
+    /**
+     * Bytes of each leaf entry, its record id and payload.
+     */
+    int entrySize;
+
+    /**
+     * Attributes stored with each entry of a covering index. Empty for other indexes.
+     */
+    std::vector<PayloadColumn> payloadColumns;
+
+    /**
+     * Bytes of payload stored with each entry, the sum of the payload column lengths.
+     */
+    int payloadSize;
+
+    /**
+     * Number of keys in non-leaf node, depending upon the type of key.
+     */
+    int nodeOccupancy;
+
+    /**
+     * Cursor of the scan run by startScan, scanNext and endScan.
+     */
+    ScanCursor scan;
+
+    /**
+     * Version latches of the nodes.
+     */
+    NodeLatchTable latches;
+
+    /**
+     * Version latch of rootPageNum, taken by an insert that splits the root or a delete that collapses it.
+     */
+    VersionLatch rootLatch;
+
+    /**
+     * First page of the list of freed pages, -1 if there is none. Mirrors IndexMetaInfo::freePageNo.
+     */
+    PageId freePageNum;
+
+    /**
+     * Fraction of its space that the left node keeps when an append splits the rightmost leaf or non-leaf.
+     */
+    std::atomic<double> appendFill;
+
+    /**
+     * Serializes taking pages from and returning pages to the free page list.
+     */
+    std::mutex freeListMutex;
+
+    /**
+     * Number of open cursors. A cursor can hold a leaf pinned after a delete has freed it, so freed
+     * pages are only handed out again while no cursor is open.
+     */
+    std::atomic<int> openCursors;
+
+    /**
+     * @brief Copy of a node as it was before a writer first changed it after a snapshot was taken.
+     */
+    struct NodeCopy
+    {
+      /**
+       * Epoch of the newest snapshot open when the copy was made. The copy is the node as snapshots up to that epoch
+       * see it, back to the epoch of the copy before it.
+       */
+      std::uint64_t epoch;
+
+      /**
+       * Contents of the page.
+       */
+      char data[Page::SIZE];
+    };
+
+    /**
+     * Copies of the nodes changed since the oldest open snapshot was taken, by page, each list by ascending epoch.
+     * Guarded by snapshotMutex.
+     */
+    std::unordered_map<PageId, std::vector<std::unique_ptr<NodeCopy> > > nodeCopies;
+
+    /**
+     * Number of node copies kept.
+     */
+    std::atomic<size_t> nodeCopyCount;
+
+    /**
+     * Epochs of the open snapshots. Guarded by snapshotMutex.
+     */
+    std::multiset<std::uint64_t> snapshotEpochs;
+
+    /**
+     * Last epoch handed to a snapshot.
+     */
+    std::uint64_t snapshotClock;
+
+    /**
+     * Epoch of the newest open snapshot, 0 if none is open. Writers copy a node before changing it if they have not
+     * copied it for this epoch yet.
+     */
+    std::atomic<std::uint64_t> newestSnapshot;
+
+    /**
+     * Serializes changes to the node copies and the open snapshots.
+     */
+    std::mutex snapshotMutex;
+
+    /**
+     * Inserts and deletes in progress, which a snapshot waits for before it is taken, so that each is wholly in or out of it.
+     */
+    std::atomic<int> activeWriters;
+
+    /**
+     * True while a snapshot is being taken, which holds back inserts and deletes that have not started.
+     */
+    std::atomic<bool> takingSnapshot;
+
+    /**
+     * @brief Marks an insert or delete in progress for as long as it is in scope. See beginWrite.
+     */
+    class WriteScope
+    {
+    private:
+      BTreeIndex &index;
+
+    public:
+      WriteScope(BTreeIndex &index)
+          : index(index)
+      {
+        index.beginWrite();
+      }
+
+      ~WriteScope()
+      {
+        index.endWrite();
+      }
+    };
+
+    /**
+     * Most inserts the write buffer holds back, 0 while inserts go straight into the tree. See setWriteBuffer.
+     */
+    std::atomic<size_t> writeBufferCapacity;
+
+    /**
+     * Number of inserts the write buffer holds. Read without writeBufferMutex, so that reads skip an empty buffer.
+     */
+    std::atomic<size_t> bufferedInserts;
+
+    /**
+     * Number of flushes of a non-empty write buffer begun. A point read that searched the buffer checks it after
+     * reading the tree, and reads both again if a flush may have moved entries from one into the other meanwhile.
+     */
+    std::atomic<std::uint64_t> writeBufferFlushes;
+
+    /**
+     * Serializes adding inserts to the write buffer and flushing it into the tree.
+     */
+    std::mutex writeBufferMutex;
+
+    /**
+     * Inserts held back by the write buffer, by key type.
+     */
+    BufferedInserts<int> bufferedInt;
+    BufferedInserts<double> bufferedDouble;
+    BufferedInserts<StringKey> bufferedString;
+    BufferedInserts<CompositeKey> bufferedComposite;
+
+    /**
+     * Inserts held back by the write buffer for key type T.
+     */
+    template <class T>
+    BufferedInserts<T> &buffered();
+
+    /**
+     * @brief Slot of the hot-node cache, holding a pin on the frame of one non-leaf node of the top levels.
+     * A pinned frame keeps holding its page, so a slot is never stale. Slots are filled and emptied under
+     * hotMutex, and emptied only while the node is latched, so that a reader that finds the node in its slot
+     * after reading its version knows the frame held it from then on until the version changes.
+     */
+    struct HotNode
+    {
+      /**
+       * Page number of the node, -1 while the slot is empty.
+       */
+      std::atomic<PageId> pageNo;
+
+      /**
+       * Frame holding the node.
+       */
+      std::atomic<Page *> page;
+    };
+
+    /**
+     * Hot-node cache: the root and the other non-leaf nodes of the top hotLevels levels that descents have
+     * passed through, up to MAX_HOT_NODES of them, read without going through the buffer manager.
+     */
+    HotNode hotNodes[MAX_HOT_NODES];
+
+    /**
+     * Levels, from the root down, whose nodes the hot-node cache takes. 0 while it takes none.
+     */
+    std::atomic<int> hotLevels;
+
+    /**
+     * Number of slots of the hot-node cache in use.
+     */
+    std::atomic<int> hotCount;
+
+    /**
+     * Serializes filling and emptying slots of the hot-node cache.
+     */
+    std::mutex hotMutex;
+
+    /**
+     * Nodes descents found in the hot-node cache or swizzled, each saving a readPage and an unPinPage.
+     */
+    std::atomic<std::uint64_t> hotHits;
+
+    /**
+     * Most non-leaf nodes descents swizzle, 0 while swizzling is off.
+     */
+    std::atomic<int> swizzleLimit;
+
+    /**
+     * Number of non-leaf nodes swizzled, each of which keeps its frame pinned.
+     */
+    std::atomic<int> swizzledCount;
+
+    /**
+     * Pages of the swizzled nodes, in no order, for unswizzling them. Guarded by hotMutex.
+     */
+    std::vector<PageId> swizzledPages;
+
+    /**
+     * Nodes visited by an optimistic descent from the root to a leaf.
+     */
+    struct DescentPath
+    {
+      /**
+       * Non-leaf nodes from the root down to the parent of the leaf.
+       */
+      PageId pageNo[MAX_HEIGHT];
+
+      /**
+       * Version each node was read at.
+       */
+      std::uint64_t version[MAX_HEIGHT];
+
+      /**
+       * Index of the child taken in each node.
+       */
+      int index[MAX_HEIGHT];
+
+      /**
+       * Number of non-leaf nodes on the path.
+       */
+      int depth;
+
+      /**
+       * Version of rootLatch when the descent started.
+       */
+      std::uint64_t rootVersion;
+    };
+
+    // KEY TYPE DISPATCH
+    // The typed implementations below are bound once, when the index is opened, so no
+    // per-entry code has to switch on attributeType.
+
+    /**
+     * insertEntry implementation for the key type of the index.
+     */
+    void (BTreeIndex::*insertFn)(const void *key, const RecordId rid, const char *payload);
+
+    /**
+     * deleteEntry implementation for the key type of the index.
+     */
+    bool (BTreeIndex::*deleteFn)(const void *key, const RecordId rid);
+
+    /**
+     * lookup implementation for the key type of the index. With no vector it stops at the first record id, for contains.
+     */
+    size_t (BTreeIndex::*lookupFn)(const void *key, std::vector<RecordId> *out);
+
+    /**
+     * countBelow implementation for the key type of the index.
+     */
+    size_t (BTreeIndex::*countBelowFn)(const void *key, const bool inclusive);
+
+    /**
+     * countRange implementation for the key type of the index, called after the operators are checked.
+     */
+    size_t (BTreeIndex::*countRangeFn)(const void *lowVal, const Operator lowOp, const void *highVal, const Operator highOp);
+
+    /**
+     * select implementation for the key type of the index.
+     */
+    bool (BTreeIndex::*selectFn)(const size_t k, void *outKey, RecordId &outRid);
+
+    /**
+     * openScan implementation for the key type of the index, called after the operators are checked.
+     */
+    void (BTreeIndex::*openScanFn)(ScanCursor &cursor, const void *lowVal, const void *highVal);
+
+    /**
+     * ScanCursor::scanNext implementation for the key type of the index.
+     */
+    void (BTreeIndex::*scanNextFn)(ScanCursor &cursor, RecordId &outRid, char *payload);
+
+    /**
+     * ScanCursor::scanNextBatch implementation for the key type of the index.
+     */
+    size_t (BTreeIndex::*scanNextBatchFn)(ScanCursor &cursor, RecordId *out, char *payloads, size_t max);
+
+    /**
+     * flushWriteBuffer implementation for the key type of the index, called with writeBufferMutex held.
+     */
+    void (BTreeIndex::*flushFn)();
+
+    /**
+     * Point the dispatch members at the implementations for key type T and set the node occupancies.
+     */
+    template <class T>
+    void bindKeyType();
+
+    /**
+     * Open the index file, or create it from the base relation, once the constructor has set the key type,
+     * key columns and attribute offset. See the constructor.
+     */
+    void openIndex(const std::string &relationName, const std::string &indexName, BufMgr *bufMgrIn,
+                   const bool bulkLoadMode, const double fillFactor, const std::vector<PayloadColumn> &payloadColumns,
+                   const BuildOptions &buildOptions);
+
+    /**
+     * Key of type T of a record of the base relation.
+     */
+    template <class T>
+    T recordKey(const char *record) const;
+
+    /**
+     * Create the index file contents for key type T from the base relation. See the constructor.
+     */
+    template <class T>
+    void buildIndex(const std::string &relationName, const bool bulkLoadMode, const double fillFactor,
+                    const BuildOptions &buildOptions);
+
+    /**
+     * Collect the key-rid pairs and payloads of the base relation for a bulk load on numThreads threads.
+     * The relation's pages are split into a contiguous range per thread; each thread reads its pages through
+     * the buffer manager and sorts what it collected into a run, and the runs are then merged.
+     * @param pairs				Set to the key-rid pairs of every record, sorted
+     * @param payloads		Set to the payload of each pair, payloadSize bytes each in the order of pairs
+     */
+    template <class T>
+    void scanRelationParallel(const std::string &relationName, const int numThreads,
+                              std::vector<RIDKeyPair<T> > &pairs, std::vector<char> &payloads);
+
+    /**
+     * Sort pairs in place, moving each payload of payloads along with its pair.
+     */
+    template <class T>
+    void sortPairs(std::vector<RIDKeyPair<T> > &pairs, std::vector<char> &payloads) const;
+
+    /**
+     * Build the tree bottom-up from the given pairs. Sorts the pairs, packs leaves left to right with
+     * fillFactor of their space used and then builds each non-leaf level above in a single pass.
+     * Called on a file holding only the meta page. Sets rootPageNum to the new root.
+     * @param pairs				Key-rid pairs of every record of the relation. Sorted in place unless already sorted.
+     * @param payloads		Payload of each pair, payloadSize bytes each in the order of pairs. Sorted along with them.
+     * @param fillFactor	Fraction (0, 1] of the space of each node to fill
+     */
+    template <class T>
+    void bulkLoad(std::vector<RIDKeyPair<T> > &pairs, std::vector<char> &payloads, const double fillFactor);
+
+    /**
+     * Build the tree bottom-up from the base relation with its pairs sorted by an ExternalSort of the given
+     * memory budget, whose merged output is packed into leaves as it comes. Called as bulkLoad is.
+     */
+    template <class T>
+    void bulkLoadExternal(const std::string &relationName, const double fillFactor, const size_t sortMemory);
+
+    /**
+     * Bytes of each leaf and children of each non-leaf node that a bulk load fills at fillFactor.
+     */
+    template <class T>
+    void bulkLoadFill(const double fillFactor, int &leafFill, int &nodeFill) const;
+
+    /**
+     * Allocate the next leaf of a bulk load with the given sorted entries and link it after prevLeaf, which is
+     * then unpinned. The new leaf is left pinned as the next prevLeaf and added to level with its first key,
+     * which becomes its separator in the level above.
+     */
+    template <class T>
+    void appendLeaf(const T *keys, const RecordId *rids, const char *payloads, const int count,
+                    PageId &prevPageNo, LeafNode<T> *&prevLeaf, std::vector<PageKeyPair<T> > &level);
+
+    /**
+     * Build the non-leaf levels of a bulk load above the given leaves, with nodeFill children each, and make
+     * the single node at the top the root.
+     */
+    template <class T>
+    void buildNonLeafLevels(std::vector<PageKeyPair<T> > &level, const int nodeFill);
+
+    /**
+     * Copy the payload columns of a record, one after the other, to payload.
+     */
+    void extractPayload(const char *record, char *payload) const;
+
+    // LEAF LAYOUT
+    // Readers do not latch leaves, so these cap every count and position they read from one,
+    // keeping a reader that finds it half written inside the page until its version fails to validate.
+
+    /**
+     * Record id of entry i of a leaf.
+     */
+    template <class T>
+    RecordId leafRid(LeafNode<T> *leaf, const int i) const
+    {
+      RecordId rid;
+      memcpy(&rid, leaf->data + i * entrySize, sizeof(RecordId));
+      return rid;
+    }
+
+    /**
+     * Payload of entry i of a leaf.
+     */
+    template <class T>
+    char *leafPayload(LeafNode<T> *leaf, const int i) const
+    {
+      return leaf->data + i * entrySize + sizeof(RecordId);
+    }
+
+    /**
+     * Find the posting list holding entry i of a leaf, with its key and the entries [start, end) it holds.
+     * @param group	Unless NULL, a guess at the index of the list, checked before searching, and receives the index
+     * @return	False if the leaf has no posting list, which only a reader can find
+     */
+    template <class T>
+    bool leafPosting(LeafNode<T> *leaf, const int i, T &key, int &start, int &end, int *group = NULL) const;
+
+    /**
+     * Key of entry i of a leaf.
+     */
+    template <class T>
+    T leafKey(LeafNode<T> *leaf, const int i) const;
+
+    /**
+     * Index of the first entry of a leaf with a key not below key, or above it if upper, like keyLowerBound
+     * and keyUpperBound over the keys of the entries. Searches only the posting lists.
+     */
+    template <class T>
+    int leafBound(LeafNode<T> *leaf, const T &key, const bool upper) const;
+
+    /**
+     * Find the entries [first, end) of a leaf with the given key, empty at leafBound(key) if there are none.
+     */
+    template <class T>
+    void leafRange(LeafNode<T> *leaf, const T &key, int &first, int &end) const;
+
+    /**
+     * Bytes of a leaf used by its entries and posting lists.
+     */
+    template <class T>
+    int leafBytes(LeafNode<T> *leaf) const;
+
+    /**
+     * Bytes n entries with the given keys take in one leaf.
+     */
+    template <class T>
+    int packedBytes(const T *keys, const int n) const;
+
+    /**
+     * Number of the n entries with the given keys to put in the left one of two leaves, evening out their bytes.
+     */
+    template <class T>
+    int splitPoint(const T *keys, const int n) const;
+
+    /**
+     * Number of the n entries with the given keys to put in the left one of two leaves when an append splits
+     * the rightmost leaf: as many as fit in appendFill of a leaf, but no fewer than splitPoint and at least one
+     * short of n.
+     */
+    template <class T>
+    int appendSplitPoint(const T *keys, const int n) const;
+
+    /**
+     * Insert an entry into a leaf that has room for it, after the entries with the same key.
+     */
+    template <class T>
+    void leafInsert(LeafNode<T> *leaf, const T &key, const RecordId rid, const char *payload);
+
+    /**
+     * Remove entry pos of a leaf, and its posting list if it was the last entry of it.
+     */
+    template <class T>
+    void leafRemove(LeafNode<T> *leaf, const int pos);
+
+    /**
+     * Copy the entries of a leaf out to one key, record id and payload per entry.
+     * @param payloads	Receives payloadSize bytes per entry
+     * @return	Number of entries
+     */
+    template <class T>
+    int unpackLeaf(LeafNode<T> *leaf, T *keys, RecordId *rids, char *payloads) const;
+
+    /**
+     * Replace the entries of a leaf with n sorted entries laid out as by unpackLeaf, which must fit.
+     */
+    template <class T>
+    void packLeaf(LeafNode<T> *leaf, const T *keys, const RecordId *rids, const char *payloads, const int n);
+
+    // INSERTION HELPERS
+
+    template <class T>
+    void insertEntryTyped(const void *key, const RecordId rid, const char *payload);
+
+    /**
+     * Descend from the root to the leaf that key belongs in, without latching anything.
+     * Each child is pinned and its version read before the version of its parent is validated.
+     * @param path				Receives the non-leaf nodes visited
+     * @param leafPageNo	Receives the leaf, which is left pinned
+     * @param leafVersion	Receives the version the leaf had while its parent was still valid
+     * @param rightmost		True to go to the last leaf that can hold key, rather than the first, so that
+     * 										every leaf to its right holds only larger keys
+     * @return	False, with nothing pinned, if a node changed on the way and the descent has to restart
+     */
+    template <class T>
+    bool descend(const T &key, DescentPath &path, PageId &leafPageNo, Page *&leaf, std::uint64_t &leafVersion,
+                 const bool rightmost = false);
+
+    /**
+     * Latch the leaf right of a leaf that is about to split or take in its right sibling, whose left sibling
+     * changes. Never waits.
+     * @param sibPageNo	Leaf to latch, -1 if there is none
+     * @return	False if another writer holds it
+     */
+    bool latchRightSibling(const PageId sibPageNo);
+
+    /**
+     * Point the left sibling of a leaf latched with latchRightSibling at a new leaf.
+     */
+    template <class T>
+    void setLeftSibling(const PageId pageNo, const PageId leftPageNo);
+
+    /**
+     * Insert the entry unless a node it reads changes concurrently.
+     * Latches the leaf and the ancestors up to the highest one that a split reaches, and joins the counters of the
+     * ancestors above it, whose entry counts are all that change, all at the versions read on the way down.
+     * @return	False if the insert has to restart, in which case nothing was changed
+     */
+    template <class T>
+    bool tryInsert(const T &key, const RecordId rid, const char *payload);
+
+    /**
+     * Add the new node of a child split to a non-leaf that has room for it, right of the child, with its entry count.
+     * @param index	Index of the child that split. Separators can repeat when duplicates fill several
+     * 				children, so the key alone does not tell where the new node goes.
+     */
+    template <class T>
+    void insert_in_non_leaf(NonLeafNode<T> *node, const int index, const PageKeyPair<T> &changes);
+
+    /**
+     * Split a leaf without room for a new entry into two while inserting the entry, as leafInsert.
+     * The leaves share the bytes evenly, unless append is set, when the left one keeps appendFill of its space.
+     * @param append	True if the node is the rightmost leaf and the entry goes after all of its entries
+     * @return	The new right leaf and its first key, for the parent
+     */
+    template <class T>
+    PageKeyPair<T> split_leaf(const PageId pageNo, LeafNode<T> *node, const T &key, const RecordId rid, const char *payload,
+                              const bool append);
+
+    /**
+     * Split a full non-leaf while adding the new node of a split of its child index, as insert_in_non_leaf.
+     * The nodes share the keys evenly, unless append is set, when the left one keeps appendFill of them.
+     * @param append	True if the node is the rightmost at its level and the new node goes after all of its children
+     * @return	The new right node and the key that moves up, for the parent
+     */
+    template <class T>
+    PageKeyPair<T> split_non_leaf(NonLeafNode<T> *node, const int index, const PageKeyPair<T> &changes, const bool append);
+
+    template <class T>
+    void root_updation(const PageKeyPair<T> &root_changes);
+
+    /**
+     * Latch the ancestors of the leaf at the end of the path that a split of the leaf reaches, and join the
+     * counters of those above, whose entry counts are all an insert changes.
+     * @param split	True if the leaf splits, which reaches every full ancestor up to the first that is not full,
+     * 							and the root pointer if the root is full too
+     * @param top	Set to the depth of the highest ancestor the split reaches, the depth of the leaf if none
+     * @return	False, with none of them latched or joined, if one has changed since the descent
+     */
+    template <class T>
+    bool latchInsertPath(const DescentPath &path, const bool split, int &top, bool &rootLocked);
+
+    /**
+     * Add delta new entries to the entry counts of the ancestors held by latchInsertPath, and the new node
+     * of a leaf split, if any, to its parent, splitting ancestors as far as needed. Releases their latches and
+     * leaves their counters.
+     * @param changes	New leaf of the split, with pageNo -1 if the leaf did not split
+     * @param append	True if the split was an append to the rightmost leaf, so that the rightmost ancestors
+     * 								it splits split as appends too
+     */
+    template <class T>
+    void propagateInsert(const DescentPath &path, const int top, const bool rootLocked, PageKeyPair<T> changes,
+                         const std::uint32_t delta, const bool append);
+
+    /**
+     * Insert the longest prefix of n sorted pairs that belongs in the leaf of the first one, with at most one
+     * split of the leaf, unless a node it reads changes concurrently.
+     * @return	Number of pairs inserted, 0 if the tree changed and nothing was
+     */
+    template <class T>
+    size_t tryInsertRun(const RIDKeyPair<T> *pairs, const size_t n);
+
+    /**
+     * Split a leaf holding count entries into two once the m sorted pairs are merged into its entries,
+     * which must come to more than one leaf holds and no more than two.
+     * @param append	True if the node is the rightmost leaf and the pairs all go after its entries
+     * @return	The new right leaf and its first key, for the parent
+     */
+    template <class T>
+    PageKeyPair<T> splitLeafRun(const PageId pageNo, LeafNode<T> *node, const int count, const RIDKeyPair<T> *pairs, const int m,
+                                const bool append);
+
+    /**
+     * Allocate a page for a new node, taking it from the free page list if no cursor is open.
+     * The page is returned pinned and its contents have to be initialized.
+     */
+    template <class T>
+    void allocNode(PageId &pageNo, Page *&page);
+
+    /**
+     * Put the page of a node that is no longer in the tree on the free page list. The page must be
+     * latched, so that readers still holding it see it change, and pinned; it is unpinned.
+     */
+    template <class T>
+    void freeNode(const PageId pageNo, Page *page);
+
+    // DELETION HELPERS
+
+    template <class T>
+    bool deleteEntryTyped(const void *key, const RecordId rid);
+
+    /**
+     * Delete the entry unless a node it reads changes concurrently.
+     * Latches the leaf and, if it underflows, the parent and a sibling of each node the rebalancing reaches.
+     * @param found	Set to whether the entry was in the index, if the delete did not have to restart
+     * @return	False if the delete has to restart, in which case nothing was changed
+     */
+    template <class T>
+    bool tryDelete(const T &key, const RecordId rid, bool &found);
+
+    /**
+     * Move a path to the leaf right of the one it leads to, for a delete that follows duplicates into it.
+     * @param leafPageNo	The leaf on the right, as read from the sibling pointer of the leaf on the path
+     * @return	False if a node on the way changed or the path does not lead to leafPageNo
+     */
+    template <class T>
+    bool advancePath(DescentPath &path, const PageId leafPageNo);
+
+    /**
+     * Join the counters of the nodes of a path above depth below, bottom-up, at the versions they were read at,
+     * for a writer that only changes their entry counts, so that writers do not serialize on the upper levels.
+     * @return	False, with none of them joined, if one has changed since the descent
+     */
+    bool joinAncestorCounters(const DescentPath &path, const int below);
+
+    /**
+     * Leave the counters joined by joinAncestorCounters.
+     */
+    void leaveAncestorCounters(const DescentPath &path, const int below);
+
+    /**
+     * Add delta to the entry count of the child taken by each node of a path whose nodes are latched or whose
+     * counters are joined. The counts are added atomically, since other writers may add to them at once.
+     */
+    template <class T>
+    void addToCounts(const DescentPath &path, const int delta);
+
+    /**
+     * Rebalance two adjacent leaves, at least one of them underfull, by moving entries from one to the other,
+     * or by merging the right one into the left one if the entries fit in one leaf.
+     * @param parent	Parent of both leaves
+     * @param sepIndex	Index in parent of the separator between the leaves
+     * @return	True if the leaves were merged, removing the separator and the right leaf from parent
+     */
+    template <class T>
+    bool rebalanceLeaves(NonLeafNode<T> *parent, const int sepIndex, LeafNode<T> *left, Page *rightPage);
+
+    /**
+     * Rebalance two adjacent non-leaf nodes through their separator in the parent, like rebalanceLeaves.
+     */
+    template <class T>
+    bool rebalanceNonLeaves(NonLeafNode<T> *parent, const int sepIndex, NonLeafNode<T> *left, Page *rightPage);
+
+    // LOOKUP HELPERS
+
+    template <class T>
+    size_t lookupTyped(const void *key, std::vector<RecordId> *out);
+
+    /**
+     * Find the entries with the given key unless a node it reads changes concurrently, following
+     * the leaf chain while duplicates of key run on into the next leaf.
+     * @param out	Vector the record ids are appended to, or NULL to stop at the first one
+     * @param count	Set to the number of entries found, if the lookup did not have to restart
+     * @return	False if the lookup has to restart, in which case out is as it was
+     */
+    template <class T>
+    bool tryLookup(const T &key, std::vector<RecordId> *out, size_t &count);
+
+    // COUNTING HELPERS
+
+    /**
+     * Number of entries with keys below key, or up to it if inclusive. Descends one path, adding
+     * up the entry counts of the children left of it.
+     */
+    template <class T>
+    size_t countBelowTyped(const void *key, const bool inclusive);
+
+    /**
+     * countBelow unless a node it reads changes concurrently.
+     * @return	False if the count has to restart
+     */
+    template <class T>
+    bool tryCountBelow(const T &key, const bool inclusive, size_t &count);
+
+    template <class T>
+    size_t countRangeTyped(const void *lowVal, const Operator lowOp, const void *highVal, const Operator highOp);
+
+    template <class T>
+    bool selectTyped(const size_t k, void *outKey, RecordId &outRid);
+
+    /**
+     * select unless a node it reads changes concurrently.
+     * @param found	Set to whether the index has more than k entries, if the select did not have to restart
+     * @return	False if the select has to restart
+     */
+    template <class T>
+    bool trySelect(const size_t k, T &outKey, RecordId &outRid, bool &found);
+
+    // SCAN HELPERS
+
+    friend class ScanCursor;
+
+    template <class T>
+    void openScanTyped(ScanCursor &cursor, const void *lowVal, const void *highVal);
+
+    template <class T>
+    void scanNextTyped(ScanCursor &cursor, RecordId &outRid, char *payload);
+
+    template <class T>
+    size_t scanNextBatchTyped(ScanCursor &cursor, RecordId *out, char *payloads, size_t max);
+
+    /**
+     * Position the cursor on the next entry it has not returned, moving right through the leaves as needed,
+     * and copy that entry out while the leaf is unchanged.
+     * @param payload	Receives the payload of the entry, unless NULL
+     * @param postingStart	Receives, unless NULL, the first entry of the posting list of the entry, at the leaf
+     * 										version the cursor is left at
+     * @param postingEnd	Receives one past the last entry of that posting list
+     * @return	False if there are no more entries in the index
+     */
+    template <class T>
+    bool peekEntry(ScanCursor &cursor, T &key, RecordId &rid, char *payload = NULL, int *postingStart = NULL,
+                   int *postingEnd = NULL);
+
+    /**
+     * peekEntry for a reverse scan: position the cursor on the next entry below those returned,
+     * moving left through the leaves as needed.
+     */
+    template <class T>
+    bool peekEntryReverse(ScanCursor &cursor, T &key, RecordId &rid, char *payload = NULL, int *postingStart = NULL,
+                          int *postingEnd = NULL);
+
+    /**
+     * scanNextBatch of a reverse scan, checking the low bound once per leaf.
+     */
+    template <class T>
+    size_t scanNextBatchReverse(ScanCursor &cursor, RecordId *out, char *payloads, size_t max);
+
+    /**
+     * scanPosition for a reverse scan: one past the index of the last entry of the leaf not yet returned.
+     * Entries are told apart by key and, among duplicates of the last key returned, by the record ids returned.
+     * @return	-1 if entries the cursor has not returned may have moved to the leaf on the right
+     */
+    template <class T>
+    int scanPositionReverse(ScanCursor &cursor, LeafNode<T> *node, const bool unchanged);
+
+    /**
+     * Index in the current leaf of the cursor of the first entry the cursor has not returned.
+     * Called when the cursor has just moved to the leaf, or the leaf has changed since the cursor last positioned itself in it.
+     * @param unchanged	True if the leaf is at the version the cursor moved to it at
+     * @return	-1 if entries the cursor has not returned may have moved to the leaf on the left, or the leaf may have been freed
+     */
+    template <class T>
+    int scanPosition(ScanCursor &cursor, LeafNode<T> *node, const bool unchanged);
+
+    /**
+     * Move the cursor to the leaf that its next entry is in, found from the root. For a reverse scan,
+     * the last leaf that can hold it.
+     */
+    template <class T>
+    void relocate(ScanCursor &cursor);
+
+    /**
+     * Move the cursor to the right sibling of its leaf, or the left one for a reverse scan, and read ahead.
+     * @param sibPageNo	Sibling, read from the leaf at version
+     * @return	False, leaving the cursor where it is, if the leaf has changed since version
+     */
+    template <class T>
+    bool moveToLeaf(ScanCursor &cursor, const PageId sibPageNo, const std::uint64_t version);
+
+    /**
+     * Bring the leaves in the readahead window of the cursor into the buffer pool.
+     * The leaves are the next children of the parent of the current leaf, so none has to be read to find the next.
+     */
+    template <class T>
+    void readAhead(ScanCursor &cursor);
+
+    /**
+     * Find the parent of the given leaf and its index among the children of the parent.
+     * @param key	First key of the leaf
+     * @return	False if the leaf was not found, or the tree changed while looking
+     */
+    template <class T>
+    bool findParent(const T &key, const PageId leafPageNo, PageId &parentPageNo, int &index);
+
+    /**
+     * Unpin the leaf of an open cursor and mark it closed.
+     */
+    void closeScan(ScanCursor &cursor);
+
+    /**
+     * Wait while a snapshot is being taken and count an insert or delete in.
+     */
+    void beginWrite();
+
+    /**
+     * Count an insert or delete out.
+     */
+    void endWrite()
+    {
+      activeWriters--;
+    }
+
+    /**
+     * Take a snapshot once the inserts and deletes in progress are done and return its epoch.
+     * @param rootPageNo	Root of the tree in the snapshot
+     */
+    std::uint64_t openSnapshot(PageId &rootPageNo);
+
+    /**
+     * Release a snapshot and free the node copies that no open snapshot reads any more.
+     */
+    void closeSnapshot(const std::uint64_t epoch);
+
+    /**
+     * Copy a node that is about to change for the open snapshots, unless it has been copied for the newest one
+     * already. The caller holds the latch of the node.
+     */
+    void preserveNode(const PageId pageNo);
+
+    /**
+     * preserveNode for the nodes of the path from depth top down, which an insert or delete changes.
+     */
+    void preservePath(const DescentPath &path, const int top);
+
+    /**
+     * Copy a node as a snapshot sees it: the oldest copy made for a snapshot at least as new, or else the page as it is now.
+     * @param out	Page::SIZE bytes
+     */
+    void readSnapshotNode(const PageId pageNo, const std::uint64_t epoch, char *out);
+
+    /**
+     * openScanTyped for a snapshot scan: take the snapshot and find the first entry as of it, from its root.
+     */
+    template <class T>
+    void openSnapshotScan(ScanCursor &cursor);
+
+    /**
+     * Move a snapshot scan on to its next entry, through the leaves of the snapshot as needed.
+     * @return	False if there are no more entries in the snapshot
+     */
+    template <class T>
+    bool peekSnapshotEntry(ScanCursor &cursor);
+
+    /**
+     * scanNextBatch of a snapshot scan, in either direction.
+     */
+    template <class T>
+    size_t scanSnapshotBatch(ScanCursor &cursor, RecordId *out, char *payloads, size_t max);
+
+    /**
+     * Insert the write buffer into the tree and empty it, with writeBufferMutex held.
+     */
+    template <class T>
+    void flushWriteBufferTyped();
+
+    /**
+     * Find the entries held in the write buffer with keys from low to high, each bound included if its flag is set,
+     * first sorting the inserts that came since the last such read into the runs of the buffer.
+     * @param out	Vector the record ids are appended to, or NULL
+     * @param flushes	Set to writeBufferFlushes, which the caller checks once it has read the tree as well
+     * @return	Number of entries found
+     */
+    template <class T>
+    size_t readWriteBuffer(const T &low, const bool lowInclusive, const T &high, const bool highInclusive,
+                           std::vector<RecordId> *out, std::uint64_t &flushes);
+
+    /**
+     * Insert pairs sorted by key with one descent per leaf they go into. See insertBatch.
+     */
+    template <class T>
+    void insertSorted(const RIDKeyPair<T> *pairs, const size_t n);
+
+    /**
+     * Pin a node on the way down and read its version, from the frame it is swizzled to or the hot-node cache if
+     * either holds the node and through the buffer manager otherwise.
+     * @return	True if the node came from a swizzled frame or the cache, which keep it pinned
+     */
+    bool pinNode(const PageId pageNo, Page *&page, std::uint64_t &version);
+
+    /**
+     * Unpin a node pinned by pinNode, unless it came from a swizzled frame or the hot-node cache.
+     */
+    void unpinNode(const PageId pageNo, const bool hot)
+    {
+      if (!hot)
+      {
+        bufMgr->unPinPage(file, pageNo, false);
+      }
+    }
+
+    /**
+     * Hand the pin of a non-leaf node that a descent has validated, depth levels below the root, over to the
+     * swizzled nodes while swizzling is on and below its limit, or else to the hot-node cache, if the cache takes
+     * nodes that deep and has a free slot.
+     * @return	True if the node was swizzled or the cache took the pin
+     */
+    bool keepHot(const PageId pageNo, Page *page, const int depth);
+
+    /**
+     * Take a node out of the hot-node cache or unswizzle it, and unpin it. The caller holds the latch of the node.
+     */
+    void dropHotNode(const PageId pageNo);
+
+    /**
+     * Take the nodes out of the hot-node cache after the root has changed level, so that the cache fills again
+     * with the new top levels. Nodes that another thread has latched are left, unless all is set, for when no
+     * other thread uses the index.
+     */
+    void dropHotNodes(const bool all);
+
+    /**
+     * Unswizzle the swizzled nodes and unpin them. Nodes that another thread has latched are left, unless all is
+     * set, for when no other thread uses the index.
+     */
+    void unswizzleNodes(const bool all);
+
+    /**
+     * Flush the write buffer unless it is empty, so that what follows sees every insert that has returned.
+     */
+    void applyWriteBuffer()
+    {
+      if (bufferedInserts > 0)
+      {
+        flushWriteBuffer();
+      }
+    }
 
   public:
     /**
      * BTreeIndex Constructor.
      * Check to see if the corresponding index file exists. If so, open the file.
-     * If not, create it and insert entries for every tuple in the base relation using FileScan class.
+     * If not, create it and add entries for every tuple in the base relation using FileScan class.
+     * In bulk-load mode the (key, rid) pairs are collected, sorted and packed into the tree bottom-up;
+     * otherwise every pair is inserted with insertEntry.
      *
      * @param relationName        Name of file.
      * @param outIndexName        Return the name of index file.
      * @param bufMgrIn						Buffer Manager Instance
      * @param attrByteOffset			Offset of attribute, over which index is to be built, in the record
      * @param attrType						Datatype of attribute over which index is built
+     * @param bulkLoadMode				True to build a new index bottom-up instead of inserting one entry at a time
+     * @param fillFactor					Fraction (0, 1] of the space of each node filled by the bulk loader
+     * @param payloadColumns			Attributes to store with each entry, making a covering index. Leaves hold
+     * 														fewer entries the more payload bytes they store.
+     * @param buildOptions				How a bulk load scans the relation and sorts its pairs
+     * @throws  BadIndexInfoException If an existing index file was built differently, or the payload columns are
+     * 														more than MAX_PAYLOAD_COLUMNS or longer than MAX_PAYLOAD_SIZE together
+     */
+    BTreeIndex(const std::string &relationName, std::string &outIndexName,
+               BufMgr *bufMgrIn, const int attrByteOffset, const Datatype attrType,
+               const bool bulkLoadMode = true, const double fillFactor = DEFAULT_FILL_FACTOR,
+               const std::vector<PayloadColumn> &payloadColumns = std::vector<PayloadColumn>(),
+               const BuildOptions &buildOptions = BuildOptions());
+
+    /**
+     * BTreeIndex Constructor for a COMPOSITE index, whose key is made of several attributes. Its keys are
+     * CompositeKeys, and the key parameters of the other methods point to ones made with compositeKey.
+     * The index file is named after the relation and the offsets of the key columns.
+     *
+     * @param keyColumns					Attributes making up the key, most significant first
+     * @throws  BadIndexInfoException If an existing index file was built differently, the key columns are none,
+     * 														more than MAX_KEY_COLUMNS or longer than COMPOSITESIZE encoded, or the payload
+     * 														columns do not fit
+     * See the other constructor for the other parameters.
      */
     BTreeIndex(const std::string &relationName, std::string &outIndexName,
-               BufMgr *bufMgrIn, const int attrByteOffset, const Datatype attrType);
+               BufMgr *bufMgrIn, const std::vector<KeyColumn> &keyColumns,
+               const bool bulkLoadMode = true, const double fillFactor = DEFAULT_FILL_FACTOR,
+               const std::vector<PayloadColumn> &payloadColumns = std::vector<PayloadColumn>(),
+               const BuildOptions &buildOptions = BuildOptions());
 
     /**
      * BTreeIndex Destructor.
      * End any initialized scan, flush index file, after unpinning any pinned pages, from the buffer manager
      * and delete file instance thereby closing the index file.
+     * Cursors returned by openScan must be closed before the index is destroyed.
      * Destructor should not throw any exceptions. All exceptions should be caught in here itself.
      * */
     ~BTreeIndex();
@@ -323,24 +2054,147 @@ namespace badgerdb
      * Make sure to unpin pages as soon as you can.
      * @param key			Key to insert, pointer to integer/double/char string
      * @param rid			Record ID of a record whose entry is getting inserted into the index.
+     * @throws  BadIndexInfoException If the index is a covering index, which needs the record for the payload
      **/
     void insertEntry(const void *key, const RecordId rid);
 
-    PageKeyPair<int> navigate(const PageId pageNo, const void *key, const RecordId rid);
+    /**
+     * Insert a new entry as insertEntry(key, rid), copying the payload columns of a covering index from the record.
+     * @param record		Record whose entry is getting inserted
+     **/
+    void insertEntry(const void *key, const RecordId rid, const char *record);
+
+    /**
+     * Delete the entry for the pair <key,rid>. A leaf left less than half full takes entries from a sibling under
+     * the same parent, or merges with it if their entries fit in one leaf, and the parent loses the separator and
+     * may underflow in turn, up to the root. A root left with a single non-leaf child is replaced by that child.
+     * Pages of merged nodes go on a free page list in the index file and are reused by later splits.
+     * When duplicates of key fill several leaves, the delete follows them to the leaf that holds the entry, which is
+     * rebalanced like any other.
+     * @param key			Key of the entry, pointer to integer/double/char string
+     * @param rid			Record ID of the entry
+     * @return	False if the index has no entry for the pair
+     **/
+    bool deleteEntry(const void *key, const RecordId rid);
+
+    /**
+     * Insert many entries at once. The pairs are sorted and inserted in key order with one descent from the
+     * root per leaf they go into: each leaf takes all the pairs up to the separator on its right before the
+     * next descent, splitting once if they do not fit, and the split goes up level by level as for insertEntry.
+     * Duplicates go after the entries already in the index with the same key.
+     * @param pairs		Pairs to insert, in any order
+     * @param n				Number of pairs
+     * @throws  BadIndexInfoException If T is not the key type of the index, or the index is a covering index
+     **/
+    template <class T>
+    void insertBatch(const RIDKeyPair<T> *pairs, size_t n);
+
+    /**
+     * Turn on write-optimized inserts. insertEntry then only adds the entry to an in-memory write buffer of up to
+     * capacity entries, which is inserted into the tree as insertBatch inserts its pairs when it fills, so that
+     * random keys cost one descent per leaf per flush rather than one per entry. lookup, contains and countRange
+     * search the buffer alongside the tree without flushing it, and the buffer is flushed before any rank, select,
+     * scan, delete or batch insert, so all of them see every insert that has returned. It is also flushed when the
+     * index is destroyed. Entries still in the buffer are lost if the process dies.
+     * @param capacity	Most entries held back, 0 to insert every entry right away again
+     * @throws  BadIndexInfoException If the index is a covering index, whose payloads are not buffered
+     **/
+    void setWriteBuffer(const size_t capacity);
+
+    /**
+     * Insert every entry held in the write buffer into the tree.
+     **/
+    void flushWriteBuffer();
+
+    /**
+     * Set how many levels of the tree, from the root down, the hot-node cache takes non-leaf nodes from,
+     * DEFAULT_HOT_LEVELS when the index is opened. Descents read the nodes it holds, up to MAX_HOT_NODES, with
+     * no buffer manager call, and those nodes stay pinned, out of reach of the replacement policy. Changing it
+     * empties the cache.
+     * @param levels	Levels to cache, 0 to turn the cache off
+     **/
+    void setHotLevels(const int levels);
+
+    /**
+     * Turn on swizzling, for an index whose non-leaf nodes fit in the buffer pool. The non-leaf nodes descents pass
+     * through, up to maxNodes of them at any level, then stay pinned and the latch table maps their page numbers
+     * straight to their frames, so that each hop down to one of them follows a pointer instead of looking the page
+     * up in the buffer manager. Pages on disk keep their page numbers. Turning it off unswizzles and unpins the
+     * nodes, as does closing the index before its pages are written back.
+     * @param maxNodes	Most non-leaf nodes to swizzle, 0 to turn swizzling off
+     **/
+    void setSwizzling(const int maxNodes);
+
+    /**
+     * Set how full an append leaves the rightmost leaf or non-leaf it splits, DEFAULT_APPEND_FILL when the
+     * index is opened. An insert past the last key of the rightmost leaf that splits it is taken for one of
+     * a run of increasing keys, so the left leaf keeps this fraction of its space rather than half, and the
+     * rightmost non-leaf nodes the split reaches keep this fraction of their keys. At 1 the left nodes stay
+     * full and the new ones start empty but for the new entry; at 0.5 appends split evenly like other inserts.
+     * @param fill	Fraction in [0.5, 1]; values outside are clamped
+     **/
+    void setAppendFill(const double fill);
+
+    /**
+     * Buffer manager calls that descents have saved by finding nodes swizzled or in the hot-node cache: a readPage
+     * and an unPinPage for every node found.
+     **/
+    std::uint64_t getBufferCallsSaved() const { return 2 * hotHits.load(std::memory_order_relaxed); }
 
-    PageId get_next_node(NonLeafNodeInt *this_node, const void *key);
+    /**
+     * Node copies writers keep for the open snapshot scans, 0 once none is open.
+     **/
+    size_t getSnapshotCopies() const { return nodeCopyCount; }
 
-    PageKeyPair<int> go_to_leaf(const PageId pageNo, const void *key, const RecordId rid);
+    /**
+     * Inserts the write buffer holds back, 0 once it is flushed.
+     **/
+    size_t getBufferedInserts() const { return bufferedInserts; }
 
-    void insert_in_leaf(LeafNodeInt *node, const void *key, const RecordId rid);
+    /**
+     * Find the record ids of all entries with the given key, with one descent from the root.
+     * Unlike a scan from key to key, it opens no cursor and throws no exception when there is no entry.
+     * @param key			Key to look up, pointer to integer/double/char string
+     * @param out			Vector the record ids are appended to, in index order, those still in the write buffer last
+     * @return	Number of record ids appended, 0 if the key is not in the index
+     **/
+    size_t lookup(const void *key, std::vector<RecordId> &out);
 
-    void insert_in_non_leaf(NonLeafNodeInt *node, const PageKeyPair<int> changes);
+    /**
+     * Return whether the index has an entry with the given key. Like lookup, but stops at the first entry.
+     * @param key			Key to look up, pointer to integer/double/char string
+     **/
+    bool contains(const void *key);
 
-    PageKeyPair<int> split_leaf(LeafNodeInt *node, const void *key, const RecordId rid);
+    /**
+     * Count the entries in a key range, with the range semantics of openScan but no exception for an empty range.
+     * Non-leaf nodes keep the number of entries below each child, so only the nodes on the paths to the two ends
+     * of the range are read, however many entries it holds. Entries inserted or deleted concurrently may or may
+     * not be counted.
+     * @param lowVal	Low value of range, pointer to integer / double / char string
+     * @param lowOp		Low operator (GT/GTE)
+     * @param highVal	High value of range, pointer to integer / double / char string
+     * @param highOp	High operator (LT/LTE)
+     * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
+     * @throws  BadScanrangeException If lowVal > highval
+     **/
+    size_t countRange(const void *lowVal, const Operator lowOp, const void *highVal, const Operator highOp);
 
-    PageKeyPair<int> split_non_leaf(NonLeafNodeInt *node, const PageKeyPair<int> changes);
+    /**
+     * Number of entries with a key below the given one, which is the position in index order of the first
+     * entry with a key at or above it. Reads one path from the root.
+     * @param key			Key to rank, pointer to integer/double/char string
+     **/
+    size_t rank(const void *key);
 
-    void root_updation(PageKeyPair<int> root_changes);
+    /**
+     * Find the entry at position k in index order, counting from 0. Reads one path from the root.
+     * @param k				Position of the entry
+     * @param outKey	Receives the key of the entry, pointer to integer / double / STRINGSIZE chars, not null terminated / CompositeKey
+     * @param outRid	Receives the record id of the entry
+     * @return	False, leaving the outputs as they were, if the index has k entries or fewer
+     **/
+    bool select(const size_t k, void *outKey, RecordId &outRid);
 
     /**
      * Begin a filtered scan of the index.  For instance, if the method is called
@@ -359,6 +2213,53 @@ namespace badgerdb
      **/
     void startScan(const void *lowVal, const Operator lowOp, const void *highVal, const Operator highOp);
 
+    /**
+     * Open an independent scan of the index, with the same range semantics as startScan.
+     * The returned cursor keeps its own position and pins only its current leaf, so any number
+     * of cursors can be open on the index at once, alongside the scan run by startScan.
+     * @param lowVal	Low value of range, pointer to integer / double / char string
+     * @param lowOp		Low operator (GT/GTE)
+     * @param highVal	High value of range, pointer to integer / double / char string
+     * @param highOp	High operator (LT/LTE)
+     * @param options	Readahead settings of the scan
+     * @return	Open cursor positioned on the first matching entry
+     * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
+     * @throws  BadScanrangeException If lowVal > highval
+     * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that satisfies the scan criteria.
+     **/
+    ScanCursor openScan(const void *lowVal, const Operator lowOp, const void *highVal, const Operator highOp,
+                        const ScanOptions &options = ScanOptions());
+
+    /**
+     * Open an independent scan of the index that returns entries in descending key order, starting at the
+     * high bound and following the left sibling links, so that the first N entries below a key cost one
+     * descent and N entries. Duplicates come back in the reverse of their order in a forward scan.
+     * Takes the same parameters and throws the same exceptions as openScan.
+     **/
+    ScanCursor openReverseScan(const void *lowVal, const Operator lowOp, const void *highVal, const Operator highOp,
+                               const ScanOptions &options = ScanOptions());
+
+    /**
+     * Make the key of a COMPOSITE index from the values of its leading key columns. Each value is encoded so
+     * that keys compare byte by byte as their values do: integers and doubles big-endian with their sign
+     * flipped, strings as their first STRINGSIZE characters. The columns after the first count are filled with
+     * the lowest bytes, or the highest if high is set, making the smallest or largest key with that prefix.
+     * @param values	Pointers to the values of the first count key columns, integer / double / char string
+     * @param count		Number of values, up to the number of key columns
+     * @param high		True to fill the missing columns with the highest bytes instead of the lowest
+     * @throws  BadIndexInfoException If the index is not a COMPOSITE index or has fewer than count key columns
+     **/
+    CompositeKey compositeKey(const void *const *values, const int count, const bool high = false) const;
+
+    /**
+     * Open a scan of the entries of a COMPOSITE index whose leading key columns have the given values,
+     * which lie in one contiguous range of leaves. Same as openScan from compositeKey(values, count) GTE to
+     * compositeKey(values, count, true) LTE.
+     * @throws  BadIndexInfoException If the index is not a COMPOSITE index or has fewer than count key columns
+     * @throws  NoSuchKeyFoundException If no entry has that prefix
+     **/
+    ScanCursor openPrefixScan(const void *const *values, const int count, const ScanOptions &options = ScanOptions());
+
     /**
      * Fetch the record id of the next index entry that matches the scan.
      * Return the next record from current page being scanned. If current page has been scanned to its entirety, move on to the right sibling of current page, if any exists, to start scanning that page. Make sure to unpin any pages that are no longer required.
@@ -368,6 +2269,31 @@ namespace badgerdb
      **/
     void scanNext(RecordId &outRid); // returned record id
 
+    /**
+     * Fetch the next entry of the scan started by startScan with its payload. See ScanCursor::scanNext.
+     **/
+    void scanNext(RecordId &outRid, char *payload);
+
+    /**
+     * Fetch the record ids of up to max next index entries that match the scan started by startScan.
+     * See ScanCursor::scanNextBatch.
+     * @param out	Array receiving the record ids
+     * @param max	Capacity of out
+     * @return	Number of record ids stored in out. Zero once the scan is complete.
+     * @throws ScanNotInitializedException If no scan has been initialized.
+     **/
+    size_t scanNextBatch(RecordId *out, size_t max);
+
+    /**
+     * Fetch the next entries of the scan started by startScan with their payloads. See ScanCursor::scanNextBatch.
+     **/
+    size_t scanNextBatch(RecordId *out, char *payloads, size_t max);
+
+    /**
+     * Bytes of payload stored with each entry, 0 unless the index is a covering index.
+     **/
+    int getPayloadSize() const { return payloadSize; }
+
     /**
      * Terminate the current scan. Unpin any pinned pages. Reset scan specific variables.
      * @throws ScanNotInitializedException If no scan has been initialized.
@@ -118,8 +118,9 @@ void BufMgr::allocBuf(FrameId & frame)
 } // end allocBuf
 
 	
-void BufMgr::readPage(File* file, const PageId pageNo, Page*& page)
+bool BufMgr::readPage(File* file, const PageId pageNo, Page*& page)
 {
+  std::lock_guard<std::mutex> guard(mutex);
   // check to see if it is already in the buffer pool
   // std::cout << "readPage called on file.page " << file << "." << pageNo << endl;
   FrameId frameNo = 0;
@@ -131,6 +132,7 @@ void BufMgr::readPage(File* file, const PageId pageNo, Page*& page)
     bufDescTable[frameNo].refbit = true;
     bufDescTable[frameNo].pinCnt++;
     page = &bufPool[frameNo];
+    return false;
   }
   catch(const HashNotFoundException &e) //not in the buffer pool, must allocate a new page
   {
@@ -148,12 +150,49 @@ void BufMgr::readPage(File* file, const PageId pageNo, Page*& page)
 
     // insert in the hash table
     hashTable->insert(file, pageNo, frameNo);
+    return true;
   }
 }
 
 
+bool BufMgr::prefetchPage(File* file, const PageId pageNo)
+{
+  std::lock_guard<std::mutex> guard(mutex);
+  FrameId frameNo = 0;
+  try
+  {
+    hashTable->lookup(file, pageNo, frameNo);
+    return false;
+  }
+  catch(const HashNotFoundException &e)
+  {
+  }
+
+  try
+  {
+    allocBuf(frameNo);
+  }
+  catch(const BufferExceededException &e)
+  {
+    // every frame is pinned; readahead is only a hint
+    return false;
+  }
+
+  bufStats.diskreads++;
+  bufPool[frameNo] = file->readPage(pageNo);
+
+  // set up the entry as for readPage, but leave the page unpinned
+  bufDescTable[frameNo].Set(file, pageNo);
+  bufDescTable[frameNo].pinCnt = 0;
+
+  hashTable->insert(file, pageNo, frameNo);
+  return true;
+}
+
+
 void BufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty) 
 {
+  std::lock_guard<std::mutex> guard(mutex);
   // lookup in hashtable
   FrameId frameNo = 0;
   hashTable->lookup(file, pageNo, frameNo);
@@ -170,6 +209,7 @@ void BufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty)
 
 void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page) 
 {
+  std::lock_guard<std::mutex> guard(mutex);
   FrameId frameNo;
 
   // alloc a new frame
@@ -189,6 +229,7 @@ void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page)
 
 void BufMgr::flushFile(const File* file) 
 {
+  std::lock_guard<std::mutex> guard(mutex);
   for (std::uint32_t i = 0; i < numBufs; i++)
 	{
   	BufDesc* tmpbuf = &(bufDescTable[i]);
@@ -214,6 +255,7 @@ void BufMgr::flushFile(const File* file)
 
 void BufMgr::disposePage(File* file, const PageId pageNo)
 {
+  std::lock_guard<std::mutex> guard(mutex);
 	//Deallocate from file altogether
   //See if it is in the buffer pool
   FrameId frameNo = 0;
@@ -228,8 +270,21 @@ void BufMgr::disposePage(File* file, const PageId pageNo)
   file->deletePage(pageNo);
 }
 
+std::uint32_t BufMgr::getUnpinnedFrames()
+{
+  std::lock_guard<std::mutex> guard(mutex);
+  std::uint32_t unpinned = 0;
+  for (std::uint32_t i = 0; i < numBufs; i++)
+  {
+    if (!bufDescTable[i].valid || bufDescTable[i].pinCnt == 0)
+      unpinned++;
+  }
+  return unpinned;
+}
+
 void BufMgr::printSelf(void) 
 {
+  std::lock_guard<std::mutex> guard(mutex);
   BufDesc* tmpbuf;
 	int validFrames = 0;
   
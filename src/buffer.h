@@ -10,6 +10,7 @@
 #include "file.h"
 #include "bufHashTbl.h"
 #include <iostream>
+#include <mutex>
 
 namespace badgerdb {
 
@@ -186,6 +187,11 @@ class BufMgr
 	 */
   BufStats bufStats;
 
+	/**
+   * Serializes the public operations, so that the buffer pool can be shared by threads
+	 */
+  std::mutex mutex;
+
 	/**
    * Advance clock to next frame in the buffer pool
 	 */
@@ -226,8 +232,9 @@ class BufMgr
 	 * @param file   	File object
 	 * @param PageNo  Page number in the file to be read
 	 * @param page  	Reference to page pointer. Used to fetch the Page object in which requested page from file is read in.
+	 * @return	True if the page was not in the buffer pool and had to be read from disk
 	 */
-  void readPage(File* file, const PageId PageNo, Page*& page);
+  bool readPage(File* file, const PageId PageNo, Page*& page);
 
 	/**
 	 * Unpin a page from memory since it is no longer required for it to remain in memory.
@@ -249,6 +256,16 @@ class BufMgr
 	 */
   void allocPage(File* file, PageId &PageNo, Page*& page); 
 
+	/**
+	 * Brings a page of the file into the buffer pool without pinning it, so that a later readPage
+	 * finds it there. Does nothing if the page is already in the pool or no frame can be freed.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number
+	 * @return	True if the page was read from disk
+	 */
+  bool prefetchPage(File* file, const PageId PageNo);
+
 	/**
 	 * Writes out all dirty pages of the file to disk.
 	 * All the frames assigned to the file need to be unpinned from buffer pool before this function can be successfully called.
@@ -270,6 +287,12 @@ class BufMgr
   void disposePage(File* file, const PageId PageNo);
 
 	/**
+	 * Number of frames that no page is pinned in, which a caller can still pin pages in as long as
+	 * no one else pins them first.
+	 */
+  std::uint32_t getUnpinnedFrames();
+
+	/**
    * Print member variable values. 
 	 */
   void  printSelf();
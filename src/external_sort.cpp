@@ -0,0 +1,331 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "external_sort.h"
+#include "exceptions/end_of_file_exception.h"
+#include "exceptions/file_exists_exception.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <sstream>
+
+namespace badgerdb {
+
+/**
+ * Numbers the temporary files of the sorts of this process.
+ */
+static std::atomic<int> sortFileCounter(0);
+
+ExternalSort::ExternalSort(BufMgr *bufMgr, const int recordSize, const size_t memoryBudget, const RecordLess &less,
+                           const int readerPins)
+  : bufMgr(bufMgr), recordSize(recordSize), memoryBudget(memoryBudget), readerPins(readerPins), less(less), file(NULL),
+    outPage(NULL), outPageNo(Page::INVALID_NUMBER), outOffset(0), merging(false), numRecords(0), numRuns(0),
+    numMerges(0), numPagesWritten(0)
+{
+  runCapacity = std::max((size_t)1, memoryBudget / (recordSize + sizeof(const char *)));
+  fanIn = (int)std::max((size_t)2, memoryBudget / Page::SIZE);
+}
+
+ExternalSort::~ExternalSort()
+{
+  try
+  {
+    closeMerge();
+    endRun();
+    if (file != NULL)
+    {
+      bufMgr->flushFile(file);
+    }
+  }
+  catch (...)
+  {
+  }
+  if (file != NULL)
+  {
+    delete file;
+    try
+    {
+      File::remove(fileName);
+    }
+    catch (...)
+    {
+    }
+  }
+}
+
+void ExternalSort::add(const char *record)
+{
+  if (buffer.empty())
+  {
+    buffer.reserve(runCapacity * recordSize);
+  }
+  buffer.insert(buffer.end(), record, record + recordSize);
+  numRecords++;
+  if (buffer.size() == runCapacity * recordSize)
+  {
+    spill();
+  }
+}
+
+void ExternalSort::sortBuffer()
+{
+  const size_t count = buffer.size() / recordSize;
+  order.resize(count);
+  for (size_t i = 0; i < count; i++)
+  {
+    order[i] = &buffer[i * recordSize];
+  }
+  const RecordLess &less = this->less;
+  std::stable_sort(order.begin(), order.end(), [&less](const char *a, const char *b) { return less(a, b); });
+}
+
+void ExternalSort::spill()
+{
+  sortBuffer();
+  while (file == NULL)
+  {
+    std::ostringstream name;
+    name << "external_sort." << sortFileCounter++;
+    try
+    {
+      file = new BlobFile(name.str(), true);
+      fileName = name.str();
+    }
+    catch (const FileExistsException &e)
+    {
+    }
+  }
+  Run run;
+  run.firstPageNo = Page::INVALID_NUMBER;
+  run.count = 0;
+  for (size_t i = 0; i < order.size(); i++)
+  {
+    writeRecord(run, order[i]);
+  }
+  endRun();
+  runs.push_back(run);
+  numRuns++;
+  buffer.clear();
+  order.clear();
+}
+
+void ExternalSort::writeRecord(Run &run, const char *record)
+{
+  // A record goes on from the end of one page to the start of the next, which the file allocates right after it
+  int copied = 0;
+  while (copied < recordSize)
+  {
+    if (outPage == NULL || outOffset == Page::SIZE)
+    {
+      endRun();
+      bufMgr->allocPage(file, outPageNo, outPage);
+      outOffset = 0;
+      numPagesWritten++;
+      if (run.firstPageNo == Page::INVALID_NUMBER)
+      {
+        run.firstPageNo = outPageNo;
+      }
+    }
+    const int n = std::min(recordSize - copied, (int)Page::SIZE - outOffset);
+    memcpy((char *)outPage + outOffset, record + copied, n);
+    copied += n;
+    outOffset += n;
+  }
+  run.count++;
+}
+
+void ExternalSort::endRun()
+{
+  if (outPage != NULL)
+  {
+    bufMgr->unPinPage(file, outPageNo, true);
+    outPage = NULL;
+  }
+}
+
+void ExternalSort::openMerge(const size_t first, const size_t count, const bool withMemory)
+{
+  inputs.resize(count + (withMemory ? 1 : 0));
+  for (size_t i = 0; i < inputs.size(); i++)
+  {
+    RunReader &in = inputs[i];
+    in.page = NULL;
+    in.offset = 0;
+    if (i < count)
+    {
+      in.memory = NULL;
+      in.pageNo = runs[first + i].firstPageNo;
+      in.left = runs[first + i].count;
+      in.record.resize(recordSize);
+    }
+    else
+    {
+      in.memory = order.empty() ? NULL : &order[0];
+      in.pageNo = Page::INVALID_NUMBER;
+      in.left = order.size();
+    }
+    advance(in);
+  }
+
+  // Play the matches bottom-up, keeping the loser at each node and passing the winner on
+  const int k = (int)inputs.size();
+  std::vector<int> winners(2 * k);
+  tree.assign(std::max(k, 1), 0);
+  for (int i = 0; i < k; i++)
+  {
+    winners[k + i] = i;
+  }
+  for (int n = k - 1; n > 0; n--)
+  {
+    const int a = winners[2 * n];
+    const int b = winners[2 * n + 1];
+    const bool bWins = beats(b, a);
+    winners[n] = bWins ? b : a;
+    tree[n] = bWins ? a : b;
+  }
+  tree[0] = k > 1 ? winners[1] : 0;
+}
+
+void ExternalSort::closeMerge()
+{
+  for (size_t i = 0; i < inputs.size(); i++)
+  {
+    if (inputs[i].page != NULL)
+    {
+      bufMgr->unPinPage(file, inputs[i].pageNo, false);
+      inputs[i].page = NULL;
+    }
+  }
+  inputs.clear();
+}
+
+void ExternalSort::advance(RunReader &in)
+{
+  if (in.left == 0)
+  {
+    in.current = NULL;
+    if (in.page != NULL)
+    {
+      bufMgr->unPinPage(file, in.pageNo, false);
+      in.page = NULL;
+    }
+    return;
+  }
+  in.left--;
+  if (in.memory != NULL)
+  {
+    in.current = *in.memory++;
+    return;
+  }
+  // A record that fits in the rest of the page is read in place, one that spans two pages is copied
+  if (in.page != NULL && in.offset + recordSize <= (int)Page::SIZE)
+  {
+    in.current = (char *)in.page + in.offset;
+    in.offset += recordSize;
+    return;
+  }
+  int copied = 0;
+  while (copied < recordSize)
+  {
+    if (in.page == NULL || in.offset == Page::SIZE)
+    {
+      if (in.page != NULL)
+      {
+        bufMgr->unPinPage(file, in.pageNo, false);
+        in.pageNo++;
+      }
+      bufMgr->readPage(file, in.pageNo, in.page);
+      in.offset = 0;
+      if (copied == 0 && recordSize <= (int)Page::SIZE)
+      {
+        in.current = (char *)in.page;
+        in.offset = recordSize;
+        return;
+      }
+    }
+    const int n = std::min(recordSize - copied, (int)Page::SIZE - in.offset);
+    memcpy(&in.record[copied], (char *)in.page + in.offset, n);
+    copied += n;
+    in.offset += n;
+  }
+  in.current = &in.record[0];
+}
+
+void ExternalSort::nextWinner()
+{
+  int w = tree[0];
+  advance(inputs[w]);
+  const int k = (int)inputs.size();
+  for (int n = (w + k) / 2; n > 0; n /= 2)
+  {
+    if (beats(tree[n], w))
+    {
+      std::swap(tree[n], w);
+    }
+  }
+  tree[0] = w;
+}
+
+void ExternalSort::scanNext(char *record)
+{
+  if (!merging)
+  {
+    merging = true;
+    // Each run merged keeps a page pinned, and a merge pass one more for its output, so no more runs are
+    // merged at once than the buffer pool has unpinned frames for, past those the caller goes on to pin
+    const int frames = (int)bufMgr->getUnpinnedFrames() - std::max(1, readerPins);
+    fanIn = std::max(2, std::min(fanIn, frames));
+    // The run in memory and a page for each run on disk share the budget in the final merge, so the run
+    // in memory goes to disk as well unless it fits alongside them
+    const size_t finalRuns = std::min(runs.size(), (size_t)fanIn - 1);
+    if (!runs.empty() && !buffer.empty() &&
+        buffer.size() / recordSize * (recordSize + sizeof(const char *)) + finalRuns * Page::SIZE > memoryBudget)
+    {
+      spill();
+    }
+    sortBuffer();
+    // Merge the runs on disk in passes, each merging groups of neighbouring runs, until those left and
+    // the one in memory, if any, can be merged at once
+    while (runs.size() + (order.empty() ? 0 : 1) > (size_t)fanIn)
+    {
+      std::vector<Run> merged;
+      for (size_t first = 0; first < runs.size(); first += fanIn)
+      {
+        const size_t count = std::min((size_t)fanIn, runs.size() - first);
+        if (count == 1)
+        {
+          merged.push_back(runs[first]);
+          continue;
+        }
+        openMerge(first, count, false);
+        Run run;
+        run.firstPageNo = Page::INVALID_NUMBER;
+        run.count = 0;
+        while (inputs[tree[0]].current != NULL)
+        {
+          writeRecord(run, inputs[tree[0]].current);
+          nextWinner();
+        }
+        endRun();
+        closeMerge();
+        merged.push_back(run);
+        numMerges++;
+      }
+      runs.swap(merged);
+    }
+    openMerge(0, runs.size(), true);
+  }
+  const char *next = inputs[tree[0]].current;
+  if (next == NULL)
+  {
+    throw EndOfFileException();
+  }
+  memcpy(record, next, recordSize);
+  nextWinner();
+}
+
+}
@@ -0,0 +1,302 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+#include "types.h"
+#include "page.h"
+#include "file.h"
+#include "buffer.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Sorts fixed-size records that need not fit in memory. Records are collected into a run of at
+ * most the memory budget, which is sorted and written to the pages of a temporary BlobFile through the
+ * buffer manager once it is full. When the input ends the runs are merged with a loser tree, the run
+ * still in memory along with those on disk, and come back in order one at a time. If there are more
+ * runs than the budget has pages for, neighbouring runs are first merged in passes into fewer, longer ones.
+ * The runs merged at once are also bounded by the frames of the buffer pool that are unpinned when the
+ * merge starts, as each keeps a page pinned.
+ *
+ * Records are kept recordSize bytes apart in storage aligned for any type, so records whose size is a
+ * multiple of their alignment can be compared in place. Equal records come back in the order they were
+ * added. The temporary file is removed when the sort is destroyed.
+ */
+class ExternalSort
+{
+ public:
+  /**
+   * Strict weak order of two records.
+   */
+  typedef std::function<bool(const char *, const char *)> RecordLess;
+
+  /**
+   * Start an empty sort.
+   *
+   * @param bufMgr				Buffer Manager Instance, through which the runs are written and read
+   * @param recordSize		Bytes of each record
+   * @param memoryBudget	Bytes of records, with a pointer each, held in memory at once. It also bounds the
+   * 											runs merged at once to one per page of the budget, each keeping a page pinned.
+   * 											In the final merge the run in memory and those pages share the budget.
+   * @param less					Order of the records
+   * @param readerPins		Pages the caller keeps pinned while it takes records from the final merge, which
+   * 											the merge leaves frames of the buffer pool for
+   */
+  ExternalSort(BufMgr *bufMgr, const int recordSize, const size_t memoryBudget, const RecordLess &less,
+               const int readerPins = 0);
+
+  /**
+   * Unpin the pages of the runs and remove the temporary file, if any.
+   */
+  ~ExternalSort();
+
+  /**
+   * Add a record, writing the run in memory to disk first if it is full.
+   * Must not be called once scanNext has been.
+   */
+  void add(const char *record);
+
+  /**
+   * Copy the next record in order to record.
+   * @throws EndOfFileException If every record has been returned
+   */
+  void scanNext(char *record);
+
+  /**
+   * Number of records added.
+   */
+  size_t size() const { return numRecords; }
+
+  /**
+   * Number of runs written to disk while records were added.
+   */
+  int getRunCount() const { return numRuns; }
+
+  /**
+   * Number of merges of runs on disk into longer runs before the final merge.
+   */
+  int getMergeCount() const { return numMerges; }
+
+  /**
+   * Pages of the temporary file written so far.
+   */
+  int getPagesWritten() const { return numPagesWritten; }
+
+ private:
+  /**
+   * @brief A sorted run written to consecutive pages of the temporary file, records one after the other
+   * across page boundaries.
+   */
+  struct Run
+  {
+    PageId firstPageNo;
+    size_t count;
+  };
+
+  /**
+   * @brief Position of the merge in one of its runs.
+   */
+  struct RunReader
+  {
+    /**
+     * Next record of the run, which the merge has not taken yet. NULL once the run is done.
+     */
+    const char *current;
+
+    /**
+     * Records of the run after current.
+     */
+    size_t left;
+
+    /**
+     * Next record pointer of the run in memory, or NULL for a run on disk.
+     */
+    const char *const *memory;
+
+    /**
+     * Page of a run on disk that holds current, pinned, or NULL before the first record.
+     */
+    Page *page;
+
+    /**
+     * Number of page.
+     */
+    PageId pageNo;
+
+    /**
+     * Byte of page after current.
+     */
+    int offset;
+
+    /**
+     * Copy of a record that spans two pages, which current then points to.
+     */
+    std::vector<char> record;
+  };
+
+  /**
+   * Buffer Manager instance.
+   */
+  BufMgr *bufMgr;
+
+  /**
+   * Bytes of each record.
+   */
+  int recordSize;
+
+  /**
+   * Bytes of records, with a pointer each, and of pinned pages held at once.
+   */
+  size_t memoryBudget;
+
+  /**
+   * Most records in memory at once.
+   */
+  size_t runCapacity;
+
+  /**
+   * Most runs merged at once. Lowered to fit the buffer pool when the merge starts.
+   */
+  int fanIn;
+
+  /**
+   * Pages the caller keeps pinned while it takes records from the final merge.
+   */
+  int readerPins;
+
+  /**
+   * Order of the records.
+   */
+  RecordLess less;
+
+  /**
+   * Temporary file of the runs, created with the first run written to disk.
+   */
+  BlobFile *file;
+
+  /**
+   * Name of file.
+   */
+  std::string fileName;
+
+  /**
+   * Records of the run in memory, in the order they were added.
+   */
+  std::vector<char> buffer;
+
+  /**
+   * Pointers into buffer in record order, set when the run is sorted.
+   */
+  std::vector<const char *> order;
+
+  /**
+   * Runs on disk, earliest records first.
+   */
+  std::vector<Run> runs;
+
+  /**
+   * Runs of the merge under way, those on disk in the order of runs and then the one in memory.
+   */
+  std::vector<RunReader> inputs;
+
+  /**
+   * Loser tree over inputs. Entry 0 is the input whose record comes next, and every other entry the
+   * input that lost the match played at that node, whose children are entries 2n and 2n + 1 with
+   * input i at leaf inputs.size() + i.
+   */
+  std::vector<int> tree;
+
+  /**
+   * Page of the run being written, pinned, or NULL.
+   */
+  Page *outPage;
+
+  /**
+   * Number of outPage.
+   */
+  PageId outPageNo;
+
+  /**
+   * Byte of outPage the next record goes to.
+   */
+  int outOffset;
+
+  /**
+   * True once the final merge has started.
+   */
+  bool merging;
+
+  size_t numRecords;
+  int numRuns;
+  int numMerges;
+  int numPagesWritten;
+
+  /**
+   * Sort the records in memory into order.
+   */
+  void sortBuffer();
+
+  /**
+   * Write the records in memory to a new run on disk and empty the buffer.
+   */
+  void spill();
+
+  /**
+   * Append a record to run, which is being written.
+   */
+  void writeRecord(Run &run, const char *record);
+
+  /**
+   * Unpin the last page of the run being written.
+   */
+  void endRun();
+
+  /**
+   * Start a merge of runs [first, first + count) on disk and, if withMemory is set, the run in memory.
+   */
+  void openMerge(const size_t first, const size_t count, const bool withMemory);
+
+  /**
+   * Unpin the pages of the inputs of the merge.
+   */
+  void closeMerge();
+
+  /**
+   * Move an input of the merge to its next record, reading the next page of its run if it has to.
+   */
+  void advance(RunReader &in);
+
+  /**
+   * True if the record of input a comes before that of input b. A run that is done comes last and equal
+   * records come from the earlier run first.
+   */
+  bool beats(const int a, const int b) const
+  {
+    const char *x = inputs[a].current;
+    const char *y = inputs[b].current;
+    if (x == NULL || y == NULL)
+    {
+      return y == NULL && x != NULL;
+    }
+    return less(x, y) || (!less(y, x) && a < b);
+  }
+
+  /**
+   * Move the input whose record came out of the merge on, and replay its matches up the loser tree.
+   */
+  void nextWinner();
+
+  ExternalSort(const ExternalSort &) = delete;
+  ExternalSort &operator=(const ExternalSort &) = delete;
+};
+
+}
@@ -103,6 +103,15 @@ class FileIterator {
 	inline Page operator*() const
   { return file_->readPage(current_page_number_); }
 
+  /**
+   * Returns the number of the page the iterator points to, without reading
+   * the page.
+   *
+   * @return  Number of current page.
+   */
+  inline PageId getCurrentPageNumber() const
+  { return current_page_number_; }
+
  private:
   /**
    * File we're iterating over.
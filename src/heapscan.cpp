@@ -0,0 +1,75 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "heapscan.h"
+#include "exceptions/end_of_file_exception.h"
+#include <algorithm>
+
+namespace badgerdb {
+
+/**
+ * Order of record ids in the file: by page, then by slot within the page.
+ */
+static bool fileOrder(const RecordId &a, const RecordId &b)
+{
+  return a.page_number != b.page_number ? a.page_number < b.page_number : a.slot_number < b.slot_number;
+}
+
+BitmapHeapScan::BitmapHeapScan(File *file, BufMgr *bufMgr, ScanCursor &cursor)
+  : file(file), bufMgr(bufMgr), next(0), curPage(NULL), curPageNo(Page::INVALID_NUMBER), numPagesRead(0)
+{
+  RecordId batch[256];
+  size_t got;
+  while ((got = cursor.scanNextBatch(batch, 256)) > 0)
+  {
+    rids.insert(rids.end(), batch, batch + got);
+  }
+  std::sort(rids.begin(), rids.end(), fileOrder);
+}
+
+BitmapHeapScan::~BitmapHeapScan()
+{
+  if (curPage != NULL)
+  {
+    bufMgr->unPinPage(file, curPageNo, false);
+    curPage = NULL;
+  }
+}
+
+void BitmapHeapScan::scanNext(RecordId& outRid)
+{
+  if (next == rids.size())
+  {
+    if (curPage != NULL)
+    {
+      bufMgr->unPinPage(file, curPageNo, false);
+      curPage = NULL;
+    }
+    throw EndOfFileException();
+  }
+  const RecordId &rid = rids[next++];
+  // Records of one page are next to each other, so the page stays pinned until the last of them
+  if (curPage == NULL || rid.page_number != curPageNo)
+  {
+    if (curPage != NULL)
+    {
+      bufMgr->unPinPage(file, curPageNo, false);
+      curPage = NULL;
+    }
+    bufMgr->readPage(file, rid.page_number, curPage);
+    curPageNo = rid.page_number;
+    numPagesRead++;
+  }
+  outRid = rid;
+}
+
+std::string BitmapHeapScan::getRecord()
+{
+  return curPage->getRecord(rids[next - 1]);
+}
+
+}
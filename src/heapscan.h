@@ -0,0 +1,105 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "types.h"
+#include "page.h"
+#include "buffer.h"
+#include "btree.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Fetches the records of an index range scan from the base relation one heap page at a time.
+ * The record ids of the scan are collected first and sorted by page, so each heap page is read and
+ * pinned once, in file order, however the keys are spread over the relation. Records come back in
+ * file order rather than key order.
+ */
+class BitmapHeapScan
+{
+ public:
+
+  /**
+   * Collect the record ids of the rest of the scan of cursor, which is left at its end.
+   *
+   * @param file			Base relation of the index, opened by the caller
+   * @param bufMgr		Buffer Manager Instance
+   * @param cursor		Open scan of the index
+   */
+  BitmapHeapScan(File *file, BufMgr *bufMgr, ScanCursor &cursor);
+
+  /**
+   * Unpin the current heap page, if any.
+   */
+  ~BitmapHeapScan();
+
+  /**
+   * Move to the next record, reading its heap page if the previous record was on another one.
+   * @param outRid	RecordId of the record
+   * @throws EndOfFileException If every record has been returned
+   */
+  void scanNext(RecordId& outRid);
+
+  /**
+   * Contents of the record last returned by scanNext.
+   */
+  std::string getRecord();
+
+  /**
+   * Number of records the scan returns in all.
+   */
+  size_t size() const { return rids.size(); }
+
+  /**
+   * Number of heap pages read so far, each of them once.
+   */
+  int pagesRead() const { return numPagesRead; }
+
+ private:
+  /**
+   * Base relation.
+   */
+  File          *file;
+
+  /**
+   * Buffer Manager instance used to read pages into the buffer pool.
+   */
+  BufMgr        *bufMgr;
+
+  /**
+   * Record ids of the scan, sorted by page and slot.
+   */
+  std::vector<RecordId> rids;
+
+  /**
+   * Index in rids of the next record to return.
+   */
+  size_t        next;
+
+  /**
+   * Heap page of the last record returned, pinned. NULL before the first record and after the last.
+   */
+  Page          *curPage;
+
+  /**
+   * Page number of curPage.
+   */
+  PageId        curPageNo;
+
+  /**
+   * Heap pages read so far.
+   */
+  int           numPagesRead;
+
+  BitmapHeapScan(const BitmapHeapScan &) = delete;
+  BitmapHeapScan &operator=(const BitmapHeapScan &) = delete;
+};
+
+}
@@ -5,8 +5,15 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <fstream>
+#include <thread>
 #include <vector>
 #include "btree.h"
+#include "heapscan.h"
+#include "external_sort.h"
 #include "page.h"
 #include "filescan.h"
 #include "page_iterator.h"
@@ -19,6 +26,7 @@
 #include "exceptions/bad_opcodes_exception.h"
 #include "exceptions/scan_not_initialized_exception.h"
 #include "exceptions/end_of_file_exception.h"
+#include "exceptions/bad_index_info_exception.h"
 
 #define checkPassFail(a, b)                                               \
 	{                                                                     \
@@ -71,8 +79,39 @@ void createRelationBackwardTest(int rel = relationSize);
 void createRelationRandom();
 void createRelationRandomTest(int rel = relationSize);
 
-void intTests();
+void intTests(const bool bulkLoad = true, const double fillFactor = DEFAULT_FILL_FACTOR);
+void test_int_out_of_bound();
+std::vector<int> *createTrueRandom(int low, int high, int step);
+void randomIntTests(std::vector<int> *sortedvec);
 int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp);
+void doubleTests(const bool bulkLoad = true);
+int doubleScan(BTreeIndex *index, double lowVal, Operator lowOp, double highVal, Operator highOp);
+void stringTests(const bool bulkLoad = true);
+void prefixTests();
+void cursorTests();
+void batchTests();
+void readaheadTests();
+void concurrencyTests();
+void concurrentDeleteTests();
+void deleteTests();
+void insertBatchTests();
+void lookupTests();
+void coveringTests(const bool bulkLoad = true);
+void heapScanTests();
+void reverseScanTests();
+void negativeKeyTests();
+void countTests(const bool bulkLoad = true);
+void postingTests(const bool bulkLoad = true);
+void compositeTests(const bool bulkLoad = true);
+void writeBufferTests();
+void hotNodeTests();
+void swizzleTests();
+void snapshotTests();
+void parallelBuildTests();
+void externalSortTests();
+void appendSplitTests();
+int batchScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp, size_t batchSize);
+int stringScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp);
 void indexTests();
 void test1();
 void test2();
@@ -85,6 +124,7 @@ void test8();
 
 
 void errorTests();
+void deleteIndexFile();
 void deleteRelation();
 
 int main(int argc, char **argv)
@@ -152,7 +192,7 @@ int main(int argc, char **argv)
 
 	delete bufMgr;
 
-	return 1;
+	return 0;
 }
 
 void test1()
@@ -203,7 +243,7 @@ void test5() {
   std::vector<int> *sortedvec =
       createTrueRandom(-relationSize, relationSize, 10);
   randomIntTests(sortedvec);
-  free(sortedvec);
+  delete sortedvec;
   deleteIndexFile();
   deleteRelation();
 }
@@ -247,8 +287,34 @@ void createRelationForwardTest(int relationSize) {
     File::remove(relationName);
   } catch (FileNotFoundException e) {
   }
-	
-	
+  file1 = new PageFile(relationName, true);
+
+  // initialize all of record1.s to keep purify happy
+  memset(record1.s, ' ', sizeof(record1.s));
+  PageId new_page_number;
+  Page new_page = file1->allocatePage(new_page_number);
+
+  // Insert a bunch of tuples into the relation.
+  for (int i = 0; i < relationSize; i++) {
+    sprintf(record1.s, "%05d string record", i);
+    record1.i = i;
+    record1.d = (double)i;
+    std::string new_data(reinterpret_cast<char *>(&record1), sizeof(record1));
+
+    while (1) {
+      try {
+        new_page.insertRecord(new_data);
+        break;
+      } catch (const InsufficientSpaceException &e) {
+        file1->writePage(new_page_number, new_page);
+        new_page = file1->allocatePage(new_page_number);
+      }
+    }
+  }
+
+  file1->writePage(new_page_number, new_page);
+}
+
 void createRelationBackwardTest(int relationSize) {
   // destroy any old copies of relation file
   try {
@@ -280,7 +346,10 @@ void createRelationBackwardTest(int relationSize) {
       }
     }
   }
-	
+
+  file1->writePage(new_page_number, new_page);
+}
+
 void createRelationForward()
 {
 	std::vector<RecordId> ridVec;
@@ -496,14 +565,75 @@ void createRelationRandom()
 
 void indexTests()
 {
+	// Bulk loaded with full nodes, bulk loaded with room for inserts, and built one insert at a time
 	intTests();
-	try
-	{
-		File::remove(intIndexName);
-	}
-	catch (const FileNotFoundException &e)
-	{
-	}
+	deleteIndexFile();
+	intTests(true, 0.5);
+	deleteIndexFile();
+	intTests(false);
+	deleteIndexFile();
+	doubleTests();
+	deleteIndexFile();
+	doubleTests(false);
+	deleteIndexFile();
+	stringTests();
+	deleteIndexFile();
+	stringTests(false);
+	deleteIndexFile();
+	prefixTests();
+	deleteIndexFile();
+	cursorTests();
+	deleteIndexFile();
+	batchTests();
+	deleteIndexFile();
+	readaheadTests();
+	deleteIndexFile();
+	concurrencyTests();
+	deleteIndexFile();
+	concurrentDeleteTests();
+	deleteIndexFile();
+	deleteTests();
+	deleteIndexFile();
+	insertBatchTests();
+	deleteIndexFile();
+	lookupTests();
+	deleteIndexFile();
+	coveringTests();
+	deleteIndexFile();
+	coveringTests(false);
+	deleteIndexFile();
+	heapScanTests();
+	deleteIndexFile();
+	reverseScanTests();
+	deleteIndexFile();
+	negativeKeyTests();
+	deleteIndexFile();
+	countTests();
+	deleteIndexFile();
+	countTests(false);
+	deleteIndexFile();
+	postingTests();
+	deleteIndexFile();
+	postingTests(false);
+	deleteIndexFile();
+	compositeTests();
+	deleteIndexFile();
+	compositeTests(false);
+	deleteIndexFile();
+	writeBufferTests();
+	deleteIndexFile();
+	hotNodeTests();
+	deleteIndexFile();
+	swizzleTests();
+	deleteIndexFile();
+	snapshotTests();
+	deleteIndexFile();
+	parallelBuildTests();
+	deleteIndexFile();
+	externalSortTests();
+	deleteIndexFile();
+	appendSplitTests();
+	deleteIndexFile();
 }
 
 
@@ -512,15 +642,23 @@ void deleteIndexFile() {
     File::remove(intIndexName);
   } catch (FileNotFoundException e) {
   }
+  try {
+    File::remove(doubleIndexName);
+  } catch (const FileNotFoundException &e) {
+  }
+  try {
+    File::remove(stringIndexName);
+  } catch (const FileNotFoundException &e) {
+  }
 }
 // -----------------------------------------------------------------------------
 // intTests
 // -----------------------------------------------------------------------------
 
-void intTests()
+void intTests(const bool bulkLoad, const double fillFactor)
 {
 	std::cout << "Create a B+ Tree index on the integer field" << std::endl;
-	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, bulkLoad, fillFactor);
 
 	// run some tests
 	checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
@@ -532,76 +670,2269 @@ void intTests()
 							checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 1000)
 }
 
-int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp)
+// -----------------------------------------------------------------------------
+// doubleTests
+// -----------------------------------------------------------------------------
+
+void doubleTests(const bool bulkLoad)
 {
-	RecordId scanRid;
-	Page *curPage;
+	std::cout << "Create a B+ Tree index on the double field" << std::endl;
+	BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple, d), DOUBLE, bulkLoad);
 
-	std::cout << "Scan for ";
-	if (lowOp == GT)
+	// run some tests
+	checkPassFail(doubleScan(&index, 25, GT, 40, LT), 14)
+	checkPassFail(doubleScan(&index, 20, GTE, 35, LTE), 16)
+	checkPassFail(doubleScan(&index, -3, GT, 3, LT), 3)
+	checkPassFail(doubleScan(&index, 996, GT, 1001, LT), 4)
+	checkPassFail(doubleScan(&index, 0, GT, 1, LT), 0)
+	checkPassFail(doubleScan(&index, 300, GT, 400, LT), 99)
+	checkPassFail(doubleScan(&index, 3000, GTE, 4000, LT), 1000)
+}
+
+// -----------------------------------------------------------------------------
+// stringTests
+// -----------------------------------------------------------------------------
+
+void stringTests(const bool bulkLoad)
+{
+	std::cout << "Create a B+ Tree index on the string field" << std::endl;
+	BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple, s), STRING, bulkLoad);
+
+	// run some tests
+	checkPassFail(stringScan(&index, 25, GT, 40, LT), 14)
+	checkPassFail(stringScan(&index, 20, GTE, 35, LTE), 16)
+	checkPassFail(stringScan(&index, -3, GT, 3, LT), 3)
+	checkPassFail(stringScan(&index, 996, GT, 1001, LT), 4)
+	checkPassFail(stringScan(&index, 0, GT, 1, LT), 0)
+	checkPassFail(stringScan(&index, 300, GT, 400, LT), 99)
+	checkPassFail(stringScan(&index, 3000, GTE, 4000, LT), 1000)
+}
+
+// -----------------------------------------------------------------------------
+// prefixTests
+// -----------------------------------------------------------------------------
+
+/**
+ * Count the keys of the string index that are formatted from format and i for i in [0, count).
+ */
+int stringHits(BTreeIndex &index, const char *format, const int count)
+{
+	int hits = 0;
+	for (int i = 0; i < count; i++)
 	{
-		std::cout << "(";
+		char key[STRINGSIZE + 1];
+		sprintf(key, format, i);
+		hits += index.contains(key);
 	}
-	else
+	return hits;
+}
+
+void prefixTests()
+{
+	std::cout << "Search the string index by key prefixes while the bytes its keys share change" << std::endl;
+	BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple, s), STRING);
+	char key[STRINGSIZE + 1] = "00000 stri";
+	std::vector<RecordId> found;
+	checkPassFail(index.lookup(key, found), 1)
+
+	// Keys of the relation all start with '0', and so do these, which go after them and split the rightmost leaves:
+	// the non-leaves take their prefixes after that shared byte
+	const int numShared = 2000, numBreaking = 1000;
+	for (int i = 0; i < numShared; i++)
 	{
-		std::cout << "[";
+		sprintf(key, "0x%04d", i);
+		index.insertEntry(key, found[0]);
 	}
-	std::cout << lowVal << "," << highVal;
-	if (highOp == LT)
+	checkPassFail(stringHits(index, "0x%04d", numShared), numShared)
+	checkPassFail(stringScan(&index, 25, GT, 40, LT), 14)
+	checkPassFail(index.countRange("0x", GTE, "0y", LT), (size_t)numShared)
+
+	// Keys that start otherwise leave the non-leaves sharing no byte, so that all their prefixes are taken anew
+	for (int i = 0; i < numBreaking; i++)
 	{
-		std::cout << ")";
+		sprintf(key, "9x%04d", i);
+		index.insertEntry(key, found[0]);
 	}
-	else
+	checkPassFail(stringHits(index, "9x%04d", numBreaking), numBreaking)
+	checkPassFail(stringHits(index, "0x%04d", numShared), numShared)
+	checkPassFail(stringHits(index, "%05d stri", relationSize), relationSize)
+	checkPassFail(stringScan(&index, 25, GT, 40, LT), 14)
+	checkPassFail(stringScan(&index, 3000, GTE, 4000, LT), 1000)
+	checkPassFail(index.countRange("0x", GTE, "0y", LT), (size_t)numShared)
+	checkPassFail(index.countRange("9x", GTE, "9y", LT), (size_t)numBreaking)
+	checkPassFail(index.countRange("0", GTE, "a", LT), (size_t)(relationSize + numShared + numBreaking))
+	checkPassFail(index.contains("5"), false)
+}
+
+// -----------------------------------------------------------------------------
+// cursorTests
+// -----------------------------------------------------------------------------
+
+void cursorTests()
+{
+	std::cout << "Interleave several scan cursors on one index" << std::endl;
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, true, 0.5);
+
+	const int numCursors = 4;
+	const int lows[numCursors] = {25, 20, 300, 3000};
+	const Operator lowOps[numCursors] = {GT, GTE, GT, GTE};
+	const int highs[numCursors] = {40, 35, 400, 4000};
+	const Operator highOps[numCursors] = {LT, LTE, LT, LT};
+	const int expected[numCursors] = {14, 16, 99, 1000};
+
+	ScanCursor cursors[numCursors];
+	int counts[numCursors];
+	for (int c = 0; c < numCursors; c++)
 	{
-		std::cout << "]";
+		cursors[c] = index.openScan(&lows[c], lowOps[c], &highs[c], highOps[c]);
+		counts[c] = 0;
 	}
-	std::cout << std::endl;
+	// The legacy scan runs alongside the cursors
+	checkPassFail(intScan(&index, 996, GT, 1001, LT), 4)
 
-	int numResults = 0;
+	// Advance every cursor one entry at a time until all of them are done
+	int open = numCursors;
+	while (open > 0)
+	{
+		for (int c = 0; c < numCursors; c++)
+		{
+			if (!cursors[c].isOpen())
+			{
+				continue;
+			}
+			RecordId cursorRid;
+			try
+			{
+				cursors[c].scanNext(cursorRid);
+				counts[c]++;
+			}
+			catch (const IndexScanCompletedException &e)
+			{
+				cursors[c].close();
+				open--;
+			}
+		}
+	}
+	for (int c = 0; c < numCursors; c++)
+	{
+		checkPassFail(counts[c], expected[c])
+	}
 
+	// A moved cursor carries on where the original stopped
+	int low = 0, high = 10;
+	ScanCursor first = index.openScan(&low, GTE, &high, LT);
+	RecordId cursorRid;
+	first.scanNext(cursorRid);
+	ScanCursor second(std::move(first));
+	int rest = 0;
 	try
 	{
-		index->startScan(&lowVal, lowOp, &highVal, highOp);
+		while (true)
+		{
+			second.scanNext(cursorRid);
+			rest++;
+		}
 	}
-	catch (const NoSuchKeyFoundException &e)
+	catch (const IndexScanCompletedException &e)
 	{
-		std::cout << "No Key Found satisfying the scan criteria." << std::endl;
-		return 0;
 	}
+	checkPassFail(rest, 9)
+	checkPassFail(first.isOpen(), false)
+}
 
-	while (1)
+// -----------------------------------------------------------------------------
+// batchTests
+// -----------------------------------------------------------------------------
+
+void batchTests()
+{
+	std::cout << "Scan the integer index in batches" << std::endl;
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, true, 0.5);
+
+	// Batches smaller than, about the size of and larger than a leaf
+	const size_t batchSizes[] = {7, 400, 5000};
+	for (int b = 0; b < 3; b++)
 	{
-		try
+		checkPassFail(batchScan(&index, 25, GT, 40, LT, batchSizes[b]), 14)
+		checkPassFail(batchScan(&index, 20, GTE, 35, LTE, batchSizes[b]), 16)
+		checkPassFail(batchScan(&index, -3, GT, 3, LT, batchSizes[b]), 3)
+		checkPassFail(batchScan(&index, 300, GT, 400, LT, batchSizes[b]), 99)
+		checkPassFail(batchScan(&index, 3000, GTE, 4000, LT, batchSizes[b]), 1000)
+		checkPassFail(batchScan(&index, 0, GTE, relationSize, LT, batchSizes[b]), relationSize)
+	}
+}
+
+// -----------------------------------------------------------------------------
+// readaheadTests
+// -----------------------------------------------------------------------------
+
+void readaheadTests()
+{
+	std::cout << "Scan the integer index with and without leaf readahead" << std::endl;
+	const int maxReadaheads[] = {0, 1, 4};
+	for (int r = 0; r < 3; r++)
+	{
+		// A new index object leaves none of its pages in the buffer pool
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, true, 0.5);
+		ScanOptions options;
+		options.maxReadahead = maxReadaheads[r];
+		int low = 0, high = relationSize;
+		// The second scan finds every leaf still in the pool, so its readahead reads nothing
+		for (int pass = 0; pass < 2; pass++)
 		{
-			index->scanNext(scanRid);
-			bufMgr->readPage(file1, scanRid.page_number, curPage);
-			RECORD myRec = *(reinterpret_cast<const RECORD *>(curPage->getRecord(scanRid).data()));
-			bufMgr->unPinPage(file1, scanRid.page_number, false);
+			ScanCursor cursor = index.openScan(&low, GTE, &high, LT, options);
+			RecordId rids[500];
+			int numResults = 0;
+			size_t got;
+			while ((got = cursor.scanNextBatch(rids, 500)) > 0)
+			{
+				numResults += got;
+			}
+			const ScanStats stats = cursor.getStats();
+			cursor.close();
+			std::cout << "readahead " << maxReadaheads[r] << ": " << stats.leavesScanned << " leaves, "
+					  << stats.leavesPrefetched << " prefetched, " << stats.prefetchHits << " prefetch hits" << std::endl;
+
+			checkPassFail(numResults, relationSize)
+			// Every leaf after the first is read ahead of a cold scan, unless readahead is off
+			const int expectedHits = maxReadaheads[r] == 0 || pass == 1 ? 0 : stats.leavesScanned - 1;
+			checkPassFail(stats.prefetchHits, expectedHits)
+			checkPassFail(stats.leavesPrefetched, stats.prefetchHits)
+		}
+	}
+}
 
-			if (numResults < 5)
+// -----------------------------------------------------------------------------
+// concurrencyTests
+// -----------------------------------------------------------------------------
+
+void concurrencyTests()
+{
+	std::cout << "Insert into and scan one index from several threads" << std::endl;
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, true, 0.5);
+
+	const int numWriters = 4;
+	const int numReaders = 2;
+	const int insertsPerWriter = 2000;
+	std::atomic<bool> writing(true);
+	std::atomic<int> badScans(0);
+	std::atomic<int> scans(0);
+
+	std::vector<std::thread> writers;
+	for (int w = 0; w < numWriters; w++)
+	{
+		writers.push_back(std::thread([&index, w]() {
+			// New keys above the relation's, spread over the key range so that splits happen all over the tree
+			for (int j = 0; j < insertsPerWriter; j++)
 			{
-				std::cout << "at:" << scanRid.page_number << "," << scanRid.slot_number;
-				std::cout << " -->:" << myRec.i << ":" << myRec.d << ":" << myRec.s << ":" << std::endl;
+				const int key = relationSize + (j * 7919 % insertsPerWriter) * numWriters + w;
+				RecordId newRid;
+				newRid.page_number = key;
+				newRid.slot_number = w;
+				index.insertEntry(&key, newRid);
 			}
-			else if (numResults == 5)
+		}));
+	}
+	std::vector<std::thread> readers;
+	for (int r = 0; r < numReaders; r++)
+	{
+		readers.push_back(std::thread([&index, &writing, &badScans, &scans]() {
+			// The relation's own keys are never changed, so every scan of them has to see all of them
+			do
 			{
-				std::cout << "..." << std::endl;
+				int low = 0, high = relationSize;
+				ScanCursor cursor = index.openScan(&low, GTE, &high, LT);
+				RecordId rids[100];
+				int numResults = 0;
+				size_t got;
+				while ((got = cursor.scanNextBatch(rids, 100)) > 0)
+				{
+					numResults += got;
+				}
+				if (numResults != relationSize)
+				{
+					badScans++;
+				}
+				scans++;
+			} while (writing);
+		}));
+	}
+	for (int w = 0; w < numWriters; w++)
+	{
+		writers[w].join();
+	}
+	writing = false;
+	for (int r = 0; r < numReaders; r++)
+	{
+		readers[r].join();
+	}
+	std::cout << scans << " scans ran alongside the inserts" << std::endl;
+
+	checkPassFail(badScans, 0)
+	checkPassFail(batchScan(&index, relationSize, GTE, relationSize + numWriters * insertsPerWriter, LT, 500), numWriters * insertsPerWriter)
+	checkPassFail(batchScan(&index, 0, GTE, relationSize + numWriters * insertsPerWriter, LT, 500), relationSize + numWriters * insertsPerWriter)
+}
+
+// -----------------------------------------------------------------------------
+// concurrentDeleteTests
+// -----------------------------------------------------------------------------
+
+void concurrentDeleteTests()
+{
+	std::cout << "Insert into and delete from one index from several threads, then check its entry counts" << std::endl;
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+
+	const int numWriters = 4;
+	const int opsPerWriter = 3000;
+	// Few keys, above the relation's, so that posting lists run over several leaves
+	const int numKeys = 300;
+	const int base = 2 * relationSize;
+	std::vector<std::vector<std::pair<int, RecordId> > > kept(numWriters);
+	std::atomic<int> missed(0);
+
+	std::vector<std::thread> writers;
+	for (int w = 0; w < numWriters; w++)
+	{
+		writers.push_back(std::thread([&index, &kept, &missed, w]() {
+			std::vector<std::pair<int, RecordId> > &mine = kept[w];
+			unsigned seed = 4321 + w;
+			for (int j = 0; j < opsPerWriter; j++)
+			{
+				seed = seed * 1103515245 + 12345;
+				if (!mine.empty() && (seed >> 8) % 3 == 0)
+				{
+					// One of its own entries, so that no two writers delete the same one
+					const size_t victim = (seed >> 4) % mine.size();
+					if (!index.deleteEntry(&mine[victim].first, mine[victim].second))
+					{
+						missed++;
+					}
+					mine[victim] = mine.back();
+					mine.pop_back();
+				}
+				else
+				{
+					const int key = base + (int)((seed >> 8) % numKeys);
+					RecordId rid = RecordId();
+					rid.page_number = w * opsPerWriter + j + 1;
+					rid.slot_number = w + 1;
+					index.insertEntry(&key, rid);
+					mine.push_back(std::make_pair(key, rid));
+				}
+			}
+			// Then most of the rest, so that nodes merge up the tree while the other writers still insert
+			while (mine.size() > opsPerWriter / 8)
+			{
+				if (!index.deleteEntry(&mine.back().first, mine.back().second))
+				{
+					missed++;
+				}
+				mine.pop_back();
 			}
+		}));
+	}
+	for (int w = 0; w < numWriters; w++)
+	{
+		writers[w].join();
+	}
+	checkPassFail(missed, 0)
+
+	// The entries each key is left with
+	std::vector<size_t> perKey(numKeys, 0);
+	size_t total = 0;
+	for (int w = 0; w < numWriters; w++)
+	{
+		for (size_t e = 0; e < kept[w].size(); e++)
+		{
+			perKey[kept[w][e].first - base]++;
+			total++;
 		}
-		catch (const IndexScanCompletedException &e)
+	}
+	int low = base, high = base + numKeys;
+	checkPassFail(index.countRange(&low, GTE, &high, LT), total)
+	checkPassFail(batchScan(&index, base, GTE, base + numKeys, LT, 100), (int)total)
+
+	// The count, rank and first entry of every key agree with what lookup finds
+	size_t before = index.rank(&low);
+	checkPassFail(before, (size_t)relationSize)
+	int bad = 0;
+	int selected;
+	RecordId rid;
+	for (int k = 0; k < numKeys; k++)
+	{
+		const int key = base + k;
+		std::vector<RecordId> found;
+		if (index.lookup(&key, found) != perKey[k] || index.countRange(&key, GTE, &key, LTE) != perKey[k])
 		{
-			break;
+			bad++;
 		}
+		if (index.rank(&key) != before)
+		{
+			bad++;
+		}
+		if (perKey[k] > 0 && (!index.select(before, &selected, rid) || selected != key))
+		{
+			bad++;
+		}
+		before += perKey[k];
+	}
+	checkPassFail(bad, 0)
+	checkPassFail(index.select(before, &selected, rid), false)
+}
 
-		numResults++;
+// -----------------------------------------------------------------------------
+// deleteTests
+// -----------------------------------------------------------------------------
+
+void deleteTests()
+{
+	std::cout << "Delete entries from the integer index" << std::endl;
+	// Keys are 0 .. relationSize - 1, so a full scan returns the record id of key i at position i
+	std::vector<RecordId> rids(relationSize);
+	std::ifstream::pos_type sizes[3];
+	for (int round = 0; round < 3; round++)
+	{
+		// Size the previous round left the file at, now that its index is closed
+		std::ifstream indexFile(intIndexName.c_str(), std::ios::binary | std::ios::ate);
+		sizes[round] = indexFile.tellg();
+		// The first round builds the index, the others open it again
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+		if (round == 0)
+		{
+			int low = 0, high = relationSize;
+			ScanCursor cursor = index.openScan(&low, GTE, &high, LT);
+			size_t numRids = 0, got;
+			while ((got = cursor.scanNextBatch(&rids[numRids], relationSize - numRids)) > 0)
+			{
+				numRids += got;
+			}
+			cursor.close();
+
+			// Delete one range, leaving its neighbours whole
+			int deleted = 0;
+			for (int key = 3000; key < 4000; key++)
+			{
+				deleted += index.deleteEntry(&key, rids[key]);
+			}
+			checkPassFail(deleted, 1000)
+			checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 0)
+			checkPassFail(intScan(&index, 2990, GTE, 4010, LT), 20)
+			checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+			checkPassFail(batchScan(&index, 0, GTE, relationSize, LT, 500), relationSize - 1000)
+			// Entries that are not there
+			int key = 3000;
+			checkPassFail(index.deleteEntry(&key, rids[key]), false)
+			key = 10;
+			checkPassFail(index.deleteEntry(&key, rids[11]), false)
+			continue;
+		}
+
+		// Delete everything, in an order that leaves holes all over the tree, and insert it all again
+		int deleted = 0;
+		for (int i = 0; i < relationSize; i++)
+		{
+			const int key = i * 7 % relationSize;
+			deleted += index.deleteEntry(&key, rids[key]);
+		}
+		// Keys 3000 .. 3999 were already gone the first time
+		const int expected = round == 1 ? relationSize - 1000 : relationSize;
+		checkPassFail(deleted, expected)
+		checkPassFail(batchScan(&index, 0, GTE, relationSize, LT, 500), 0)
+		for (int key = 0; key < relationSize; key++)
+		{
+			index.insertEntry(&key, rids[key]);
+		}
+		checkPassFail(intScan(&index, 300, GT, 400, LT), 99)
+		checkPassFail(batchScan(&index, 0, GTE, relationSize, LT, 500), relationSize)
 	}
+	// The second time round, the pages freed by the deletes are enough for the inserts
+	std::ifstream indexFile(intIndexName.c_str(), std::ios::binary | std::ios::ate);
+	const bool reused = indexFile.tellg() == sizes[2];
+	checkPassFail(reused, true)
+}
 
-	if (numResults >= 5)
+// -----------------------------------------------------------------------------
+// insertBatchTests
+// -----------------------------------------------------------------------------
+
+void insertBatchTests()
+{
+	std::cout << "Insert batches into the integer index" << std::endl;
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+	std::vector<RecordId> rids(relationSize);
+	int low = 0, high = relationSize;
+	ScanCursor cursor = index.openScan(&low, GTE, &high, LT);
+	size_t numRids = 0, got;
+	while ((got = cursor.scanNextBatch(&rids[numRids], relationSize - numRids)) > 0)
 	{
-		std::cout << "Number of results: " << numResults << std::endl;
+		numRids += got;
 	}
-	index->endScan();
-	std::cout << std::endl;
+	cursor.close();
+
+	// Unsorted new keys past those of the relation, which split leaves on the right edge over and over,
+	// and a second entry for each of the first 1000 keys, which fills leaves on the left
+	const int numNew = 20000;
+	std::vector<RIDKeyPair<int> > pairs;
+	for (int i = 0; i < numNew; i++)
+	{
+		RIDKeyPair<int> pair;
+		pair.set(rids[i % relationSize], relationSize + (int)((long)i * 7919 % numNew));
+		pairs.push_back(pair);
+	}
+	for (int key = 0; key < 1000; key++)
+	{
+		RIDKeyPair<int> pair;
+		pair.set(rids[relationSize - 1 - key], key);
+		pairs.push_back(pair);
+	}
+	for (size_t from = 0; from < pairs.size(); from += 6000)
+	{
+		index.insertBatch(&pairs[from], std::min((size_t)6000, pairs.size() - from));
+	}
+	checkPassFail(intScan(&index, 990, GT, 1010, LT), 28)
+	checkPassFail(batchScan(&index, 0, GTE, 1000, LT, 500), 2000)
+	checkPassFail(batchScan(&index, relationSize, GTE, relationSize + numNew, LT, 500), numNew)
+	checkPassFail(batchScan(&index, 0, GTE, relationSize + numNew, LT, 500), relationSize + numNew + 1000)
+	// The batch entries mix with those inserted one at a time
+	const int key = relationSize + numNew;
+	index.insertEntry(&key, rids[0]);
+	checkPassFail(batchScan(&index, relationSize + numNew - 10, GTE, relationSize + numNew, LTE, 500), 11)
+
+	bool thrown = false;
+	try
+	{
+		RIDKeyPair<double> pair;
+		pair.set(rids[0], 1.0);
+		index.insertBatch(&pair, 1);
+	}
+	catch (const BadIndexInfoException &e)
+	{
+		thrown = true;
+	}
+	checkPassFail(thrown, true)
+}
+
+// -----------------------------------------------------------------------------
+// lookupTests
+// -----------------------------------------------------------------------------
+
+void lookupTests()
+{
+	std::cout << "Point lookups on the integer index" << std::endl;
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+	std::vector<RecordId> found;
+	int key = 100;
+	checkPassFail(index.lookup(&key, found), 1)
+	// The record id is that of the record with the key
+	Page *page;
+	bufMgr->readPage(file1, found[0].page_number, page);
+	const RECORD record = *(reinterpret_cast<const RECORD *>(page->getRecord(found[0]).data()));
+	bufMgr->unPinPage(file1, found[0].page_number, false);
+	checkPassFail(record.i, 100)
+	checkPassFail(index.contains(&key), true)
+
+	// Keys that are not there leave the vector as it was
+	key = relationSize;
+	checkPassFail(index.lookup(&key, found), 0)
+	checkPassFail(index.contains(&key), false)
+	key = -5;
+	checkPassFail(index.contains(&key), false)
+	checkPassFail(found.size(), 1)
+
+	// Every key, whichever leaf it is in and wherever in the leaf
+	int hits = 0;
+	for (key = 0; key < relationSize; key++)
+	{
+		hits += index.contains(&key);
+	}
+	checkPassFail(hits, relationSize)
+
+	// A kernel switched to while the index is open is the one its searches use
+	checkPassFail(setSearchKernel(SEARCH_LINEAR), true)
+	checkPassFail(searchKernel().type, SEARCH_LINEAR)
+	hits = 0;
+	for (key = 0; key < relationSize; key++)
+	{
+		hits += index.contains(&key);
+	}
+	checkPassFail(hits, relationSize)
+	setSearchKernel(SEARCH_AUTO);
+
+	// Duplicates that fill several leaves come back in index order
+	key = 200;
+	for (int i = 0; i < 2000; i++)
+	{
+		index.insertEntry(&key, found[0]);
+	}
+	found.clear();
+	checkPassFail(index.lookup(&key, found), 2001)
+	checkPassFail(intScan(&index, 199, GT, 201, LT), 2001)
+	key = 201;
+	checkPassFail(index.lookup(&key, found), 1)
+	checkPassFail(found.size(), 2002)
+
+	// Keys with so many duplicates that separators repeat in the nodes above the leaves
+	const int numKeys = 5;
+	const int perKey = 3000;
+	for (int i = 0; i < numKeys * perKey; i++)
+	{
+		key = relationSize + i * 3 % numKeys;
+		index.insertEntry(&key, found[0]);
+	}
+	int matching = 0;
+	for (key = relationSize; key < relationSize + numKeys; key++)
+	{
+		found.clear();
+		matching += index.lookup(&key, found) == perKey;
+	}
+	checkPassFail(matching, numKeys)
+	checkPassFail(batchScan(&index, relationSize, GTE, relationSize + 2, LT, 500), 2 * perKey)
+}
+
+// -----------------------------------------------------------------------------
+// coveringTests
+// -----------------------------------------------------------------------------
+
+void coveringTests(const bool bulkLoad)
+{
+	std::cout << "Create a covering index on the integer field, storing the double field and a prefix of the string" << std::endl;
+	std::vector<PayloadColumn> columns(2);
+	columns[0].set(offsetof(tuple, d), sizeof(double));
+	columns[1].set(offsetof(tuple, s), 5);
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, bulkLoad, DEFAULT_FILL_FACTOR, columns);
+		const int payloadSize = index.getPayloadSize();
+		checkPassFail(payloadSize, (int)sizeof(double) + 5)
+
+		// The payloads come back with the record ids, in key order, without reading the relation
+		RecordId rids[10];
+		char payloads[10 * (sizeof(double) + 5)];
+		int lowVal = 25, highVal = 40;
+		ScanCursor cursor = index.openScan(&lowVal, GT, &highVal, LT);
+		int count = 0;
+		int wrong = 0;
+		size_t got;
+		while ((got = cursor.scanNextBatch(rids, payloads, 10)) > 0)
+		{
+			for (size_t i = 0; i < got; i++)
+			{
+				double d;
+				memcpy(&d, payloads + i * payloadSize, sizeof(double));
+				char s[6];
+				sprintf(s, "%05d", lowVal + 1 + count);
+				wrong += d != (double)(lowVal + 1 + count) || memcmp(payloads + i * payloadSize + sizeof(double), s, 5) != 0;
+				count++;
+			}
+		}
+		cursor.close();
+		checkPassFail(count, 14)
+		checkPassFail(wrong, 0)
+
+		// Entries of a covering index are inserted from their records, through splits and deletes
+		try
+		{
+			int key = 0;
+			index.insertEntry(&key, rids[0]);
+			checkPassFail(0, 1)
+		}
+		catch (const BadIndexInfoException &e)
+		{
+		}
+		RECORD record;
+		memset(&record, 0, sizeof(record));
+		for (int i = 0; i < 3 * relationSize; i++)
+		{
+			record.i = i % relationSize;
+			record.d = (double)record.i;
+			sprintf(record.s, "%05d string record", record.i);
+			RecordId newRid;
+			newRid.page_number = 100000 + i;
+			newRid.slot_number = 1;
+			index.insertEntry(&record.i, newRid, (const char *)&record);
+		}
+		int deleted = 0;
+		for (int i = 0; i < 3 * relationSize; i += 2)
+		{
+			RecordId newRid;
+			newRid.page_number = 100000 + i;
+			newRid.slot_number = 1;
+			const int key = i % relationSize;
+			deleted += index.deleteEntry(&key, newRid);
+		}
+		checkPassFail(deleted, (3 * relationSize + 1) / 2)
+
+		// Every entry still carries the payload of its own key
+		lowVal = -1;
+		highVal = relationSize;
+		index.startScan(&lowVal, GT, &highVal, LT);
+		count = 0;
+		wrong = 0;
+		double last = -1;
+		try
+		{
+			while (true)
+			{
+				RecordId outRid;
+				char payload[sizeof(double) + 5];
+				index.scanNext(outRid, payload);
+				double d;
+				memcpy(&d, payload, sizeof(double));
+				char s[6];
+				sprintf(s, "%05d", (int)d);
+				wrong += d < last || memcmp(payload + sizeof(double), s, 5) != 0;
+				last = d;
+				count++;
+			}
+		}
+		catch (const IndexScanCompletedException &e)
+		{
+		}
+		index.endScan();
+		checkPassFail(count, relationSize + 3 * relationSize / 2)
+		checkPassFail(wrong, 0)
+	}
+
+	// Opening the index with other payload columns is an error
+	columns.pop_back();
+	bool mismatch = false;
+	try
+	{
+		BTreeIndex other(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, bulkLoad, DEFAULT_FILL_FACTOR, columns);
+	}
+	catch (const BadIndexInfoException &e)
+	{
+		mismatch = true;
+	}
+	checkPassFail(mismatch, true)
+}
+
+// -----------------------------------------------------------------------------
+// heapScanTests
+// -----------------------------------------------------------------------------
+
+void heapScanTests()
+{
+	std::cout << "Fetch the records of index range scans one heap page at a time" << std::endl;
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+	const int ranges[][2] = {{25, 40}, {0, relationSize}, {1000, 1001}, {3000, 4500}};
+	for (size_t r = 0; r < sizeof(ranges) / sizeof(ranges[0]); r++)
+	{
+		const int low = ranges[r][0], high = ranges[r][1];
+		ScanCursor cursor = index.openScan(&low, GTE, &high, LT);
+		BitmapHeapScan heapScan(file1, bufMgr, cursor);
+		int count = 0;
+		int outOfRange = 0;
+		int outOfOrder = 0;
+		int pages = 0;
+		RecordId rid, prev;
+		try
+		{
+			while (true)
+			{
+				heapScan.scanNext(rid);
+				const RECORD record = *(reinterpret_cast<const RECORD *>(heapScan.getRecord().data()));
+				outOfRange += record.i < low || record.i >= high;
+				if (count > 0)
+				{
+					outOfOrder += rid.page_number < prev.page_number ||
+								  (rid.page_number == prev.page_number && rid.slot_number <= prev.slot_number);
+				}
+				pages += count == 0 || rid.page_number != prev.page_number;
+				prev = rid;
+				count++;
+			}
+		}
+		catch (const EndOfFileException &e)
+		{
+		}
+		// Every record of the range, in file order, with each heap page read once
+		const int expected = std::min(high, relationSize) - low;
+		checkPassFail(count, expected)
+		checkPassFail(outOfRange, 0)
+		checkPassFail(outOfOrder, 0)
+		checkPassFail(heapScan.pagesRead(), pages)
+	}
+}
+
+// -----------------------------------------------------------------------------
+// reverseScanTests
+// -----------------------------------------------------------------------------
+
+/**
+ * Record ids of every entry of the scan of cursor, fetched in batches of batchSize.
+ */
+std::vector<RecordId> drainScan(ScanCursor &cursor, const size_t batchSize)
+{
+	std::vector<RecordId> rids;
+	std::vector<RecordId> batch(batchSize);
+	size_t got;
+	while ((got = cursor.scanNextBatch(&batch[0], batchSize)) > 0)
+	{
+		rids.insert(rids.end(), batch.begin(), batch.begin() + got);
+	}
+	return rids;
+}
+
+void reverseScanTests()
+{
+	std::cout << "Scan the integer index from the high bound down" << std::endl;
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, true, 0.5);
+	int low = 0, high = relationSize;
+	ScanCursor forward = index.openScan(&low, GTE, &high, LT);
+	const std::vector<RecordId> rids = drainScan(forward, 500);
+	forward.close();
+
+	// One entry at a time and in batches, the reverse scan returns the forward one backwards
+	ScanCursor reverse = index.openReverseScan(&low, GTE, &high, LT);
+	std::vector<RecordId> backwards;
+	RecordId rid;
+	try
+	{
+		while (true)
+		{
+			reverse.scanNext(rid);
+			backwards.push_back(rid);
+		}
+	}
+	catch (const IndexScanCompletedException &e)
+	{
+	}
+	reverse.close();
+	std::reverse(backwards.begin(), backwards.end());
+	checkPassFail(backwards.size(), rids.size())
+	const bool sameOne = backwards == rids;
+	checkPassFail(sameOne, true)
+	reverse = index.openReverseScan(&low, GTE, &high, LT);
+	backwards = drainScan(reverse, 37);
+	reverse.close();
+	std::reverse(backwards.begin(), backwards.end());
+	const bool sameBatch = backwards == rids;
+	checkPassFail(sameBatch, true)
+
+	// Bounds, and the first entries of a scan that is not run to its end
+	low = 25;
+	high = 40;
+	reverse = index.openReverseScan(&low, GT, &high, LT);
+	checkPassFail(drainScan(reverse, 5).size(), 14)
+	reverse.close();
+	high = 3000;
+	reverse = index.openReverseScan(&low, GT, &high, LTE);
+	RecordId top[10];
+	const size_t numTop = reverse.scanNextBatch(top, 10);
+	reverse.close();
+	checkPassFail(numTop, 10)
+	const bool topMatches = std::equal(top, top + 10, rids.rbegin() + (relationSize - 3001));
+	checkPassFail(topMatches, true)
+	high = 10;
+	bool thrown = false;
+	try
+	{
+		reverse = index.openReverseScan(&high, GT, &high, LTE);
+	}
+	catch (const NoSuchKeyFoundException &e)
+	{
+		thrown = true;
+	}
+	checkPassFail(thrown, true)
+
+	// After deletes merge leaves and inserts split them, the left links still lead through every leaf,
+	// and duplicates of a key come back in the reverse of their forward order
+	for (int key = 1000; key < relationSize; key += 3)
+	{
+		index.deleteEntry(&key, rids[key]);
+	}
+	for (int key = 2000; key < 2500; key++)
+	{
+		index.insertEntry(&key, rids[relationSize - 1 - key]);
+	}
+	low = 0;
+	high = relationSize;
+	forward = index.openScan(&low, GTE, &high, LT);
+	const std::vector<RecordId> after = drainScan(forward, 500);
+	forward.close();
+	reverse = index.openReverseScan(&low, GTE, &high, LT);
+	backwards = drainScan(reverse, 64);
+	reverse.close();
+	std::reverse(backwards.begin(), backwards.end());
+	checkPassFail(backwards.size(), after.size())
+	const bool sameAfter = backwards == after;
+	checkPassFail(sameAfter, true)
+}
+
+// -----------------------------------------------------------------------------
+// negativeKeyTests
+// -----------------------------------------------------------------------------
+
+void negativeKeyTests()
+{
+	std::cout << "Index negative keys, -1 included" << std::endl;
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+	std::vector<RecordId> found;
+	int key = 0;
+	index.lookup(&key, found);
+	// Enough negative keys to split leaves and their parents, with -1 among them many times over
+	const int numNegative = 5000;
+	for (key = -numNegative; key < 0; key++)
+	{
+		index.insertEntry(&key, found[0]);
+	}
+	key = -1;
+	for (int i = 0; i < 999; i++)
+	{
+		index.insertEntry(&key, found[0]);
+	}
+	key = INT_MIN;
+	index.insertEntry(&key, found[0]);
+	found.clear();
+	key = -1;
+	checkPassFail(index.lookup(&key, found), 1000)
+	checkPassFail(intScan(&index, -3, GTE, 0, LT), 1002)
+	checkPassFail(batchScan(&index, INT_MIN, GTE, 0, LT, 500), numNegative + 1000)
+	checkPassFail(batchScan(&index, INT_MIN, GTE, relationSize, LT, 500), relationSize + numNegative + 1000)
+	// Deleting them leaves the relation's keys as they were
+	int deleted = 0;
+	for (size_t i = 0; i < found.size(); i++)
+	{
+		deleted += index.deleteEntry(&key, found[i]);
+	}
+	checkPassFail(deleted, 1000)
+	checkPassFail(index.contains(&key), false)
+	checkPassFail(batchScan(&index, INT_MIN, GTE, relationSize, LT, 500), relationSize + numNegative)
+}
+
+// -----------------------------------------------------------------------------
+// countTests
+// -----------------------------------------------------------------------------
+
+void countTests(const bool bulkLoad)
+{
+	std::cout << "Count, rank and select on the integer index" << std::endl;
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, bulkLoad);
+	int low = 25, high = 40;
+	checkPassFail(index.countRange(&low, GT, &high, LT), 14)
+	checkPassFail(index.countRange(&low, GTE, &high, LTE), 16)
+	low = -100;
+	high = relationSize + 100;
+	checkPassFail(index.countRange(&low, GT, &high, LT), relationSize)
+	// A range with no keys in it counts none rather than throwing
+	low = relationSize;
+	checkPassFail(index.countRange(&low, GTE, &high, LTE), 0)
+	bool thrown = false;
+	try
+	{
+		index.countRange(&high, GTE, &low, LTE);
+	}
+	catch (const BadScanrangeException &e)
+	{
+		thrown = true;
+	}
+	checkPassFail(thrown, true)
+	thrown = false;
+	try
+	{
+		index.countRange(&low, LT, &high, LTE);
+	}
+	catch (const BadOpcodesException &e)
+	{
+		thrown = true;
+	}
+	checkPassFail(thrown, true)
+
+	// Every key has its own position, and select finds the key at it
+	int ranked = 0, selected = 0;
+	int key;
+	RecordId rid;
+	for (int k = 0; k < relationSize; k++)
+	{
+		ranked += index.rank(&k) == (size_t)k;
+		selected += index.select(k, &key, rid) && key == k;
+	}
+	checkPassFail(ranked, relationSize)
+	checkPassFail(selected, relationSize)
+	checkPassFail(index.select(relationSize, &key, rid), false)
+
+	// Duplicates that fill leaves of their own, and deletes that merge leaves, are counted in the nodes above
+	key = 200;
+	for (int i = 0; i < 3000; i++)
+	{
+		index.insertEntry(&key, rid);
+	}
+	for (key = 1000; key < relationSize; key += 2)
+	{
+		std::vector<RecordId> found;
+		index.lookup(&key, found);
+		index.deleteEntry(&key, found[0]);
+	}
+	const int bounds[][2] = {{0, relationSize}, {150, 250}, {200, 201}, {199, 1001}, {900, 4000}, {2001, 2003}};
+	int matching = 0;
+	for (size_t b = 0; b < sizeof(bounds) / sizeof(bounds[0]); b++)
+	{
+		matching += index.countRange(&bounds[b][0], GTE, &bounds[b][1], LT)
+			== (size_t)batchScan(&index, bounds[b][0], GTE, bounds[b][1], LT, 500);
+	}
+	checkPassFail(matching, 6)
+	key = 201;
+	checkPassFail(index.rank(&key), 3201)
+
+	// Select at each position returns the entry a scan returns there
+	low = 0;
+	high = relationSize;
+	ScanCursor cursor = index.openScan(&low, GTE, &high, LT);
+	const std::vector<RecordId> rids = drainScan(cursor, 500);
+	cursor.close();
+	checkPassFail(rids.size(), index.countRange(&low, GTE, &high, LT))
+	selected = 0;
+	for (size_t k = 0; k < rids.size(); k++)
+	{
+		selected += index.select(k, &key, rid) && rid == rids[k] && index.rank(&key) <= k;
+	}
+	const int numRids = (int)rids.size();
+	checkPassFail(selected, numRids)
+	checkPassFail(index.select(rids.size(), &key, rid), false)
+}
+
+// -----------------------------------------------------------------------------
+// postingTests
+// -----------------------------------------------------------------------------
+
+/**
+ * Orders record ids by page, then slot.
+ */
+bool ridLess(const RecordId &a, const RecordId &b)
+{
+	return a.page_number < b.page_number || (a.page_number == b.page_number && a.slot_number < b.slot_number);
+}
+
+/**
+ * Record ids of the entries of the integer index in [lowVal, highVal], one scanNext at a time.
+ */
+std::vector<RecordId> scanRids(BTreeIndex &index, const int lowVal, const int highVal)
+{
+	std::vector<RecordId> rids;
+	ScanCursor cursor = index.openScan(&lowVal, GTE, &highVal, LTE);
+	RecordId rid;
+	try
+	{
+		while (true)
+		{
+			cursor.scanNext(rid);
+			rids.push_back(rid);
+		}
+	}
+	catch (const IndexScanCompletedException &e)
+	{
+	}
+	// A scan that is done stays done, even in the middle of a posting list
+	bool done = false;
+	try
+	{
+		cursor.scanNext(rid);
+	}
+	catch (const IndexScanCompletedException &e)
+	{
+		done = true;
+	}
+	checkPassFail(done, true)
+	cursor.close();
+	return rids;
+}
+
+void postingTests(const bool bulkLoad)
+{
+	std::cout << "Fill leaves with the posting lists of a few hot keys of the integer index" << std::endl;
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, bulkLoad);
+	// Key 100 gets entries enough for several leaves, key 101 a few, in an order the record ids do not sort in
+	int key = 100;
+	std::vector<RecordId> hot;
+	index.lookup(&key, hot);
+	for (int i = 0; i < 3000; i++)
+	{
+		RecordId rid;
+		rid.page_number = 10000 + (i * 7919) % 3000;
+		rid.slot_number = 1;
+		key = 100 + i % 3 / 2;
+		index.insertEntry(&key, rid);
+		if (key == 100)
+		{
+			hot.push_back(rid);
+		}
+	}
+
+	// Lookup and scans forward and back agree on the order of the duplicates
+	key = 100;
+	std::vector<RecordId> found;
+	index.lookup(&key, found);
+	checkPassFail(found.size(), hot.size())
+	std::vector<RecordId> sorted(found);
+	std::sort(sorted.begin(), sorted.end(), ridLess);
+	std::sort(hot.begin(), hot.end(), ridLess);
+	const bool sameEntries = sorted == hot;
+	checkPassFail(sameEntries, true)
+	const bool sameScan = scanRids(index, 100, 100) == found;
+	checkPassFail(sameScan, true)
+	int low = 100, high = 100;
+	ScanCursor cursor = index.openScan(&low, GTE, &high, LTE);
+	const bool sameBatch = drainScan(cursor, 37) == found;
+	checkPassFail(sameBatch, true)
+	cursor.close();
+	cursor = index.openReverseScan(&low, GTE, &high, LTE);
+	std::vector<RecordId> backwards = drainScan(cursor, 37);
+	cursor.close();
+	std::reverse(backwards.begin(), backwards.end());
+	const bool sameReverse = backwards == found;
+	checkPassFail(sameReverse, true)
+	checkPassFail(scanRids(index, 99, 102).size(), found.size() + 1000 + 3)
+	checkPassFail(index.countRange(&low, GTE, &high, LTE), found.size())
+
+	// A scan in the middle of the posting lists carries on past entries deleted and inserted meanwhile
+	cursor = index.openScan(&low, GTE, &high, LTE);
+	std::vector<RecordId> returned;
+	RecordId rid;
+	for (int i = 0; i < 700; i++)
+	{
+		cursor.scanNext(rid);
+		returned.push_back(rid);
+	}
+	for (size_t i = 600; i < 1600; i += 2)
+	{
+		index.deleteEntry(&key, found[i]);
+	}
+	std::vector<RecordId> inserted;
+	for (int i = 0; i < 200; i++)
+	{
+		rid.page_number = 20000 + i;
+		index.insertEntry(&key, rid);
+		inserted.push_back(rid);
+	}
+	const std::vector<RecordId> rest = drainScan(cursor, 50);
+	cursor.close();
+	// Entries inserted during the scan may or may not be returned, but only once, and the rest in order
+	int seenInserted = 0;
+	for (size_t i = 0; i < rest.size(); i++)
+	{
+		if (rest[i].page_number >= 20000)
+		{
+			seenInserted++;
+		}
+		else
+		{
+			returned.push_back(rest[i]);
+		}
+	}
+	const bool insertedOnce = seenInserted <= 200;
+	checkPassFail(insertedOnce, true)
+	std::vector<RecordId> expected(found.begin(), found.begin() + 700);
+	for (size_t i = 700; i < found.size(); i++)
+	{
+		if (i >= 1600 || i % 2 == 1)
+		{
+			expected.push_back(found[i]);
+		}
+	}
+	const bool carriedOn = returned == expected;
+	checkPassFail(carriedOn, true)
+
+	// Deleting all entries of a key drops its posting lists and merges the leaves they leave underfull
+	expected.insert(expected.end(), inserted.begin(), inserted.end());
+	int deleted = 0;
+	for (size_t i = 0; i < expected.size(); i++)
+	{
+		deleted += index.deleteEntry(&key, expected[i]);
+	}
+	// The entries the scan returned before the first deletions were already gone
+	checkPassFail(deleted, (int)expected.size() - 50)
+	checkPassFail(index.contains(&key), false)
+	low = 0;
+	high = relationSize;
+	checkPassFail(index.countRange(&low, GTE, &high, LT), relationSize - 1 + 1000)
+	checkPassFail(batchScan(&index, 0, GTE, relationSize, LT, 500), relationSize - 1 + 1000)
+}
+
+// -----------------------------------------------------------------------------
+// compositeTests
+// -----------------------------------------------------------------------------
+
+/**
+ * Time of the i-th entry inserted by compositeTests, unique, negative for about one in eight.
+ */
+double entryTime(const int i)
+{
+	return (i * 7919 % 3000) * 0.5 - 200;
+}
+
+void compositeTests(const bool bulkLoad)
+{
+	std::cout << "Index composite (INTEGER, DOUBLE) keys, and scan by their leading column" << std::endl;
+	std::vector<KeyColumn> columns(2);
+	columns[0].set(offsetof(tuple, i), INTEGER);
+	columns[1].set(offsetof(tuple, d), DOUBLE);
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, columns, bulkLoad);
+		// Keys compare as the values they are made of, column by column, negative values included
+		const int ints[] = {INT_MIN, -70000, -1, 0, 1, 256, INT_MAX};
+		const double doubles[] = {-1e300, -2.5, -0.5, -1e-300, 0.0, 1e-300, 0.75, 3.0, 1e300};
+		const int numInts = sizeof(ints) / sizeof(ints[0]);
+		const int numDoubles = sizeof(doubles) / sizeof(doubles[0]);
+		CompositeKey previous = index.compositeKey(NULL, 0);
+		int ordered = 0;
+		for (int a = 0; a < numInts; a++)
+		{
+			for (int b = 0; b < numDoubles; b++)
+			{
+				const void *values[] = {&ints[a], &doubles[b]};
+				const CompositeKey key = index.compositeKey(values, 2);
+				ordered += previous < key;
+				previous = key;
+			}
+		}
+		checkPassFail(ordered, numInts * numDoubles)
+		const double negativeZero = -0.0;
+		const void *zeros[] = {&ints[3], &negativeZero};
+		const void *positiveZeros[] = {&ints[3], &doubles[4]};
+		const bool sameZero = index.compositeKey(zeros, 2) == index.compositeKey(positiveZeros, 2);
+		checkPassFail(sameZero, true)
+
+		// Each record of the relation has its own first column
+		int tenant = 42;
+		const void *prefix[] = {&tenant};
+		ScanCursor cursor = index.openPrefixScan(prefix, 1);
+		checkPassFail(drainScan(cursor, 10).size(), 1)
+		cursor.close();
+
+		// Entries of five tenants, with keys below those of the relation, at times inserted out of order
+		const int numEntries = 3000;
+		for (int i = 0; i < numEntries; i++)
+		{
+			tenant = -1 - i % 5;
+			const double time = entryTime(i);
+			const void *values[] = {&tenant, &time};
+			const CompositeKey key = index.compositeKey(values, 2);
+			RecordId rid;
+			rid.page_number = i;
+			rid.slot_number = 1;
+			index.insertEntry(&key, rid);
+		}
+
+		// The entries of a tenant are one range of keys, in time order
+		int inOrder = 0;
+		for (tenant = -5; tenant <= -1; tenant++)
+		{
+			cursor = index.openPrefixScan(prefix, 1);
+			const std::vector<RecordId> rids = drainScan(cursor, 64);
+			cursor.close();
+			bool sorted = rids.size() == (size_t)numEntries / 5;
+			for (size_t i = 0; i < rids.size(); i++)
+			{
+				sorted = sorted && -1 - (int)rids[i].page_number % 5 == tenant &&
+						 (i == 0 || entryTime(rids[i - 1].page_number) < entryTime(rids[i].page_number));
+			}
+			inOrder += sorted;
+		}
+		checkPassFail(inOrder, 5)
+
+		// A time range of one tenant is the range between two keys, whichever way it is read
+		tenant = -3;
+		const double from = -100, to = 400;
+		int expected = 0;
+		for (int i = 0; i < numEntries; i++)
+		{
+			expected += -1 - i % 5 == tenant && entryTime(i) >= from && entryTime(i) < to;
+		}
+		const void *lowValues[] = {&tenant, &from};
+		const void *highValues[] = {&tenant, &to};
+		const CompositeKey low = index.compositeKey(lowValues, 2);
+		const CompositeKey high = index.compositeKey(highValues, 2);
+		checkPassFail(index.countRange(&low, GTE, &high, LT), (size_t)expected)
+		cursor = index.openScan(&low, GTE, &high, LT);
+		std::vector<RecordId> forward = drainScan(cursor, 37);
+		cursor.close();
+		cursor = index.openReverseScan(&low, GTE, &high, LT);
+		std::vector<RecordId> backward = drainScan(cursor, 37);
+		cursor.close();
+		std::reverse(backward.begin(), backward.end());
+		checkPassFail(forward.size(), (size_t)expected)
+		const bool sameRange = forward == backward;
+		checkPassFail(sameRange, true)
+
+		// Deleting a tenant's entries leaves the others
+		tenant = -2;
+		int deleted = 0;
+		for (int i = 1; i < numEntries; i += 5)
+		{
+			const double time = entryTime(i);
+			const void *values[] = {&tenant, &time};
+			const CompositeKey key = index.compositeKey(values, 2);
+			RecordId rid;
+			rid.page_number = i;
+			rid.slot_number = 1;
+			deleted += index.deleteEntry(&key, rid);
+		}
+		checkPassFail(deleted, numEntries / 5)
+		bool empty = false;
+		try
+		{
+			cursor = index.openPrefixScan(prefix, 1);
+		}
+		catch (const NoSuchKeyFoundException &e)
+		{
+			empty = true;
+		}
+		checkPassFail(empty, true)
+
+		// More values than key columns make no key
+		bool tooMany = false;
+		try
+		{
+			const void *values[] = {&tenant, &from, &to};
+			index.compositeKey(values, 3);
+		}
+		catch (const BadIndexInfoException &e)
+		{
+			tooMany = true;
+		}
+		checkPassFail(tooMany, true)
+	}
+
+	// The key columns are kept in the meta page: the index opens again with them, and only with them
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, columns, bulkLoad);
+		int tenant = -4;
+		const void *prefix[] = {&tenant};
+		ScanCursor cursor = index.openPrefixScan(prefix, 1);
+		checkPassFail(drainScan(cursor, 100).size(), 600)
+		cursor.close();
+	}
+	bool mismatch = false;
+	columns[1].set(offsetof(tuple, d), INTEGER);
+	try
+	{
+		BTreeIndex other(relationName, intIndexName, bufMgr, columns, bulkLoad);
+	}
+	catch (const BadIndexInfoException &e)
+	{
+		mismatch = true;
+	}
+	checkPassFail(mismatch, true)
+	bool tooLarge = false;
+	columns.assign(MAX_KEY_COLUMNS, columns[1]);
+	for (size_t i = 0; i < columns.size(); i++)
+	{
+		columns[i].set(offsetof(tuple, s), STRING);
+	}
+	try
+	{
+		std::string name;
+		BTreeIndex other(relationName, name, bufMgr, columns, bulkLoad);
+	}
+	catch (const BadIndexInfoException &e)
+	{
+		tooLarge = true;
+	}
+	checkPassFail(tooLarge, true)
+}
+
+// -----------------------------------------------------------------------------
+// writeBufferTests
+// -----------------------------------------------------------------------------
+
+void writeBufferTests()
+{
+	std::cout << "Buffer random inserts into the integer index and read them back" << std::endl;
+	const int numNew = 2500;
+	std::vector<RecordId> rids;
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+		rids = scanRids(index, 0, numNew - 1);
+		index.setWriteBuffer(1000);
+
+		// Keys past those of the relation in random order, flushed twice on the way
+		for (int i = 0; i < numNew; i++)
+		{
+			const int key = relationSize + (int)((long)i * 7919 % numNew);
+			index.insertEntry(&key, rids[i]);
+		}
+		// Point reads search the inserts still held back without flushing them
+		checkPassFail(index.getBufferedInserts(), (size_t)(numNew % 1000))
+		int key = relationSize + numNew - 1;
+		checkPassFail(index.contains(&key), true)
+		int low = 0, high = relationSize + numNew;
+		checkPassFail(index.countRange(&low, GTE, &high, LT), (size_t)(relationSize + numNew))
+		low = relationSize + numNew - 10;
+		high = relationSize + numNew - 1;
+		checkPassFail(index.countRange(&low, GT, &high, LTE), 9)
+		checkPassFail(index.getBufferedInserts(), (size_t)(numNew % 1000))
+
+		// A key in the tree and held back as well is found in both, the entry held back last
+		key = 0;
+		index.insertEntry(&key, rids[1]);
+		std::vector<RecordId> found;
+		checkPassFail(index.lookup(&key, found), 2)
+		checkPassFail((found.size() == 2 && found[1] == rids[1]), true)
+		checkPassFail(index.getBufferedInserts(), (size_t)(numNew % 1000 + 1))
+		checkPassFail(index.deleteEntry(&key, rids[1]), true)
+		checkPassFail(index.getBufferedInserts(), 0)
+
+		// Every other read flushes them first
+		key = relationSize + numNew - 1;
+		checkPassFail(intScan(&index, relationSize - 10, GTE, relationSize + 10, LT), 20)
+		checkPassFail(batchScan(&index, 0, GTE, relationSize + numNew, LT, 500), relationSize + numNew)
+		checkPassFail(index.rank(&key), (size_t)(relationSize + numNew - 1))
+
+		// An entry deleted while it is held back is gone
+		key = -10;
+		index.insertEntry(&key, rids[0]);
+		checkPassFail(index.deleteEntry(&key, rids[0]), true)
+		checkPassFail(index.contains(&key), false)
+
+		// Entries held back when the index is destroyed are kept
+		for (key = -5; key < 0; key++)
+		{
+			index.insertEntry(&key, rids[0]);
+		}
+	}
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+		checkPassFail(intScan(&index, -10, GTE, 0, LT), 5)
+		// Turning the buffer off inserts what it holds
+		index.setWriteBuffer(10);
+		const int key = -20;
+		index.insertEntry(&key, rids[0]);
+		index.setWriteBuffer(0);
+		std::vector<RecordId> found;
+		checkPassFail(index.lookup(&key, found), 1)
+	}
+
+	// The buffer holds no payloads
+	std::vector<PayloadColumn> columns(1);
+	columns[0].set(offsetof(tuple, i), sizeof(int));
+	BTreeIndex covering(relationName, doubleIndexName, bufMgr, offsetof(tuple, d), DOUBLE, true, DEFAULT_FILL_FACTOR, columns);
+	bool thrown = false;
+	try
+	{
+		covering.setWriteBuffer(100);
+	}
+	catch (const BadIndexInfoException &e)
+	{
+		thrown = true;
+	}
+	checkPassFail(thrown, true)
+}
+
+// -----------------------------------------------------------------------------
+// hotNodeTests
+// -----------------------------------------------------------------------------
+
+void hotNodeTests()
+{
+	std::cout << "Read the root of the integer index from the hot-node cache" << std::endl;
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+	// The first descent puts the root in the cache, and every later one finds it there
+	int key = 0;
+	checkPassFail(index.contains(&key), true)
+	std::uint64_t saved = index.getBufferCallsSaved();
+	int hits = 0;
+	for (key = 0; key < relationSize; key += 50)
+	{
+		hits += index.contains(&key);
+	}
+	checkPassFail(hits, relationSize / 50)
+	checkPassFail(index.getBufferCallsSaved() - saved, (std::uint64_t)(2 * relationSize / 50))
+	saved = index.getBufferCallsSaved();
+	int low = 100, high = 200;
+	checkPassFail(index.countRange(&low, GTE, &high, LT), 100)
+	RecordId rid;
+	checkPassFail(index.select(10, &key, rid), true)
+	checkPassFail(key, 10)
+	checkPassFail(index.getBufferCallsSaved() - saved, 6)
+
+	// Deletes merge and free leaves under the cached root, and the entries left are all found
+	std::vector<RecordId> rids = scanRids(index, 0, relationSize - 1);
+	int deleted = 0;
+	for (key = 0; key < relationSize; key++)
+	{
+		if (key % 10 != 0)
+		{
+			deleted += index.deleteEntry(&key, rids[key]);
+		}
+	}
+	checkPassFail(deleted, relationSize - relationSize / 10)
+	hits = 0;
+	for (key = 0; key < relationSize; key += 10)
+	{
+		hits += index.contains(&key);
+	}
+	checkPassFail(hits, relationSize / 10)
+
+	// With the cache off every node goes through the buffer manager
+	index.setHotLevels(0);
+	saved = index.getBufferCallsSaved();
+	checkPassFail(intScan(&index, 0, GTE, 100, LT), 10)
+	checkPassFail(index.getBufferCallsSaved(), saved)
+}
+
+// -----------------------------------------------------------------------------
+// swizzleTests
+// -----------------------------------------------------------------------------
+
+void swizzleTests()
+{
+	std::cout << "Follow swizzled child pointers of the integer index" << std::endl;
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+	// With the hot-node cache off, only swizzling saves buffer manager calls
+	index.setHotLevels(0);
+	index.setSwizzling(8);
+	int key = 0;
+	checkPassFail(index.contains(&key), true)
+	std::uint64_t saved = index.getBufferCallsSaved();
+	int hits = 0;
+	for (key = 0; key < relationSize; key += 50)
+	{
+		hits += index.contains(&key);
+	}
+	checkPassFail(hits, relationSize / 50)
+	checkPassFail(index.getBufferCallsSaved() - saved, (std::uint64_t)(2 * relationSize / 50))
+
+	// Inserts split leaves under the swizzled root, and every entry is found through it
+	RecordId rid;
+	for (key = relationSize; key < 2 * relationSize; key++)
+	{
+		rid.page_number = key / 100 + 1;
+		rid.slot_number = key % 100 + 1;
+		index.insertEntry(&key, rid);
+	}
+	hits = 0;
+	for (key = 0; key < 2 * relationSize; key += 10)
+	{
+		hits += index.contains(&key);
+	}
+	checkPassFail(hits, 2 * relationSize / 10)
+	int low = relationSize, high = 2 * relationSize;
+	checkPassFail(index.countRange(&low, GTE, &high, LT), relationSize)
+
+	// Turning swizzling off unpins the root, which then goes through the buffer manager again
+	index.setSwizzling(0);
+	saved = index.getBufferCallsSaved();
+	checkPassFail(intScan(&index, 0, GTE, 100, LT), 100)
+	checkPassFail(index.getBufferCallsSaved(), saved)
+}
+
+// -----------------------------------------------------------------------------
+// snapshotTests
+// -----------------------------------------------------------------------------
+
+void snapshotTests()
+{
+	std::cout << "Scan snapshots of the integer index while inserts and deletes change it" << std::endl;
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+	const std::vector<RecordId> before = scanRids(index, 0, relationSize - 1);
+	ScanOptions options;
+	options.snapshot = true;
+	int low = 0, high = relationSize;
+	ScanCursor forward = index.openScan(&low, GTE, &high, LT, options);
+	ScanCursor reverse = index.openReverseScan(&low, GTE, &high, LT, options);
+	std::vector<RecordId> seen(100);
+	checkPassFail(forward.scanNextBatch(&seen[0], 100), 100)
+	// Nothing has changed yet, so nothing is copied
+	checkPassFail(index.getSnapshotCopies(), 0)
+
+	// Inserts split leaves, and deletes merge and free them
+	RecordId rid;
+	for (int key = relationSize; key < 2 * relationSize; key++)
+	{
+		rid.page_number = key / 100 + 1;
+		rid.slot_number = key % 100 + 1;
+		index.insertEntry(&key, rid);
+	}
+	for (int key = 0; key < relationSize; key++)
+	{
+		if (key % 10 != 0)
+		{
+			index.deleteEntry(&key, before[key]);
+		}
+	}
+	high = 2 * relationSize;
+	checkPassFail(index.countRange(&low, GTE, &high, LT), (size_t)(relationSize + relationSize / 10))
+	checkPassFail((index.getSnapshotCopies() > 0), true)
+
+	// The snapshot scans return the entries as they were when they were opened, in both directions
+	std::vector<RecordId> rest = drainScan(forward, 333);
+	seen.insert(seen.end(), rest.begin(), rest.end());
+	checkPassFail((seen == before), true)
+	std::vector<RecordId> backwards;
+	try
+	{
+		while (true)
+		{
+			reverse.scanNext(rid);
+			backwards.push_back(rid);
+		}
+	}
+	catch (const IndexScanCompletedException &e)
+	{
+	}
+	std::reverse(backwards.begin(), backwards.end());
+	checkPassFail((backwards == before), true)
+
+	// Copies go once no snapshot is left to read them
+	forward.close();
+	checkPassFail((index.getSnapshotCopies() > 0), true)
+	reverse.close();
+	checkPassFail(index.getSnapshotCopies(), 0)
+
+	// A snapshot taken now sees the changes
+	ScanCursor after = index.openScan(&low, GTE, &high, LT, options);
+	checkPassFail(drainScan(after, 500).size(), (size_t)(relationSize + relationSize / 10))
+	after.close();
+	low = relationSize + 1;
+	high = relationSize + 9;
+	for (int key = low; key <= high; key++)
+	{
+		index.deleteEntry(&key, scanRids(index, key, key)[0]);
+	}
+	bool thrown = false;
+	try
+	{
+		index.openScan(&low, GTE, &high, LTE, options);
+	}
+	catch (const NoSuchKeyFoundException &e)
+	{
+		thrown = true;
+	}
+	checkPassFail(thrown, true)
+	checkPassFail(index.getSnapshotCopies(), 0)
+}
+
+// -----------------------------------------------------------------------------
+// parallelBuildTests
+// -----------------------------------------------------------------------------
+
+/**
+ * Entries of the integer index, built with the double field as its payload, whose payload is not their key.
+ */
+int payloadErrors(BTreeIndex &index, int &count)
+{
+	RecordId rids[100];
+	double payloads[100];
+	int low = 0, high = relationSize;
+	ScanCursor cursor = index.openScan(&low, GTE, &high, LT);
+	count = 0;
+	int wrong = 0;
+	size_t got;
+	while ((got = cursor.scanNextBatch(rids, (char *)payloads, 100)) > 0)
+	{
+		for (size_t i = 0; i < got; i++)
+		{
+			wrong += payloads[i] != (double)count;
+			count++;
+		}
+	}
+	cursor.close();
+	return wrong;
+}
+
+void parallelBuildTests()
+{
+	std::cout << "Bulk load the integer index from a relation scanned on several threads" << std::endl;
+	std::vector<RecordId> serial;
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+		serial = scanRids(index, 0, relationSize - 1);
+	}
+	deleteIndexFile();
+	// With more threads than the relation has pages, each thread scans one page
+	const int threadCounts[] = {2, 3, MAX_BUILD_THREADS};
+	BuildOptions options;
+	for (int t = 0; t < 3; t++)
+	{
+		options.threads = threadCounts[t];
+		{
+			BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, true, DEFAULT_FILL_FACTOR,
+							 std::vector<PayloadColumn>(), options);
+			checkPassFail((scanRids(index, 0, relationSize - 1) == serial), true)
+			checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+		}
+		deleteIndexFile();
+	}
+
+	// Payloads are merged along with their pairs
+	std::vector<PayloadColumn> columns(1);
+	columns[0].set(offsetof(tuple, d), sizeof(double));
+	options.threads = 4;
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, true, DEFAULT_FILL_FACTOR,
+					 columns, options);
+	int count;
+	checkPassFail(payloadErrors(index, count), 0)
+	checkPassFail(count, relationSize)
+}
+
+// -----------------------------------------------------------------------------
+// externalSortTests
+// -----------------------------------------------------------------------------
+
+struct SortItem
+{
+	int key;
+	int seq;
+	int pad;
+};
+
+bool sortItemLess(const char *a, const char *b)
+{
+	return ((const SortItem *)a)->key < ((const SortItem *)b)->key;
+}
+
+void externalSortTests()
+{
+	std::cout << "Sort records in runs on disk and bulk load the integer index through an external sort" << std::endl;
+	{
+		// Runs of 12-byte records do not line up with the pages, and a budget of two pages merges two runs
+		// at a time, so the runs are merged in passes before the final merge
+		ExternalSort sorter(bufMgr, sizeof(SortItem), 2 * Page::SIZE, sortItemLess);
+		const int count = 20000;
+		unsigned seed = 1;
+		SortItem item;
+		item.pad = 0;
+		for (int i = 0; i < count; i++)
+		{
+			seed = seed * 1103515245 + 12345;
+			item.key = (seed >> 8) % 1000;
+			item.seq = i;
+			sorter.add((const char *)&item);
+		}
+		checkPassFail(sorter.size(), (size_t)count)
+		checkPassFail((sorter.getRunCount() > 2), true)
+		// Equal keys come back in the order they were added
+		SortItem prev;
+		int got = 0;
+		int wrong = 0;
+		try
+		{
+			while (true)
+			{
+				sorter.scanNext((char *)&item);
+				wrong += got > 0 && (item.key < prev.key || (item.key == prev.key && item.seq < prev.seq));
+				prev = item;
+				got++;
+			}
+		}
+		catch (const EndOfFileException &e)
+		{
+		}
+		checkPassFail(got, count)
+		checkPassFail(wrong, 0)
+		checkPassFail((sorter.getMergeCount() > 0), true)
+	}
+	{
+		// Records fit in memory, so nothing goes to disk
+		ExternalSort sorter(bufMgr, sizeof(SortItem), 1 << 20, sortItemLess);
+		SortItem item;
+		for (int i = 0; i < 100; i++)
+		{
+			item.key = 100 - i;
+			sorter.add((const char *)&item);
+		}
+		int got = 0;
+		try
+		{
+			while (true)
+			{
+				sorter.scanNext((char *)&item);
+				got += item.key == got + 1;
+			}
+		}
+		catch (const EndOfFileException &e)
+		{
+		}
+		checkPassFail(got, 100)
+		checkPassFail(sorter.getPagesWritten(), 0)
+	}
+	{
+		// A budget of more pages than a pool of 12 frames has merges as many runs at once as the pool can
+		// pin, with a frame to spare for the caller, in more passes. The run in memory does not fit in the
+		// budget alongside a page for each run on disk, so it is written out too.
+		BufMgr smallPool(12);
+		ExternalSort sorter(&smallPool, sizeof(SortItem), 16 * Page::SIZE, sortItemLess, 1);
+		const int count = 150000;
+		SortItem item;
+		item.pad = 0;
+		for (int i = 0; i < count; i++)
+		{
+			item.key = (int)((long)i * 7919 % count);
+			item.seq = i;
+			sorter.add((const char *)&item);
+		}
+		const int runs = sorter.getRunCount();
+		checkPassFail((runs > 12), true)
+		int got = 0;
+		try
+		{
+			while (true)
+			{
+				sorter.scanNext((char *)&item);
+				got += item.key == got;
+			}
+		}
+		catch (const EndOfFileException &e)
+		{
+		}
+		checkPassFail(got, count)
+		checkPassFail(sorter.getRunCount(), runs + 1)
+		checkPassFail((sorter.getMergeCount() > 1), true)
+	}
+
+	// A bulk load streaming pairs from the sort builds the same index as one sorting them in memory
+	std::vector<RecordId> inMemory;
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+		inMemory = scanRids(index, 0, relationSize - 1);
+	}
+	deleteIndexFile();
+	std::vector<PayloadColumn> columns(1);
+	columns[0].set(offsetof(tuple, d), sizeof(double));
+	BuildOptions options;
+	options.sortMemory = 4 * Page::SIZE;
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, true, DEFAULT_FILL_FACTOR,
+					 columns, options);
+	checkPassFail((scanRids(index, 0, relationSize - 1) == inMemory), true)
+	int count;
+	checkPassFail(payloadErrors(index, count), 0)
+	checkPassFail(count, relationSize)
+}
+
+// -----------------------------------------------------------------------------
+// appendSplitTests
+// -----------------------------------------------------------------------------
+
+void appendSplitTests()
+{
+	std::cout << "Split the rightmost nodes of the integer index unevenly while keys are appended" << std::endl;
+	// Keys past those of the relation, inserted in increasing order, split the rightmost leaf every time.
+	// The fuller the leaves those splits leave behind, the smaller the file.
+	const int numNew = 20000;
+	const double fills[] = {0.5, DEFAULT_APPEND_FILL, 1.0};
+	std::ifstream::pos_type sizes[3];
+	std::vector<RecordId> rids;
+	for (int f = 0; f < 3; f++)
+	{
+		{
+			BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+			if (f == 0)
+			{
+				rids = scanRids(index, 0, relationSize - 1);
+			}
+			index.setAppendFill(fills[f]);
+			for (int key = relationSize; key < relationSize + numNew; key++)
+			{
+				index.insertEntry(&key, rids[key % relationSize]);
+			}
+			int low = 0, high = relationSize + numNew;
+			checkPassFail(index.countRange(&low, GTE, &high, LT), (size_t)(relationSize + numNew))
+			checkPassFail(intScan(&index, relationSize + numNew - 30, GTE, relationSize + numNew, LT), 30)
+		}
+		std::ifstream indexFile(intIndexName.c_str(), std::ios::binary | std::ios::ate);
+		sizes[f] = indexFile.tellg();
+		deleteIndexFile();
+	}
+	checkPassFail((sizes[1] < sizes[0]), true)
+	checkPassFail((sizes[2] <= sizes[1]), true)
+
+	// Batches of increasing keys take the same split, and enough of them split the rightmost non-leaves
+	// all the way up. With a fill of 1, each such split leaves a new non-leaf with a single child.
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+	index.setAppendFill(1.0);
+	const int numBatch = 400000;
+	std::vector<RIDKeyPair<int> > pairs(10000);
+	for (int from = relationSize; from < relationSize + numBatch; from += (int)pairs.size())
+	{
+		for (size_t i = 0; i < pairs.size(); i++)
+		{
+			pairs[i].set(rids[i % relationSize], from + (int)i);
+		}
+		index.insertBatch(&pairs[0], pairs.size());
+	}
+	int low = 0, high = relationSize + numBatch;
+	checkPassFail(index.countRange(&low, GTE, &high, LT), (size_t)(relationSize + numBatch))
+
+	// Deletes at the right edge empty its leaves, which have no sibling to merge with under a
+	// non-leaf with a single child, and appends after them go on as before
+	int deleted = 0;
+	for (int key = relationSize + numBatch - 2000; key < relationSize + numBatch; key++)
+	{
+		deleted += index.deleteEntry(&key, rids[(key - relationSize) % 10000 % relationSize]);
+	}
+	checkPassFail(deleted, 2000)
+	for (int key = relationSize + numBatch; key < relationSize + numBatch + 1000; key++)
+	{
+		index.insertEntry(&key, rids[key % relationSize]);
+	}
+	high = relationSize + numBatch + 1000;
+	checkPassFail(index.countRange(&low, GTE, &high, LT), (size_t)(relationSize + numBatch - 1000))
+	low = relationSize + numBatch - 2000;
+	checkPassFail(index.countRange(&low, GTE, &high, LT), 1000)
+	checkPassFail(intScan(&index, relationSize + numBatch - 2001, GTE, relationSize + numBatch + 5, LT), 6)
+}
+
+// -----------------------------------------------------------------------------
+// test_int_out_of_bound
+// -----------------------------------------------------------------------------
+
+void test_int_out_of_bound()
+{
+	std::cout << "Create a B+ Tree index on the integer field" << std::endl;
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+
+	// ranges entirely or partly outside of the keys in the relation
+	checkPassFail(intScan(&index, -1000, GT, -10, LT), 0)
+	checkPassFail(intScan(&index, relationSize, GTE, relationSize + 1000, LT), 0)
+	checkPassFail(intScan(&index, -1000, GT, 10, LT), 10)
+	checkPassFail(intScan(&index, relationSize - 10, GT, relationSize + 1000, LT), 9)
+	checkPassFail(intScan(&index, -1000, GT, relationSize + 1000, LT), relationSize)
+}
+
+// -----------------------------------------------------------------------------
+// createTrueRandom
+// -----------------------------------------------------------------------------
+
+std::vector<int> *createTrueRandom(int low, int high, int step)
+{
+	// destroy any old copies of relation file
+	try
+	{
+		File::remove(relationName);
+	}
+	catch (const FileNotFoundException &e)
+	{
+	}
+	file1 = new PageFile(relationName, true);
+
+	// initialize all of record1.s to keep purify happy
+	memset(record1.s, ' ', sizeof(record1.s));
+	PageId new_page_number;
+	Page new_page = file1->allocatePage(new_page_number);
+
+	// keep each value in [low, high) with probability 1/step, in random order
+	std::vector<int> *sortedvec = new std::vector<int>();
+	for (int v = low; v < high; v++)
+	{
+		if (random() % step == 0)
+		{
+			sortedvec->push_back(v);
+		}
+	}
+	std::vector<int> intvec(*sortedvec);
+	for (int i = (int)intvec.size() - 1; i > 0; i--)
+	{
+		std::swap(intvec[i], intvec[random() % (i + 1)]);
+	}
+
+	for (size_t i = 0; i < intvec.size(); i++)
+	{
+		sprintf(record1.s, "%05d string record", intvec[i]);
+		record1.i = intvec[i];
+		record1.d = intvec[i];
+
+		std::string new_data(reinterpret_cast<char *>(&record1), sizeof(RECORD));
+
+		while (1)
+		{
+			try
+			{
+				new_page.insertRecord(new_data);
+				break;
+			}
+			catch (const InsufficientSpaceException &e)
+			{
+				file1->writePage(new_page_number, new_page);
+				new_page = file1->allocatePage(new_page_number);
+			}
+		}
+	}
+
+	file1->writePage(new_page_number, new_page);
+	return sortedvec;
+}
+
+// -----------------------------------------------------------------------------
+// randomIntTests
+// -----------------------------------------------------------------------------
+
+void randomIntTests(std::vector<int> *sortedvec)
+{
+	std::cout << "Create a B+ Tree index on the integer field" << std::endl;
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+
+	// compare scans of random ranges against the sorted list of keys
+	for (int t = 0; t < 20; t++)
+	{
+		int lowVal = sortedvec->front() - 10 + (int)(random() % (sortedvec->back() - sortedvec->front() + 20));
+		int highVal = lowVal + (int)(random() % 1000);
+		Operator lowOp = (t & 1) ? GT : GTE;
+		Operator highOp = (t & 2) ? LT : LTE;
+		int expected = 0;
+		for (size_t i = 0; i < sortedvec->size(); i++)
+		{
+			int v = (*sortedvec)[i];
+			if ((lowOp == GT ? v > lowVal : v >= lowVal) && (highOp == LT ? v < highVal : v <= highVal))
+			{
+				expected++;
+			}
+		}
+		checkPassFail(intScan(&index, lowVal, lowOp, highVal, highOp), expected)
+	}
+}
+
+int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp)
+{
+	RecordId scanRid;
+	Page *curPage;
+
+	std::cout << "Scan for ";
+	if (lowOp == GT)
+	{
+		std::cout << "(";
+	}
+	else
+	{
+		std::cout << "[";
+	}
+	std::cout << lowVal << "," << highVal;
+	if (highOp == LT)
+	{
+		std::cout << ")";
+	}
+	else
+	{
+		std::cout << "]";
+	}
+	std::cout << std::endl;
+
+	int numResults = 0;
+
+	try
+	{
+		index->startScan(&lowVal, lowOp, &highVal, highOp);
+	}
+	catch (const NoSuchKeyFoundException &e)
+	{
+		std::cout << "No Key Found satisfying the scan criteria." << std::endl;
+		return 0;
+	}
+
+	while (1)
+	{
+		try
+		{
+			index->scanNext(scanRid);
+			bufMgr->readPage(file1, scanRid.page_number, curPage);
+			RECORD myRec = *(reinterpret_cast<const RECORD *>(curPage->getRecord(scanRid).data()));
+			bufMgr->unPinPage(file1, scanRid.page_number, false);
+
+			if (numResults < 5)
+			{
+				std::cout << "at:" << scanRid.page_number << "," << scanRid.slot_number;
+				std::cout << " -->:" << myRec.i << ":" << myRec.d << ":" << myRec.s << ":" << std::endl;
+			}
+			else if (numResults == 5)
+			{
+				std::cout << "..." << std::endl;
+			}
+		}
+		catch (const IndexScanCompletedException &e)
+		{
+			break;
+		}
+
+		numResults++;
+	}
+
+	if (numResults >= 5)
+	{
+		std::cout << "Number of results: " << numResults << std::endl;
+	}
+	index->endScan();
+	std::cout << std::endl;
+
+	return numResults;
+}
+
+int doubleScan(BTreeIndex *index, double lowVal, Operator lowOp, double highVal, Operator highOp)
+{
+	RecordId scanRid;
+	Page *curPage;
+
+	std::cout << "Scan for ";
+	if (lowOp == GT)
+	{
+		std::cout << "(";
+	}
+	else
+	{
+		std::cout << "[";
+	}
+	std::cout << lowVal << "," << highVal;
+	if (highOp == LT)
+	{
+		std::cout << ")";
+	}
+	else
+	{
+		std::cout << "]";
+	}
+	std::cout << std::endl;
+
+	int numResults = 0;
+
+	try
+	{
+		index->startScan(&lowVal, lowOp, &highVal, highOp);
+	}
+	catch (const NoSuchKeyFoundException &e)
+	{
+		std::cout << "No Key Found satisfying the scan criteria." << std::endl;
+		return 0;
+	}
+
+	while (1)
+	{
+		try
+		{
+			index->scanNext(scanRid);
+			bufMgr->readPage(file1, scanRid.page_number, curPage);
+			RECORD myRec = *(reinterpret_cast<const RECORD *>(curPage->getRecord(scanRid).data()));
+			bufMgr->unPinPage(file1, scanRid.page_number, false);
+
+			if (numResults < 5)
+			{
+				std::cout << "at:" << scanRid.page_number << "," << scanRid.slot_number;
+				std::cout << " -->:" << myRec.i << ":" << myRec.d << ":" << myRec.s << ":" << std::endl;
+			}
+			else if (numResults == 5)
+			{
+				std::cout << "..." << std::endl;
+			}
+		}
+		catch (const IndexScanCompletedException &e)
+		{
+			break;
+		}
+
+		numResults++;
+	}
+
+	if (numResults >= 5)
+	{
+		std::cout << "Number of results: " << numResults << std::endl;
+	}
+	index->endScan();
+	std::cout << std::endl;
+
+	return numResults;
+}
+
+int stringScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp)
+{
+	RecordId scanRid;
+	Page *curPage;
+
+	std::cout << "Scan for ";
+	if (lowOp == GT)
+	{
+		std::cout << "(";
+	}
+	else
+	{
+		std::cout << "[";
+	}
+	std::cout << lowVal << "," << highVal;
+	if (highOp == LT)
+	{
+		std::cout << ")";
+	}
+	else
+	{
+		std::cout << "]";
+	}
+	std::cout << std::endl;
+
+	// Keys are the leading characters of the string field, which starts with the zero padded number
+	char lowValStr[100];
+	sprintf(lowValStr, "%05d string record", lowVal);
+	char highValStr[100];
+	sprintf(highValStr, "%05d string record", highVal);
+
+	int numResults = 0;
+
+	try
+	{
+		index->startScan(lowValStr, lowOp, highValStr, highOp);
+	}
+	catch (const NoSuchKeyFoundException &e)
+	{
+		std::cout << "No Key Found satisfying the scan criteria." << std::endl;
+		return 0;
+	}
+
+	while (1)
+	{
+		try
+		{
+			index->scanNext(scanRid);
+			bufMgr->readPage(file1, scanRid.page_number, curPage);
+			RECORD myRec = *(reinterpret_cast<const RECORD *>(curPage->getRecord(scanRid).data()));
+			bufMgr->unPinPage(file1, scanRid.page_number, false);
+
+			if (numResults < 5)
+			{
+				std::cout << "at:" << scanRid.page_number << "," << scanRid.slot_number;
+				std::cout << " -->:" << myRec.i << ":" << myRec.d << ":" << myRec.s << ":" << std::endl;
+			}
+			else if (numResults == 5)
+			{
+				std::cout << "..." << std::endl;
+			}
+		}
+		catch (const IndexScanCompletedException &e)
+		{
+			break;
+		}
+
+		numResults++;
+	}
+
+	if (numResults >= 5)
+	{
+		std::cout << "Number of results: " << numResults << std::endl;
+	}
+	index->endScan();
+	std::cout << std::endl;
+
+	return numResults;
+}
+
+int batchScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp, size_t batchSize)
+{
+	std::cout << "Batch scan for " << (lowOp == GT ? "(" : "[") << lowVal << "," << highVal
+			  << (highOp == LT ? ")" : "]") << " in batches of " << batchSize << std::endl;
+
+	try
+	{
+		index->startScan(&lowVal, lowOp, &highVal, highOp);
+	}
+	catch (const NoSuchKeyFoundException &e)
+	{
+		std::cout << "No Key Found satisfying the scan criteria." << std::endl;
+		return 0;
+	}
+
+	std::vector<RecordId> rids(batchSize);
+	int numResults = 0;
+	size_t got;
+	while ((got = index->scanNextBatch(&rids[0], batchSize)) > 0)
+	{
+		numResults += got;
+	}
+	index->endScan();
+	std::cout << "Number of results: " << numResults << std::endl;
 
 	return numResults;
 }
@@ -0,0 +1,277 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#include "types.h"
+
+namespace badgerdb
+{
+
+  class Page;
+
+  /**
+   * @brief Version latch of one B+ tree node, for optimistic lock coupling.
+   * The low bit is set while a writer holds the latch and every release that follows a change
+   * advances the version. A reader records the version, reads the node without latching it and
+   * then validates: if the version is unchanged, nothing it read was modified in between.
+   * Writers that only add to the entry counts of a non-leaf node do not take the latch. They join the
+   * node's counters instead, which many can do at once, and a writer taking the latch waits until they
+   * have left, so that no count is added to a node whose children have moved.
+   */
+  class VersionLatch
+  {
+  private:
+    /**
+     * Version, with the low bit set while a writer holds the latch.
+     */
+    std::atomic<std::uint64_t> word;
+
+    /**
+     * Writers adding to the entry counts of the node.
+     */
+    std::atomic<std::uint32_t> counters;
+
+    /**
+     * Wait, with the latch just taken, for the writers adding to the entry counts to leave.
+     */
+    void waitForCounters() const
+    {
+      while (counters.load(std::memory_order_seq_cst) > 0)
+      {
+        std::this_thread::yield();
+      }
+    }
+
+  public:
+    VersionLatch()
+        : word(0), counters(0)
+    {
+    }
+
+    /**
+     * Wait until no writer holds the latch and return the version of the node.
+     */
+    std::uint64_t readLock() const
+    {
+      std::uint64_t version = word.load(std::memory_order_acquire);
+      while (version & 1)
+      {
+        std::this_thread::yield();
+        version = word.load(std::memory_order_acquire);
+      }
+      return version;
+    }
+
+    /**
+     * True if the node is still at the version returned by readLock, so that what was read since is consistent.
+     */
+    bool validate(const std::uint64_t version) const
+    {
+      std::atomic_thread_fence(std::memory_order_acquire);
+      return word.load(std::memory_order_relaxed) == version;
+    }
+
+    /**
+     * Take the latch for writing, provided the node is still at the given version. Waits only for the writers
+     * adding to the entry counts to leave, which may take mutexes meanwhile, so the caller must hold none.
+     * @return	False if the node changed or another writer holds the latch
+     */
+    bool upgrade(std::uint64_t version)
+    {
+      if (!word.compare_exchange_strong(version, version + 1, std::memory_order_seq_cst))
+      {
+        return false;
+      }
+      waitForCounters();
+      return true;
+    }
+
+    /**
+     * Take the latch for writing at whatever version the node is at, provided no writer holds it. Never waits.
+     * For nodes that are read only once latched, such as the sibling a delete rebalances with.
+     * @return	False if another writer holds the latch or writers are adding to the entry counts
+     */
+    bool tryLock()
+    {
+      std::uint64_t version = word.load(std::memory_order_relaxed);
+      if ((version & 1) || !word.compare_exchange_strong(version, version + 1, std::memory_order_seq_cst))
+      {
+        return false;
+      }
+      // Callers may hold other locks, which writers adding to counts can wait for, so this backs off instead
+      if (counters.load(std::memory_order_seq_cst) > 0)
+      {
+        unlockUnchanged();
+        return false;
+      }
+      return true;
+    }
+
+    /**
+     * Join the writers adding to the entry counts of the node, provided it is still at the given version. Never
+     * waits. Until leaveCounters, no writer changes the node, though the counts may change under readers.
+     * @return	False if the node changed or a writer holds the latch
+     */
+    bool joinCounters(const std::uint64_t version)
+    {
+      counters.fetch_add(1, std::memory_order_seq_cst);
+      if (word.load(std::memory_order_seq_cst) != version)
+      {
+        counters.fetch_sub(1, std::memory_order_release);
+        return false;
+      }
+      return true;
+    }
+
+    /**
+     * Leave the writers adding to the entry counts, after joinCounters.
+     */
+    void leaveCounters()
+    {
+      counters.fetch_sub(1, std::memory_order_release);
+    }
+
+    /**
+     * Release the latch after changing the node, which gives it a new version.
+     */
+    void unlock()
+    {
+      word.fetch_add(1, std::memory_order_release);
+    }
+
+    /**
+     * Release the latch without having changed the node, which keeps its version so readers do not restart.
+     */
+    void unlockUnchanged()
+    {
+      word.fetch_sub(1, std::memory_order_release);
+    }
+  };
+
+  /**
+   * @brief Version latches of the pages of one index file, indexed by page number, with the frame each page is
+   * swizzled to, if any, and the snapshot it was last copied for. Latches are created a chunk at a time as the file grows and never move, so looking one
+   * up takes no lock.
+   */
+  class NodeLatchTable
+  {
+  private:
+    /**
+     * Latch, swizzled frame and snapshot copy epoch of one page.
+     */
+    struct Entry
+    {
+      VersionLatch latch;
+
+      /**
+       * Frame the page is pinned in while its index keeps it swizzled, NULL otherwise.
+       */
+      std::atomic<Page *> frame;
+
+      /**
+       * Epoch of the newest snapshot the page has been copied for before a change, 0 if none. Written under the latch.
+       */
+      std::uint64_t copied;
+
+      Entry()
+          : frame(NULL), copied(0)
+      {
+      }
+    };
+
+    /**
+     * Latches per chunk, as a power of two.
+     */
+    static const int CHUNK_BITS = 12;
+
+    /**
+     * Number of chunks, which bounds the page numbers that can be latched to 2^28.
+     */
+    static const int MAX_CHUNKS = 1 << 16;
+
+    /**
+     * Chunks of latches, NULL until a page in the chunk is first latched.
+     */
+    std::atomic<Entry *> chunks[MAX_CHUNKS];
+
+    /**
+     * Serializes the creation of chunks.
+     */
+    std::mutex growMutex;
+
+    NodeLatchTable(const NodeLatchTable &) = delete;
+    NodeLatchTable &operator=(const NodeLatchTable &) = delete;
+
+    /**
+     * Entry of the given page.
+     */
+    Entry &entry(const PageId pageNo)
+    {
+      const std::uint32_t chunk = (pageNo >> CHUNK_BITS) % MAX_CHUNKS;
+      Entry *entries = chunks[chunk].load(std::memory_order_acquire);
+      if (entries == NULL)
+      {
+        std::lock_guard<std::mutex> guard(growMutex);
+        entries = chunks[chunk].load(std::memory_order_relaxed);
+        if (entries == NULL)
+        {
+          entries = new Entry[1 << CHUNK_BITS];
+          chunks[chunk].store(entries, std::memory_order_release);
+        }
+      }
+      return entries[pageNo & ((1 << CHUNK_BITS) - 1)];
+    }
+
+  public:
+    NodeLatchTable()
+    {
+      for (int i = 0; i < MAX_CHUNKS; i++)
+      {
+        chunks[i].store(NULL, std::memory_order_relaxed);
+      }
+    }
+
+    ~NodeLatchTable()
+    {
+      for (int i = 0; i < MAX_CHUNKS; i++)
+      {
+        delete[] chunks[i].load(std::memory_order_relaxed);
+      }
+    }
+
+    /**
+     * Latch of the given page.
+     */
+    VersionLatch &get(const PageId pageNo)
+    {
+      return entry(pageNo).latch;
+    }
+
+    /**
+     * Frame the given page is swizzled to, which a descent follows in place of a buffer manager lookup.
+     */
+    std::atomic<Page *> &frame(const PageId pageNo)
+    {
+      return entry(pageNo).frame;
+    }
+
+    /**
+     * Epoch of the newest snapshot the given page has been copied for, which the holder of its latch may update.
+     */
+    std::uint64_t &copied(const PageId pageNo)
+    {
+      return entry(pageNo).copied;
+    }
+  };
+
+}
@@ -0,0 +1,257 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "search_kernel.h"
+#include <atomic>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SEARCH_KERNEL_X86
+#include <immintrin.h>
+#endif
+
+namespace badgerdb
+{
+
+	/**
+	 * Number of keys the vector kernels count once binary search has narrowed the range down.
+	 * Counting a whole block, four vectors wide, is cheaper than the last few binary search steps.
+	 */
+	static const int SSE4_BLOCK = 16;
+	static const int AVX2_BLOCK = 32;
+
+	// -----------------------------------------------------------------------------
+	// Linear scan
+	// -----------------------------------------------------------------------------
+
+	static int linearLowerBound(const int *keys, int n, int key)
+	{
+		int i = 0;
+		while (i < n && keys[i] < key)
+			i++;
+		return i;
+	}
+
+	static int linearUpperBound(const int *keys, int n, int key)
+	{
+		int i = 0;
+		while (i < n && keys[i] <= key)
+			i++;
+		return i;
+	}
+
+	// -----------------------------------------------------------------------------
+	// Branchless binary search
+	// -----------------------------------------------------------------------------
+
+	static int binaryLowerBound(const int *keys, int n, int key)
+	{
+		if (n == 0)
+			return 0;
+		const int *base = keys;
+		while (n > 1)
+		{
+			const int half = n / 2;
+			// Compiles to a conditional move, so there is no branch to mispredict
+			base = (base[half] < key) ? base + half : base;
+			n -= half;
+		}
+		return (int)(base - keys) + (*base < key);
+	}
+
+	static int binaryUpperBound(const int *keys, int n, int key)
+	{
+		if (n == 0)
+			return 0;
+		const int *base = keys;
+		while (n > 1)
+		{
+			const int half = n / 2;
+			base = (base[half] <= key) ? base + half : base;
+			n -= half;
+		}
+		return (int)(base - keys) + (*base <= key);
+	}
+
+	/**
+	 * Narrow [keys, keys + n) down to a block of at most block keys that contains the answer.
+	 * If upper is false the answer is the lower bound of key, otherwise its upper bound.
+	 * Returns the offset of the block and leaves its length in n.
+	 */
+	static inline int narrowToBlock(const int *keys, int &n, int key, bool upper, const int block)
+	{
+		const int *base = keys;
+		while (n > block)
+		{
+			const int half = n / 2;
+			const bool right = upper ? base[half] <= key : base[half] < key;
+			base = right ? base + half : base;
+			n -= half;
+		}
+		return (int)(base - keys);
+	}
+
+#ifdef SEARCH_KERNEL_X86
+
+	// -----------------------------------------------------------------------------
+	// SSE4.1 compare-and-count
+	// -----------------------------------------------------------------------------
+
+	/**
+	 * Number of keys in [keys, keys + n) that are less than key (or, if upper is set, less than or equal).
+	 */
+	__attribute__((target("sse4.1"))) static int sse4Count(const int *keys, int n, int key, bool upper)
+	{
+		// keys <= key is the same as keys < key + 1, except for the largest int
+		if (upper && key == 0x7fffffff)
+			return n;
+		const __m128i probe = _mm_set1_epi32(upper ? key + 1 : key);
+		// Each lane of a compare result is -1 where the key is smaller, so subtracting counts it
+		__m128i counts = _mm_setzero_si128();
+		int i = 0;
+		for (; i + 4 <= n; i += 4)
+		{
+			const __m128i block = _mm_loadu_si128((const __m128i *)(keys + i));
+			counts = _mm_sub_epi32(counts, _mm_cmpgt_epi32(probe, block));
+		}
+		counts = _mm_add_epi32(counts, _mm_shuffle_epi32(counts, _MM_SHUFFLE(1, 0, 3, 2)));
+		counts = _mm_add_epi32(counts, _mm_shuffle_epi32(counts, _MM_SHUFFLE(2, 3, 0, 1)));
+		int count = _mm_cvtsi128_si32(counts);
+		for (; i < n; i++)
+			count += upper ? keys[i] <= key : keys[i] < key;
+		return count;
+	}
+
+	__attribute__((target("sse4.1"))) static int sse4LowerBound(const int *keys, int n, int key)
+	{
+		const int offset = narrowToBlock(keys, n, key, false, SSE4_BLOCK);
+		return offset + sse4Count(keys + offset, n, key, false);
+	}
+
+	__attribute__((target("sse4.1"))) static int sse4UpperBound(const int *keys, int n, int key)
+	{
+		const int offset = narrowToBlock(keys, n, key, true, SSE4_BLOCK);
+		return offset + sse4Count(keys + offset, n, key, true);
+	}
+
+	// -----------------------------------------------------------------------------
+	// AVX2 compare-and-count
+	// -----------------------------------------------------------------------------
+
+	__attribute__((target("avx2"))) static int avx2Count(const int *keys, int n, int key, bool upper)
+	{
+		if (upper && key == 0x7fffffff)
+			return n;
+		const __m256i probe = _mm256_set1_epi32(upper ? key + 1 : key);
+		__m256i counts = _mm256_setzero_si256();
+		int i = 0;
+		for (; i + 8 <= n; i += 8)
+		{
+			const __m256i block = _mm256_loadu_si256((const __m256i *)(keys + i));
+			counts = _mm256_sub_epi32(counts, _mm256_cmpgt_epi32(probe, block));
+		}
+		__m128i half = _mm_add_epi32(_mm256_castsi256_si128(counts), _mm256_extracti128_si256(counts, 1));
+		half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+		half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+		int count = _mm_cvtsi128_si32(half);
+		for (; i < n; i++)
+			count += upper ? keys[i] <= key : keys[i] < key;
+		return count;
+	}
+
+	__attribute__((target("avx2"))) static int avx2LowerBound(const int *keys, int n, int key)
+	{
+		const int offset = narrowToBlock(keys, n, key, false, AVX2_BLOCK);
+		return offset + avx2Count(keys + offset, n, key, false);
+	}
+
+	__attribute__((target("avx2"))) static int avx2UpperBound(const int *keys, int n, int key)
+	{
+		const int offset = narrowToBlock(keys, n, key, true, AVX2_BLOCK);
+		return offset + avx2Count(keys + offset, n, key, true);
+	}
+
+#else
+
+	// Vector kernels are never selected off x86; these keep the kernel table complete.
+	static int sse4LowerBound(const int *keys, int n, int key) { return binaryLowerBound(keys, n, key); }
+	static int sse4UpperBound(const int *keys, int n, int key) { return binaryUpperBound(keys, n, key); }
+	static int avx2LowerBound(const int *keys, int n, int key) { return binaryLowerBound(keys, n, key); }
+	static int avx2UpperBound(const int *keys, int n, int key) { return binaryUpperBound(keys, n, key); }
+
+#endif
+
+	/**
+	 * All kernels, indexed by SearchKernelType.
+	 */
+	static const SearchKernel kernels[] = {
+		{SEARCH_LINEAR, "linear", linearLowerBound, linearUpperBound},
+		{SEARCH_BINARY, "binary", binaryLowerBound, binaryUpperBound},
+		{SEARCH_SSE4, "sse4", sse4LowerBound, sse4UpperBound},
+		{SEARCH_AVX2, "avx2", avx2LowerBound, avx2UpperBound}};
+
+	/**
+	 * Kernel used by the B+ tree, chosen on first use. Searches load it each time, so a switch reaches
+	 * indexes that are already open.
+	 */
+	static std::atomic<const SearchKernel *> activeKernel(NULL);
+
+	bool searchKernelSupported(const SearchKernelType type)
+	{
+		switch (type)
+		{
+		case SEARCH_LINEAR:
+		case SEARCH_BINARY:
+		case SEARCH_AUTO:
+			return true;
+#ifdef SEARCH_KERNEL_X86
+		case SEARCH_SSE4:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("sse4.1");
+		case SEARCH_AVX2:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2");
+#endif
+		default:
+			return false;
+		}
+	}
+
+	const SearchKernel &getSearchKernel(const SearchKernelType type)
+	{
+		if (type == SEARCH_AUTO)
+		{
+			if (searchKernelSupported(SEARCH_AVX2))
+				return kernels[SEARCH_AVX2];
+			if (searchKernelSupported(SEARCH_SSE4))
+				return kernels[SEARCH_SSE4];
+			return kernels[SEARCH_BINARY];
+		}
+		if (!searchKernelSupported(type))
+			return kernels[SEARCH_BINARY];
+		return kernels[type];
+	}
+
+	const SearchKernel &searchKernel()
+	{
+		const SearchKernel *kernel = activeKernel.load(std::memory_order_acquire);
+		if (kernel == NULL)
+		{
+			kernel = &getSearchKernel(SEARCH_AUTO);
+			activeKernel.store(kernel, std::memory_order_release);
+		}
+		return *kernel;
+	}
+
+	bool setSearchKernel(const SearchKernelType type)
+	{
+		if (!searchKernelSupported(type))
+			return false;
+		activeKernel.store(&getSearchKernel(type), std::memory_order_release);
+		return true;
+	}
+
+}
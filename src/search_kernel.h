@@ -0,0 +1,193 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstring>
+
+namespace badgerdb
+{
+
+  /**
+   * @brief Search kernels available for searching the sorted key arrays of B+ tree nodes.
+   */
+  enum SearchKernelType
+  {
+    SEARCH_LINEAR, /* Scan keys one at a time */
+    SEARCH_BINARY, /* Branchless binary search */
+    SEARCH_SSE4,   /* Binary search narrowed to a block that is counted with SSE4.1 compares */
+    SEARCH_AVX2,   /* Binary search narrowed to a block that is counted with AVX2 compares */
+    SEARCH_AUTO    /* Fastest kernel the CPU supports */
+  };
+
+  /**
+   * @brief Set of functions searching a sorted array of n INTEGER keys.
+   * lowerBound returns the number of keys less than key, that is the index of the first key >= key.
+   * upperBound returns the number of keys less than or equal to key, that is the index of the first key > key.
+   */
+  struct SearchKernel
+  {
+    /**
+     * Kernel this is.
+     */
+    SearchKernelType type;
+
+    /**
+     * Name of the kernel, for reporting.
+     */
+    const char *name;
+
+    /**
+     * Index of the first key >= key.
+     */
+    int (*lowerBound)(const int *keys, int n, int key);
+
+    /**
+     * Index of the first key > key.
+     */
+    int (*upperBound)(const int *keys, int n, int key);
+  };
+
+  /**
+   * Index of the first key >= key in a sorted array of n keys of any ordered type.
+   * The kernels work on INTEGER keys; other key types use branchless binary search.
+   */
+  template <class T>
+  inline int keyLowerBound(const SearchKernel &kernel, const T *keys, int n, const T &key)
+  {
+    if (n == 0)
+      return 0;
+    const T *base = keys;
+    while (n > 1)
+    {
+      const int half = n / 2;
+      base = (base[half] < key) ? base + half : base;
+      n -= half;
+    }
+    return (int)(base - keys) + (*base < key);
+  }
+
+  /**
+   * Index of the first key > key in a sorted array of n keys of any ordered type.
+   */
+  template <class T>
+  inline int keyUpperBound(const SearchKernel &kernel, const T *keys, int n, const T &key)
+  {
+    if (n == 0)
+      return 0;
+    const T *base = keys;
+    while (n > 1)
+    {
+      const int half = n / 2;
+      base = (base[half] <= key) ? base + half : base;
+      n -= half;
+    }
+    return (int)(base - keys) + (*base <= key);
+  }
+
+  inline int keyLowerBound(const SearchKernel &kernel, const int *keys, int n, const int &key)
+  {
+    return kernel.lowerBound(keys, n, key);
+  }
+
+  inline int keyUpperBound(const SearchKernel &kernel, const int *keys, int n, const int &key)
+  {
+    return kernel.upperBound(keys, n, key);
+  }
+
+  /**
+   * Index of the first of n sorted keys that is >= key, or > key if upper, given the order-preserving INTEGER
+   * prefix of every key and that of key. Keys with a smaller or larger prefix are smaller or larger, so the
+   * kernel finds the keys with the same prefix and only those are compared whole, usually none or one.
+   */
+  template <class T>
+  inline int prefixBound(const SearchKernel &kernel, const int *prefixes, const T *keys, int n, int prefix,
+                         const T &key, bool upper)
+  {
+    const int first = kernel.lowerBound(prefixes, n, prefix);
+    if (first == n || prefixes[first] != prefix)
+      return first;
+    // Prefixes read while they change can be out of order, so the ties are never fewer than none
+    int ties = kernel.upperBound(prefixes, n, prefix) - first;
+    ties = ties > 0 ? ties : 0;
+    return first + (upper ? keyUpperBound(kernel, keys + first, ties, key) : keyLowerBound(kernel, keys + first, ties, key));
+  }
+
+  /**
+   * Most leading bytes of a key of type T that its prefix can be taken after, so that the prefix stays inside the key.
+   */
+  template <class T>
+  inline int maxPrefixOffset()
+  {
+    return (int)(sizeof(T) - sizeof(int));
+  }
+
+  /**
+   * Number of leading bytes, up to maxPrefixOffset, that all of n sorted keys of a byte-compared type share.
+   * As the keys are sorted, those the first and the last share.
+   */
+  template <class T>
+  inline int sharedPrefixOffset(const T *keys, int n)
+  {
+    int offset = 0;
+    if (n > 1)
+    {
+      while (offset < maxPrefixOffset<T>() && keys[0].value[offset] == keys[n - 1].value[offset])
+        offset++;
+    }
+    return offset;
+  }
+
+  /**
+   * prefixBound for n sorted keys that share their first offset bytes, with prefixes taken from there on by
+   * Traits::prefix. A key that differs from them in those bytes goes before or after all of them, unsearched.
+   */
+  template <class Traits, class T>
+  inline int sharedPrefixBound(const SearchKernel &kernel, const int *prefixes, const T *keys, int n, int offset,
+                               const T &key, bool upper)
+  {
+    if (n == 0)
+      return 0;
+    const int shared = memcmp(key.value, keys[0].value, offset);
+    if (shared != 0)
+      return shared < 0 ? 0 : n;
+    return prefixBound(kernel, prefixes, keys, n, Traits::prefix(key, offset), key, upper);
+  }
+
+  /**
+   * Returns true if the CPU this runs on can execute the given kernel.
+   * Checked with CPUID, so a binary built on one machine picks the right kernel on another.
+   *
+   * @param type	Kernel to check
+   */
+  bool searchKernelSupported(const SearchKernelType type);
+
+  /**
+   * Returns the kernel of the given type.
+   * SEARCH_AUTO resolves to the fastest kernel the CPU supports.
+   *
+   * @param type	Kernel to return
+   * @return	The kernel, or the binary search kernel if the CPU does not support the requested one
+   */
+  const SearchKernel &getSearchKernel(const SearchKernelType type);
+
+  /**
+   * Returns the kernel used by the B+ tree for all in-node searches.
+   * Defaults to SEARCH_AUTO the first time it is called.
+   */
+  const SearchKernel &searchKernel();
+
+  /**
+   * Changes the kernel used by the B+ tree for all in-node searches, including those of indexes that are
+   * already open. Searches under way finish with the kernel they started with.
+   *
+   * @param type	Kernel to use
+   * @return	False if the CPU does not support the kernel, in which case the active kernel is unchanged
+   */
+  bool setSearchKernel(const SearchKernelType type);
+
+}